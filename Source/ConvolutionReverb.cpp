@@ -0,0 +1,489 @@
+#include "ConvolutionReverb.h"
+
+namespace
+{
+// The FFT's interleaved (re, im) bins to and from the split layout the spectra are kept in.
+void splitBins (const float* interleaved, float* split, int numBins) noexcept
+{
+    for (int k = 0; k < numBins; ++k)
+    {
+        split[k] = interleaved[2 * k];
+        split[numBins + k] = interleaved[2 * k + 1];
+    }
+}
+
+void interleaveBins (const float* split, float* interleaved, int numBins) noexcept
+{
+    for (int k = 0; k < numBins; ++k)
+    {
+        interleaved[2 * k] = split[k];
+        interleaved[2 * k + 1] = split[numBins + k];
+    }
+}
+} // namespace
+
+ImpulseResponse::ImpulseResponse (const juce::AudioBuffer<float>& response, double responseSampleRate, double sampleRate)
+{
+    const auto numChannels = juce::jlimit (1, 2, response.getNumChannels());
+    const auto ratio = responseSampleRate / sampleRate;
+    const auto length = juce::jmin (static_cast<int> (std::ceil (response.getNumSamples() / ratio)),
+                                    static_cast<int> (maxSeconds * sampleRate));
+
+    juce::AudioBuffer<float> resampled (numChannels, juce::jmax (1, length));
+    resampled.clear();
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        if (juce::approximatelyEqual (ratio, 1.0))
+        {
+            resampled.copyFrom (ch, 0, response, ch, 0, juce::jmin (length, response.getNumSamples()));
+            continue;
+        }
+
+        // Zero padding lets the interpolator read past the last sample.
+        std::vector<float> padded ((size_t) response.getNumSamples() + 8, 0.0f);
+        std::copy_n (response.getReadPointer (ch), response.getNumSamples(), padded.begin());
+
+        juce::LagrangeInterpolator interpolator;
+        interpolator.process (ratio, padded.data(), resampled.getWritePointer (ch), length);
+    }
+
+    // Unit energy per channel keeps the wet level independent of the response's length and gain.
+    auto energy = 0.0;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+        for (int i = 0; i < resampled.getNumSamples(); ++i)
+            energy += juce::square (static_cast<double> (resampled.getSample (ch, i)));
+
+    if (energy > 0.0)
+        resampled.applyGain (static_cast<float> (1.0 / std::sqrt (energy / numChannels)));
+
+    lengthSeconds = resampled.getNumSamples() / sampleRate;
+    partition (head, resampled, 0, juce::jmin (headLength, resampled.getNumSamples()), headPartition);
+    partition (tail, resampled, headLength, resampled.getNumSamples(), tailPartition);
+}
+
+void ImpulseResponse::partition (Segment& segment, const juce::AudioBuffer<float>& response, int start, int end, int partitionSize)
+{
+    const auto fftSize = 2 * partitionSize;
+    const auto spectrumSize = fftSize + 2;
+    const juce::dsp::FFT fft (juce::roundToInt (std::log2 (fftSize)));
+    std::vector<float> scratch ((size_t) (2 * fftSize));
+
+    segment.partitionSize = partitionSize;
+    segment.numPartitions = juce::jmax (0, (end - start + partitionSize - 1) / partitionSize);
+    segment.numChannels = response.getNumChannels();
+
+    for (int ch = 0; ch < segment.numChannels; ++ch)
+    {
+        auto& spectra = segment.spectra[(size_t) ch];
+        spectra.assign ((size_t) (segment.numPartitions * spectrumSize), 0.0f);
+
+        for (int p = 0; p < segment.numPartitions; ++p)
+        {
+            const auto offset = start + p * partitionSize;
+            std::fill (scratch.begin(), scratch.end(), 0.0f);
+            std::copy_n (response.getReadPointer (ch, offset), juce::jmin (partitionSize, end - offset), scratch.begin());
+
+            fft.performRealOnlyForwardTransform (scratch.data(), true);
+            splitBins (scratch.data(), spectra.data() + p * spectrumSize, partitionSize + 1);
+        }
+    }
+}
+
+juce::AudioBuffer<float> ImpulseResponse::makeRoom (double sampleRate, double seconds)
+{
+    const auto length = juce::jmax (1, static_cast<int> (seconds * sampleRate));
+    juce::AudioBuffer<float> room (2, length);
+
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        // Fixed seeds keep renders reproducible; different ones decorrelate the channels.
+        juce::Random random (ch + 1);
+        auto* data = room.getWritePointer (ch);
+        auto smoothed = 0.0f;
+
+        for (int i = 0; i < length; ++i)
+        {
+            const auto t = static_cast<float> (i) / static_cast<float> (length);
+            const auto envelope = std::exp (-6.91f * t) * juce::jmin (1.0f, static_cast<float> (i) / (0.004f * static_cast<float> (sampleRate)));
+
+            // The lowpass closes over time, so the tail darkens as it decays.
+            smoothed += (0.9f - 0.8f * t) * (random.nextFloat() * 2.0f - 1.0f - smoothed);
+            data[i] = envelope * smoothed;
+        }
+    }
+
+    return room;
+}
+
+size_t ImpulseResponse::getMemoryBytes() const noexcept
+{
+    size_t bytes = sizeof (*this);
+
+    for (const auto* segment : { &head, &tail })
+        for (const auto& spectra : segment->spectra)
+            bytes += spectra.capacity() * sizeof (float);
+
+    return bytes;
+}
+
+//==============================================================================
+std::unique_ptr<ImpulseResponse> ImpulseResponse::load (const juce::File& file, double sampleRate)
+{
+    if (file == juce::File())
+        return std::make_unique<ImpulseResponse> (makeRoom (sampleRate, roomSeconds), sampleRate, sampleRate);
+
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    std::unique_ptr<juce::AudioFormatReader> reader (formats.createReaderFor (file));
+
+    if (reader == nullptr || reader->lengthInSamples <= 0)
+        return nullptr;
+
+    const auto length = static_cast<int> (juce::jmin (reader->lengthInSamples, static_cast<juce::int64> (maxSeconds * reader->sampleRate)));
+    juce::AudioBuffer<float> buffer (static_cast<int> (juce::jlimit (1u, 2u, reader->numChannels)), length);
+    reader->read (&buffer, 0, length, 0, true, buffer.getNumChannels() > 1);
+
+    return std::make_unique<ImpulseResponse> (buffer, reader->sampleRate, sampleRate);
+}
+
+//==============================================================================
+void ConvolutionReverb::Engine::Stage::init (const ImpulseResponse::Segment& newSegment, int skipPartitions, int steps)
+{
+    // Without a skipped partition the newest input is needed straight away, so nothing can be done ahead.
+    jassert (skipPartitions > 0 || steps == 1);
+
+    segment = &newSegment;
+    partitionSize = newSegment.partitionSize;
+    spectrumSize = 2 * partitionSize + 2;
+    skip = skipPartitions;
+    numSteps = juce::jmax (1, steps);
+    numSlots = newSegment.numPartitions + skip;
+    fft = std::make_unique<juce::dsp::FFT> (juce::roundToInt (std::log2 (2 * partitionSize)));
+
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        window[(size_t) ch].assign ((size_t) (2 * partitionSize), 0.0f);
+        history[(size_t) ch].assign ((size_t) (numSlots * spectrumSize), 0.0f);
+        output[(size_t) ch].assign ((size_t) partitionSize, 0.0f);
+        accumulator[(size_t) ch].assign ((size_t) spectrumSize, 0.0f);
+    }
+
+    scratch.assign ((size_t) (4 * partitionSize), 0.0f);
+    slot = 0;
+    fill = 0;
+    nextPartition = 0;
+}
+
+size_t ConvolutionReverb::Engine::Stage::getMemoryBytes() const noexcept
+{
+    auto floats = scratch.capacity();
+
+    for (int ch = 0; ch < 2; ++ch)
+        floats += window[(size_t) ch].capacity() + history[(size_t) ch].capacity() + output[(size_t) ch].capacity()
+                + accumulator[(size_t) ch].capacity();
+
+    return sizeof (*this) + floats * sizeof (float);
+}
+
+void ConvolutionReverb::Engine::Stage::clear() noexcept
+{
+    for (int ch = 0; ch < 2; ++ch)
+    {
+        std::fill (window[(size_t) ch].begin(), window[(size_t) ch].end(), 0.0f);
+        std::fill (history[(size_t) ch].begin(), history[(size_t) ch].end(), 0.0f);
+        std::fill (output[(size_t) ch].begin(), output[(size_t) ch].end(), 0.0f);
+        std::fill (accumulator[(size_t) ch].begin(), accumulator[(size_t) ch].end(), 0.0f);
+    }
+
+    slot = 0;
+    fill = 0;
+    nextPartition = 0;
+}
+
+void ConvolutionReverb::Engine::Stage::accumulate (int numChannels, int step) noexcept
+{
+    using Ops = juce::FloatVectorOperations;
+
+    const auto numBins = partitionSize + 1;
+    const auto end = segment->numPartitions * juce::jlimit (0, numSteps, step) / numSteps;
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        const auto* hist = history[(size_t) ch].data();
+        const auto* spectra = segment->spectra[(size_t) juce::jmin (ch, segment->numChannels - 1)].data();
+        auto* accRe = accumulator[(size_t) ch].data();
+        auto* accIm = accRe + numBins;
+
+        for (int p = nextPartition; p < end; ++p)
+        {
+            const auto* xRe = hist + ((slot - skip - p + 2 * numSlots) % numSlots) * spectrumSize;
+            const auto* xIm = xRe + numBins;
+            const auto* hRe = spectra + p * spectrumSize;
+            const auto* hIm = hRe + numBins;
+
+            Ops::addWithMultiply (accRe, xRe, hRe, numBins);
+            Ops::subtractWithMultiply (accRe, xIm, hIm, numBins);
+            Ops::addWithMultiply (accIm, xRe, hIm, numBins);
+            Ops::addWithMultiply (accIm, xIm, hRe, numBins);
+        }
+    }
+
+    nextPartition = juce::jmax (nextPartition, end);
+}
+
+void ConvolutionReverb::Engine::Stage::convolve (int numChannels) noexcept
+{
+    const auto numBins = partitionSize + 1;
+    auto* x = scratch.data();
+
+    // Overlap-save: transform the last two partitions of input and keep the spectrum for later partitions.
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto& win = window[(size_t) ch];
+
+        std::copy (win.begin(), win.end(), x);
+        std::fill (x + 2 * partitionSize, x + 4 * partitionSize, 0.0f);
+        fft->performRealOnlyForwardTransform (x, true);
+        splitBins (x, history[(size_t) ch].data() + slot * spectrumSize, numBins);
+        std::copy (win.begin() + partitionSize, win.end(), win.begin());
+    }
+
+    // Whatever the steps in between have not covered yet (all of it when numSteps is 1).
+    accumulate (numChannels, numSteps);
+
+    for (int ch = 0; ch < numChannels; ++ch)
+    {
+        auto& acc = accumulator[(size_t) ch];
+
+        std::fill (x, x + 4 * partitionSize, 0.0f);
+        interleaveBins (acc.data(), x, numBins);
+        fft->performRealOnlyInverseTransform (x);
+        std::copy_n (x + partitionSize, partitionSize, output[(size_t) ch].begin());
+        std::fill (acc.begin(), acc.end(), 0.0f);
+    }
+
+    nextPartition = 0;
+    slot = (slot + 1) % numSlots;
+}
+
+//==============================================================================
+ConvolutionReverb::ConvolutionReverb()
+    : juce::Thread ("Codex Piano impulse responses")
+{
+}
+
+ConvolutionReverb::~ConvolutionReverb()
+{
+    release();
+}
+
+void ConvolutionReverb::prepare (double newSampleRate)
+{
+    release();
+
+    sampleRate = newSampleRate;
+    current.store (nullptr);
+    engines.clear();
+
+    dry.reset (sampleRate, 0.05);
+    wet.reset (sampleRate, 0.05);
+
+    juce::File file;
+
+    {
+        const juce::ScopedLock scopedLock (requestLock);
+        file = requestedFile;
+        servedCount = requestCount.load();
+    }
+
+    install (buildEngine (file));
+    startThread (juce::Thread::Priority::background);
+}
+
+void ConvolutionReverb::release()
+{
+    stopThread (4000);
+}
+
+void ConvolutionReverb::loadImpulseResponse (const juce::File& file)
+{
+    {
+        const juce::ScopedLock scopedLock (requestLock);
+        requestedFile = file;
+    }
+
+    ++requestCount;
+    notify();
+}
+
+void ConvolutionReverb::setLevels (float dryLevel, float wetLevel) noexcept
+{
+    dry.setTargetValue (dryLevel);
+    wet.setTargetValue (wetLevel);
+}
+
+void ConvolutionReverb::process (float* left, float* right, int numSamples) noexcept
+{
+    Engine* engine = nullptr;
+
+    do
+    {
+        engine = current.load();
+        inUse.store (engine);
+    }
+    while (engine != current.load());
+
+    if (engine == nullptr)
+    {
+        inUse.store (nullptr);
+        return;
+    }
+
+    const auto numChannels = right != nullptr ? 2 : 1;
+    auto& head = engine->headStage;
+    auto& tail = engine->tailStage;
+    const auto hasTail = tail.segment->numPartitions > 0;
+    float* channels[] = { left, right };
+
+    for (int done = 0; done < numSamples;)
+    {
+        // Tail partitions are a whole number of head partitions, so both stages fill up on the same sample.
+        const auto count = juce::jmin (numSamples - done, head.partitionSize - head.fill);
+        const auto smoothing = dry.isSmoothing() || wet.isSmoothing();
+        auto dryLevel = dry.getTargetValue();
+        auto wetLevel = wet.getTargetValue();
+
+        for (int i = 0; i < count; ++i)
+        {
+            if (smoothing)
+            {
+                dryLevel = dry.getNextValue();
+                wetLevel = wet.getNextValue();
+            }
+
+            for (int ch = 0; ch < numChannels; ++ch)
+            {
+                auto& sample = channels[ch][done + i];
+                const auto in = sample;
+                auto wetSample = head.output[(size_t) ch][(size_t) (head.fill + i)];
+                head.window[(size_t) ch][(size_t) (head.partitionSize + head.fill + i)] = in;
+
+                if (hasTail)
+                {
+                    wetSample += tail.output[(size_t) ch][(size_t) (tail.fill + i)];
+                    tail.window[(size_t) ch][(size_t) (tail.partitionSize + tail.fill + i)] = in;
+                }
+
+                sample = dryLevel * in + wetLevel * wetSample;
+            }
+        }
+
+        done += count;
+        head.fill += count;
+        tail.fill += count;
+
+        if (head.fill == head.partitionSize)
+        {
+            head.convolve (numChannels);
+            head.fill = 0;
+
+            // The tail's multiply-adds are shared out over the head partitions, rather than all landing on the
+            // callback where the tail partition completes.
+            if (hasTail && tail.fill < tail.partitionSize)
+                tail.accumulate (numChannels, tail.fill / head.partitionSize);
+        }
+
+        if (tail.fill == tail.partitionSize)
+        {
+            if (hasTail)
+                tail.convolve (numChannels);
+
+            tail.fill = 0;
+        }
+    }
+
+    inUse.store (nullptr);
+}
+
+void ConvolutionReverb::reset() noexcept
+{
+    if (auto* engine = current.load())
+    {
+        inUse.store (engine);
+
+        if (engine == current.load())
+        {
+            engine->headStage.clear();
+            engine->tailStage.clear();
+        }
+
+        inUse.store (nullptr);
+    }
+}
+
+void ConvolutionReverb::run()
+{
+    while (! threadShouldExit())
+    {
+        if (const auto count = requestCount.load(); count != servedCount)
+        {
+            juce::File file;
+
+            {
+                const juce::ScopedLock scopedLock (requestLock);
+                file = requestedFile;
+            }
+
+            servedCount = count;
+            install (buildEngine (file));
+        }
+
+        freeRetiredEngines();
+        wait (100);
+    }
+}
+
+std::unique_ptr<ConvolutionReverb::Engine> ConvolutionReverb::buildEngine (const juce::File& file) const
+{
+    auto getResponse = [this] (const juce::File& source)
+    {
+        const auto key = "ir/" + (source == juce::File() ? juce::String ("room")
+                                                         : source.getFullPathName() + "@" + juce::String (source.getLastModificationTime().toMilliseconds()))
+                       + "@" + juce::String (sampleRate);
+
+        return sharedResources->get<ImpulseResponse> (key, [this, &source] { return ImpulseResponse::load (source, sampleRate); });
+    };
+
+    auto response = getResponse (file);
+
+    // Unreadable files fall back to the built-in room rather than silencing the reverb.
+    if (response == nullptr)
+        response = getResponse ({});
+
+    auto engine = std::make_unique<Engine>();
+    engine->response = std::move (response);
+    engine->headStage.init (engine->response->getHead(), 0, 1);
+    // The head stage's output is one head partition late; one skipped tail partition lines the tail up behind it,
+    // and lets its multiply-adds run a head partition at a time while the tail partition fills.
+    engine->tailStage.init (engine->response->getTail(), 1, ImpulseResponse::tailPartition / ImpulseResponse::headPartition);
+    return engine;
+}
+
+void ConvolutionReverb::install (std::unique_ptr<Engine> engine)
+{
+    tailSeconds.store (engine->response->getLengthSeconds(), std::memory_order_relaxed);
+    privateBytes.store (sizeof (Engine) + engine->headStage.getMemoryBytes() + engine->tailStage.getMemoryBytes(), std::memory_order_relaxed);
+    current.store (engine.get());
+    engines.push_back (std::move (engine));
+    freeRetiredEngines();
+}
+
+void ConvolutionReverb::freeRetiredEngines()
+{
+    engines.erase (std::remove_if (engines.begin(), engines.end(), [this] (const std::unique_ptr<Engine>& engine)
+    {
+        return engine.get() != current.load() && engine.get() != inUse.load();
+    }), engines.end());
+}
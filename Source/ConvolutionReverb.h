@@ -0,0 +1,136 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SharedResourceCache.h"
+
+// One impulse response at one sample rate, resampled, normalised and transformed into frequency-domain partitions.
+// Immutable once built, so every instance convolving with the same file shares a single copy via the SharedResourceCache.
+class ImpulseResponse
+{
+public:
+    // Two uniformly partitioned stages: short partitions cover the head for low latency, long ones the rest of the IR
+    // for a lower per-sample cost. The head length lines the tail stage's output up with the head's (see Stage).
+    static constexpr int headPartition = 128;
+    static constexpr int tailPartition = 1024;
+    static constexpr int headLength = 2 * tailPartition - headPartition;
+    static constexpr double maxSeconds = 12.0;
+    static constexpr double roomSeconds = 2.5;
+
+    struct Segment
+    {
+        int partitionSize = 0;
+        int numPartitions = 0;
+        int numChannels = 1;
+        // numPartitions spectra of partitionSize + 1 bins per channel, each stored as all its real parts and then all
+        // its imaginary parts, so the multiply-adds run as plain vector operations.
+        std::array<std::vector<float>, 2> spectra;
+    };
+
+    // Mono responses are used for both channels.
+    ImpulseResponse (const juce::AudioBuffer<float>& response, double responseSampleRate, double sampleRate);
+
+    // Decodes a file; an empty file gives the built-in room. Returns null if the file can't be read.
+    static std::unique_ptr<ImpulseResponse> load (const juce::File& file, double sampleRate);
+
+    // Diffuse, darkening stereo noise decay, used when no file is loaded.
+    static juce::AudioBuffer<float> makeRoom (double sampleRate, double seconds);
+
+    const Segment& getHead() const noexcept { return head; }
+    const Segment& getTail() const noexcept { return tail; }
+    double getLengthSeconds() const noexcept { return lengthSeconds; }
+    size_t getMemoryBytes() const noexcept;
+
+private:
+    static void partition (Segment&, const juce::AudioBuffer<float>&, int start, int end, int partitionSize);
+
+    Segment head, tail;
+    double lengthSeconds = 0.0;
+
+    JUCE_DECLARE_NON_COPYABLE (ImpulseResponse)
+};
+
+// Stereo uniformly partitioned overlap-save convolution in two stages. Impulse responses are loaded on a background
+// thread and swapped in through an atomic pointer; a hazard pointer keeps the engine in use from being freed.
+class ConvolutionReverb final : private juce::Thread
+{
+public:
+    ConvolutionReverb();
+    ~ConvolutionReverb() override;
+
+    // Message thread: builds the engine for the requested response synchronously and starts the loader thread.
+    void prepare (double newSampleRate);
+    void release();
+
+    // Any thread but the audio thread. An empty file selects the built-in room.
+    void loadImpulseResponse (const juce::File& file);
+
+    // Audio thread: level changes are smoothed. Mixes in place; right may be null for mono.
+    void setLevels (float dryLevel, float wetLevel) noexcept;
+    void process (float* left, float* right, int numSamples) noexcept;
+    void reset() noexcept;
+
+    // Length of the current response, i.e. the longest tail it can add.
+    double getTailSeconds() const noexcept { return tailSeconds.load (std::memory_order_relaxed); }
+
+    // Convolution state owned by this instance alone; the response itself is shared.
+    size_t getPrivateMemoryBytes() const noexcept { return privateBytes.load (std::memory_order_relaxed); }
+
+private:
+    // Per-instance convolution state for one impulse response; built on the loader thread, rendered on the audio thread.
+    struct Engine
+    {
+        // y for block k is sum_p X[k - skip - p] H[p], giving an output delay of (skip + 1) partitions. With skip > 0
+        // every input y needs is known a partition early, so its multiply-adds can be spread over numSteps calls.
+        struct Stage
+        {
+            const ImpulseResponse::Segment* segment = nullptr;
+            int partitionSize = 0;
+            int spectrumSize = 0;
+            int skip = 0;
+            int numSlots = 0;
+            int slot = 0;
+            int fill = 0;
+            int numSteps = 1;
+            int nextPartition = 0; // partitions already in the accumulator
+            std::array<std::vector<float>, 2> window, history, output, accumulator;
+            std::vector<float> scratch;
+            std::unique_ptr<juce::dsp::FFT> fft;
+
+            void init (const ImpulseResponse::Segment&, int skipPartitions, int steps);
+            size_t getMemoryBytes() const noexcept;
+            void clear() noexcept;
+
+            // Adds the partitions that fall to steps 1 to step (of numSteps) into the next output.
+            void accumulate (int numChannels, int step) noexcept;
+
+            // At the end of each partition: takes in the input, finishes the accumulation and produces the output.
+            void convolve (int numChannels) noexcept;
+        };
+
+        std::shared_ptr<const ImpulseResponse> response;
+        Stage headStage, tailStage;
+    };
+
+    void run() override;
+    std::unique_ptr<Engine> buildEngine (const juce::File& file) const;
+    void install (std::unique_ptr<Engine>);
+    void freeRetiredEngines();
+
+    juce::SharedResourcePointer<SharedResourceCache> sharedResources;
+    double sampleRate = 44100.0;
+
+    juce::CriticalSection requestLock;
+    juce::File requestedFile;
+    std::atomic<int> requestCount { 0 };
+    int servedCount = 0; // loader thread only
+
+    std::vector<std::unique_ptr<Engine>> engines; // loader/message thread only
+    std::atomic<Engine*> current { nullptr };
+    std::atomic<Engine*> inUse { nullptr };
+    std::atomic<double> tailSeconds { 0.0 };
+    std::atomic<size_t> privateBytes { 0 };
+
+    juce::SmoothedValue<float> dry { 1.0f }, wet { 0.0f };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ConvolutionReverb)
+};
@@ -0,0 +1,184 @@
+#include "EffectsPipeline.h"
+
+//==============================================================================
+class EffectsPipeline::EffectsThread final : public juce::Thread
+{
+public:
+    explicit EffectsThread (EffectsPipeline& ownerToUse)
+        : juce::Thread ("Codex Piano effects"), owner (ownerToUse)
+    {
+    }
+
+    void run() override
+    {
+        // Asleep until the audio thread queues a chunk, or release() wakes it to exit.
+        while (! threadShouldExit())
+        {
+            owner.chunksQueued.wait();
+            owner.processPendingChunks();
+        }
+    }
+
+private:
+    EffectsPipeline& owner;
+};
+
+//==============================================================================
+EffectsPipeline::EffectsPipeline() = default;
+
+EffectsPipeline::~EffectsPipeline()
+{
+    release();
+}
+
+void EffectsPipeline::prepare (int maxBlockSize, StageFunction stage, void* context)
+{
+    release();
+
+    stageFunction = stage;
+    stageContext = context;
+    latency = juce::jmax (1, maxBlockSize);
+
+    // The block being written and the one being read back are two latencies apart; the rest is room for the effects
+    // thread to fall behind before blocks have to be dropped.
+    const auto ringSize = juce::nextPowerOfTwo (4 * latency);
+    ring.setSize (2, ringSize);
+    ringMask = ringSize - 1;
+
+    // Both threads use the raw channels, as AudioBuffer's write accessors also update its cleared flag.
+    for (int ch = 0; ch < 2; ++ch)
+        ringChannels[(size_t) ch] = ring.getWritePointer (ch);
+
+    chunkFifo.reset();
+    reset();
+
+    thread = std::make_unique<EffectsThread> (*this);
+
+    if (! thread->startRealtimeThread (juce::Thread::RealtimeOptions{}))
+        thread->startThread (juce::Thread::Priority::highest);
+}
+
+void EffectsPipeline::release()
+{
+    if (thread != nullptr)
+    {
+        thread->signalThreadShouldExit();
+        chunksQueued.post();
+        thread->stopThread (1000);
+    }
+
+    thread.reset();
+}
+
+void EffectsPipeline::reset() noexcept
+{
+    if (thread != nullptr)
+        waitUntilProcessed (submitted);
+
+    // The ring starts with one latency of silence, already processed, so the first blocks read back zeros.
+    ring.clear();
+    submitted = latency;
+    processed.store (latency, std::memory_order_release);
+}
+
+void EffectsPipeline::process (float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept
+{
+    for (int offset = 0; offset < numSamples; offset += latency)
+    {
+        const auto blockSize = juce::jmin (latency, numSamples - offset);
+        submit (left + offset, right != nullptr ? right + offset : nullptr, blockSize, settings);
+    }
+}
+
+void EffectsPipeline::submit (float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept
+{
+    const auto start = submitted;
+
+    // Writing this block would overwrite audio the effects thread hasn't got to yet, or its queue is full.
+    if (processed.load (std::memory_order_acquire) < start + numSamples - (ringMask + 1) || chunkFifo.getFreeSpace() < 2)
+    {
+        dropBlock (left, right, numSamples);
+        return;
+    }
+
+    const auto offset = static_cast<int> (start & ringMask);
+    const auto firstPart = juce::jmin (numSamples, ringMask + 1 - offset);
+    const auto mono = right == nullptr;
+
+    // Chunks never wrap, so the stage always gets contiguous channels.
+    for (int ch = 0; ch < (mono ? 1 : 2); ++ch)
+    {
+        const auto* source = ch == 0 ? left : right;
+        juce::FloatVectorOperations::copy (ringChannels[(size_t) ch] + offset, source, firstPart);
+        juce::FloatVectorOperations::copy (ringChannels[(size_t) ch], source + firstPart, numSamples - firstPart);
+    }
+
+    pushChunk (start, firstPart, mono, settings);
+
+    if (firstPart < numSamples)
+        pushChunk (start + firstPart, numSamples - firstPart, mono, settings);
+
+    submitted += numSamples;
+    chunksQueued.post();
+
+    // Normally finished long ago: the effects thread had the gap between host callbacks for it. If not, the block
+    // plays as silence rather than holding up the audio thread.
+    if (processed.load (std::memory_order_acquire) < submitted - latency)
+    {
+        dropBlock (left, right, numSamples);
+        return;
+    }
+
+    copyFromRing (submitted - latency - numSamples, left, right, numSamples);
+}
+
+void EffectsPipeline::pushChunk (juce::int64 start, int numSamples, bool mono, const EffectsSettings& settings) noexcept
+{
+    const auto scope = chunkFifo.write (1);
+    chunks[(size_t) scope.startIndex1] = { start, numSamples, mono, settings };
+}
+
+void EffectsPipeline::dropBlock (float* left, float* right, int numSamples) noexcept
+{
+    juce::FloatVectorOperations::clear (left, numSamples);
+
+    if (right != nullptr)
+        juce::FloatVectorOperations::clear (right, numSamples);
+
+    ++lateBlocks;
+}
+
+void EffectsPipeline::waitUntilProcessed (juce::int64 position) const noexcept
+{
+    while (processed.load (std::memory_order_acquire) < position)
+        std::this_thread::yield();
+}
+
+void EffectsPipeline::copyFromRing (juce::int64 start, float* left, float* right, int numSamples) const noexcept
+{
+    const auto offset = static_cast<int> (start & ringMask);
+    const auto firstPart = juce::jmin (numSamples, ringMask + 1 - offset);
+
+    for (int ch = 0; ch < (right != nullptr ? 2 : 1); ++ch)
+    {
+        auto* dest = ch == 0 ? left : right;
+        juce::FloatVectorOperations::copy (dest, ringChannels[(size_t) ch] + offset, firstPart);
+        juce::FloatVectorOperations::copy (dest + firstPart, ringChannels[(size_t) ch], numSamples - firstPart);
+    }
+}
+
+void EffectsPipeline::processPendingChunks() noexcept
+{
+    const auto numReady = chunkFifo.getNumReady();
+
+    for (int i = 0; i < numReady; ++i)
+    {
+        const auto scope = chunkFifo.read (1);
+        const auto& chunk = chunks[(size_t) scope.startIndex1];
+        const auto offset = static_cast<int> (chunk.start & ringMask);
+
+        stageFunction (stageContext, ringChannels[0] + offset, chunk.mono ? nullptr : ringChannels[1] + offset,
+                       chunk.numSamples, chunk.settings);
+        processed.store (chunk.start + chunk.numSamples, std::memory_order_release);
+    }
+}
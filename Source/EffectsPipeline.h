@@ -0,0 +1,88 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "RealtimeSemaphore.h"
+
+// Everything the post-synth chain needs besides the audio. It travels with each chunk, so the effects see a parameter
+// change at the same point in the stream as the voices did, whichever thread runs them.
+struct EffectsSettings
+{
+    float reverbMix = 0.0f;
+    bool convolution = false;
+    float gain = 1.0f;
+    bool silent = false; // the output has been silent for a while: tails may be cleared and ramps may jump
+};
+
+// Runs the post-synth effects on a dedicated real-time thread, one host block behind the voices. The audio thread
+// copies the synth output into a ring, queues it as a chunk and takes back the processed audio from maxBlockSize
+// samples earlier, which the effects thread finished while the host was between callbacks. Handoff is a lock-free
+// chunk FIFO one way and a processed-sample counter the other, so neither side ever locks. The effects thread sleeps
+// on a semaphore until a chunk arrives, and the audio thread never waits for it: a block whose effects aren't done in
+// time plays as silence and is counted, so hundreds of instances cost no spinning cores.
+class EffectsPipeline
+{
+public:
+    using StageFunction = void (*) (void* context, float* left, float* right, int numSamples, const EffectsSettings&);
+
+    EffectsPipeline();
+    ~EffectsPipeline();
+
+    // Message thread: sizes the ring and starts the effects thread. Adds maxBlockSize samples of latency.
+    void prepare (int maxBlockSize, StageFunction stage, void* context);
+    void release();
+
+    bool isActive() const noexcept { return thread != nullptr; }
+    int getLatencySamples() const noexcept { return isActive() ? latency : 0; }
+
+    // Audio thread: blocks replaced by silence because the effects thread had fallen behind, since construction.
+    juce::int64 getNumLateBlocks() const noexcept { return lateBlocks; }
+
+    // Audio thread: hands the synth output to the effects thread and replaces it with the processed audio from one
+    // block earlier. right is null for mono. Blocks larger than maxBlockSize are split.
+    void process (float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept;
+
+    // Waits for the effects thread to finish what it was given and clears the delay. Not concurrent with process().
+    void reset() noexcept;
+
+private:
+    class EffectsThread;
+
+    struct Chunk
+    {
+        juce::int64 start = 0;
+        int numSamples = 0;
+        bool mono = false;
+        EffectsSettings settings;
+    };
+
+    static constexpr int maxPendingChunks = 256;
+
+    void submit (float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept;
+    void pushChunk (juce::int64 start, int numSamples, bool mono, const EffectsSettings& settings) noexcept;
+    void dropBlock (float* left, float* right, int numSamples) noexcept;
+    void waitUntilProcessed (juce::int64 position) const noexcept;
+    void copyFromRing (juce::int64 start, float* left, float* right, int numSamples) const noexcept;
+
+    // Effects thread: runs every queued chunk.
+    void processPendingChunks() noexcept;
+
+    RealtimeSemaphore chunksQueued;
+    std::unique_ptr<EffectsThread> thread;
+    StageFunction stageFunction = nullptr;
+    void* stageContext = nullptr;
+
+    juce::AudioBuffer<float> ring;
+    std::array<float*, 2> ringChannels {};
+    int ringMask = 0;
+    int latency = 0;
+
+    juce::AbstractFifo chunkFifo { maxPendingChunks };
+    std::array<Chunk, maxPendingChunks> chunks;
+
+    // Audio thread only: samples handed over so far, counting the latency's worth of silence the ring starts with.
+    juce::int64 submitted = 0;
+    juce::int64 lateBlocks = 0;
+    std::atomic<juce::int64> processed { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (EffectsPipeline)
+};
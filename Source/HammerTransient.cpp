@@ -0,0 +1,76 @@
+#include "HammerTransient.h"
+
+HammerTransientTables::HammerTransientTables (double sampleRate)
+    : length (juce::jmax (2, static_cast<int> (sampleRate * lengthSeconds)))
+{
+    static constexpr int numTables = numVelocityLayers * numKeyRanges * numVariants;
+
+    samples.assign (static_cast<size_t> ((numTables + 1) * length), 0.0f);
+
+    for (int layer = 0; layer < numVelocityLayers; ++layer)
+        for (int keyRange = 0; keyRange < numKeyRanges; ++keyRange)
+            for (int variant = 0; variant < numVariants; ++variant)
+                buildTable (samples.data() + ((layer * numKeyRanges + keyRange) * numVariants + variant + 1) * length,
+                            layer, keyRange, variant, sampleRate);
+}
+
+const float* HammerTransientTables::getTable (double frequency, float velocity, juce::uint32 strike) const noexcept
+{
+    const auto keyPosition = 12.0 * std::log2 (juce::jmax (1.0, frequency) / 27.5) / 88.0;
+    const auto keyRange = juce::jlimit (0, numKeyRanges - 1, static_cast<int> (keyPosition * numKeyRanges));
+    const auto layer = juce::jlimit (0, numVelocityLayers - 1, static_cast<int> (velocity * numVelocityLayers));
+    const auto variant = static_cast<int> (strike % static_cast<juce::uint32> (numVariants));
+
+    return samples.data() + ((layer * numKeyRanges + keyRange) * numVariants + variant + 1) * length;
+}
+
+void HammerTransientTables::buildTable (float* table, int layer, int keyRange, int variant, double sampleRate) const
+{
+    const auto velocity = (layer + 0.5) / numVelocityLayers;
+    const auto note = 21.0 + (keyRange + 0.5) * 88.0 / numKeyRanges;
+    const auto seed = static_cast<juce::uint32> ((layer * numKeyRanges + keyRange) * numVariants + variant);
+
+    std::vector<float> felt (static_cast<size_t> (length)), knock (felt.size());
+    CounterNoise::fill (felt.data(), length, 2 * seed);
+    CounterNoise::fill (knock.data(), length, 2 * seed + 1);
+
+    // The felt's band rises up the keyboard and with velocity, and harder strikes spread wider; the knock is the
+    // low thud of the hammer and key, more prominent in soft playing.
+    const auto centre = juce::jlimit (150.0, 0.35 * sampleRate, 700.0 * std::pow (2.0, (note - 60.0) / 36.0) * (0.6 + 1.4 * velocity));
+    const auto w0 = juce::MathConstants<double>::twoPi * centre / sampleRate;
+    const auto alpha = std::sin (w0) / (2.0 * (1.2 - 0.6 * velocity));
+    const auto b0 = alpha / (1.0 + alpha);
+    const auto a1 = -2.0 * std::cos (w0) / (1.0 + alpha);
+    const auto a2 = (1.0 - alpha) / (1.0 + alpha);
+    const auto knockCoeff = 1.0 - std::exp (-juce::MathConstants<double>::twoPi * 120.0 / sampleRate);
+    const auto knockGain = 0.6 - 0.3 * velocity;
+
+    double x1 = 0.0, x2 = 0.0, y1 = 0.0, y2 = 0.0, lowpass = 0.0, power = 0.0;
+
+    for (int i = 0; i < length; ++i)
+    {
+        const auto x = static_cast<double> (felt[(size_t) i]);
+        const auto y = b0 * (x - x2) - a1 * y1 - a2 * y2;
+        x2 = x1;
+        x1 = x;
+        y2 = y1;
+        y1 = y;
+
+        lowpass += knockCoeff * (knock[(size_t) i] - lowpass);
+        table[i] = static_cast<float> (y + knockGain * lowpass / juce::jmax (1.0e-3, std::sqrt (knockCoeff)));
+        power += table[i] * table[i];
+    }
+
+    // Same RMS as the uniform white noise this replaces, then the strike's decay and a short fade so it ends at zero.
+    const auto normalise = (1.0 / std::sqrt (3.0)) / juce::jmax (1.0e-9, std::sqrt (power / length));
+    const auto gain = level * (0.75 + 0.25 * velocity) * normalise;
+    const auto fadeLength = juce::jmax (1, static_cast<int> (sampleRate * 0.002));
+
+    for (int i = 0; i < length; ++i)
+    {
+        const auto t = i / sampleRate;
+        const auto remaining = length - 1 - i;
+        const auto fade = remaining < fadeLength ? 0.5 - 0.5 * std::cos (juce::MathConstants<double>::pi * remaining / fadeLength) : 1.0;
+        table[i] = static_cast<float> (table[i] * gain * std::exp (-t / decaySeconds) * fade);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Counter-based white noise: sample n of a stream is a pure function of (seed, n), so a stream can be generated in
+// any order or on any thread and always gives the same values. Nothing is chained from one sample to the next,
+// so fill() vectorises.
+struct CounterNoise
+{
+    // lowbias32 integer hash (C. Wellons): every input bit affects every output bit.
+    static constexpr juce::uint32 hash (juce::uint32 x) noexcept
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return x;
+    }
+
+    static constexpr juce::uint32 hash (juce::uint32 seed, juce::uint32 counter) noexcept { return hash (counter + hash (seed)); }
+
+    // Uniform in [-1, 1).
+    static float bipolar (juce::uint32 seed, juce::uint32 counter) noexcept { return toBipolar (hash (seed, counter)); }
+
+    static void fill (float* dest, int numSamples, juce::uint32 seed, juce::uint32 firstCounter = 0) noexcept
+    {
+        const auto offset = firstCounter + hash (seed);
+
+        for (int i = 0; i < numSamples; ++i)
+            dest[i] = toBipolar (hash (offset + static_cast<juce::uint32> (i)));
+    }
+
+private:
+    static float toBipolar (juce::uint32 bits) noexcept
+    {
+        return static_cast<float> (static_cast<juce::int32> (bits)) * (1.0f / 2147483648.0f);
+    }
+};
+
+// Hammer strike transients: band-shaped noise bursts precomputed per velocity layer, key range and variant, so a
+// note's attack is a table read instead of a random number per sample. Immutable once built and shared by every
+// instance at the same sample rate via the SharedResourceCache.
+class HammerTransientTables
+{
+public:
+    static constexpr int numVelocityLayers = 4;
+    static constexpr int numKeyRanges = 8;
+    static constexpr int numVariants = 2;
+    static constexpr double lengthSeconds = 0.02;
+
+    explicit HammerTransientTables (double sampleRate);
+
+    // Every table, silence included, ends in a zero, so a read position can park on the last sample.
+    int getLength() const noexcept { return length; }
+
+    // Successive strikes alternate between variants, so repeated notes don't sound machine-gunned.
+    const float* getTable (double frequency, float velocity, juce::uint32 strike) const noexcept;
+    const float* getSilence() const noexcept { return samples.data(); }
+
+    size_t getMemoryBytes() const noexcept { return sizeof (*this) + samples.capacity() * sizeof (float); }
+
+private:
+    static constexpr float level = 0.08f;
+    static constexpr double decaySeconds = 0.015;
+
+    void buildTable (float* table, int layer, int keyRange, int variant, double sampleRate) const;
+
+    int length = 0;
+    std::vector<float> samples; // silence, then every table, each length samples long
+
+    JUCE_DECLARE_NON_COPYABLE (HammerTransientTables)
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// A per-lane sound generator that VoiceBank renders outside its SIMD oscillator kernel (streamed samples,
+// modal resonators). The bank owns the lane's envelope and passes it in as a gain ramp.
+class LaneSource
+{
+public:
+    virtual ~LaneSource() = default;
+
+    // Audio thread. Returns false if the lane cannot play, in which case it finishes straight away.
+    virtual bool startLane (int lane, int midiNoteNumber, float velocity) noexcept = 0;
+    virtual void stopLane (int lane) noexcept = 0;
+
+    // Adds the lane's output scaled by gain * gainCoeff^i. Returns false once the lane has nothing left to play.
+    // Different lanes may be rendered from different threads at once.
+    virtual bool renderLane (int lane, float* left, float* right, int numSamples, float gain, float gainCoeff) noexcept = 0;
+};
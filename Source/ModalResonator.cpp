@@ -0,0 +1,219 @@
+#include "ModalResonator.h"
+
+void ModalResonatorBank::prepare (double newSampleRate, int numLanes)
+{
+    sampleRate = newSampleRate;
+
+    tables = sharedResources->get<Tables> ("modal@" + juce::String (sampleRate), [this]
+    {
+        auto newTables = std::make_unique<Tables>();
+
+        for (int note = 0; note < 128; ++note)
+            buildKey (newTables->keys[(size_t) note], note, sampleRate);
+
+        return newTables;
+    });
+
+    lanes.resize ((size_t) numLanes);
+
+    for (auto& lane : lanes)
+    {
+        lane.key = nullptr;
+        lane.numBlocks = 0;
+        lane.y1.assign ((size_t) maxBlocks, Vec::expand (0.0f));
+        lane.y2.assign ((size_t) maxBlocks, Vec::expand (0.0f));
+    }
+}
+
+size_t ModalResonatorBank::Tables::getMemoryBytes() const noexcept
+{
+    auto bytes = sizeof (*this);
+
+    for (const auto& key : keys)
+        bytes += (key.a1.capacity() + key.a2.capacity() + key.input.capacity()) * sizeof (Vec);
+
+    return bytes;
+}
+
+size_t ModalResonatorBank::getPrivateMemoryBytes() const noexcept
+{
+    return lanes.size() * (sizeof (LaneState) + 2 * maxBlocks * sizeof (Vec));
+}
+
+void ModalResonatorBank::buildKey (KeyModes& key, int midiNoteNumber, double sampleRate)
+{
+    const auto f0 = juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber);
+    const auto keyPosition = static_cast<double> (midiNoteNumber - 21);
+
+    // Inharmonicity grows roughly exponentially up the keyboard; the bass rings for far longer than the treble.
+    const auto stiffness = 1.0e-4 * std::exp (0.0576 * keyPosition);
+    const auto t60 = juce::jlimit (0.4, 20.0, 18.0 * std::pow (2.0, -keyPosition / 18.0));
+    const auto baseDamping = 6.91 / t60;
+
+    std::vector<float> a1, a2, input;
+
+    for (int k = 1; k <= maxModes; ++k)
+    {
+        const auto frequency = k * f0 * std::sqrt (1.0 + stiffness * k * k);
+
+        if (frequency >= 0.45 * sampleRate)
+            break;
+
+        const auto damping = baseDamping + 2.5e-7 * frequency * frequency;
+        const auto w = juce::MathConstants<double>::twoPi * frequency / sampleRate;
+        const auto r = std::exp (-damping / sampleRate);
+
+        a1.push_back (static_cast<float> (2.0 * r * std::cos (w)));
+        a2.push_back (static_cast<float> (r * r));
+        // Striking at a fraction of the string length weights mode k by sin (k pi x); sin (w) normalises its peak.
+        input.push_back (static_cast<float> (std::sin (k * juce::MathConstants<double>::pi * strikePosition) * std::sin (w)));
+    }
+
+    key.numModes = static_cast<int> (a1.size());
+    key.outputGain = key.numModes > 0 ? 0.6f / std::sqrt (static_cast<float> (key.numModes)) : 0.0f;
+
+    // Padding modes have zero coefficients, so they stay silent.
+    const auto numBlocks = (key.numModes + modesPerBlock - 1) / modesPerBlock;
+    a1.resize ((size_t) (numBlocks * modesPerBlock), 0.0f);
+    a2.resize (a1.size(), 0.0f);
+    input.resize (a1.size(), 0.0f);
+
+    key.a1.resize ((size_t) numBlocks);
+    key.a2.resize ((size_t) numBlocks);
+    key.input.resize ((size_t) numBlocks);
+
+    // Lane by lane: vector storage is only as aligned as the allocator happens to make it, which an aligned load of a
+    // wider register (AVX) can't rely on.
+    auto loadBlock = [] (const std::vector<float>& values, size_t offset)
+    {
+        auto block = Vec::expand (0.0f);
+
+        for (size_t i = 0; i < (size_t) modesPerBlock; ++i)
+            block.set (i, values[offset + i]);
+
+        return block;
+    };
+
+    for (int b = 0; b < numBlocks; ++b)
+    {
+        const auto offset = (size_t) (b * modesPerBlock);
+        key.a1[(size_t) b] = loadBlock (a1, offset);
+        key.a2[(size_t) b] = loadBlock (a2, offset);
+        key.input[(size_t) b] = loadBlock (input, offset);
+    }
+}
+
+bool ModalResonatorBank::startLane (int laneIndex, int midiNoteNumber, float velocity) noexcept
+{
+    if (tables == nullptr || ! juce::isPositiveAndBelow (laneIndex, static_cast<int> (lanes.size())))
+        return false;
+
+    auto& key = tables->keys[(size_t) juce::jlimit (0, 127, midiNoteNumber)];
+
+    if (key.numModes == 0)
+        return false;
+
+    auto& lane = lanes[(size_t) laneIndex];
+    lane.key = &key;
+    lane.numBlocks = juce::jmin (static_cast<int> (key.a1.size()), (modeLimit + modesPerBlock - 1) / modesPerBlock);
+
+    for (int b = 0; b < lane.numBlocks; ++b)
+    {
+        lane.y1[(size_t) b] = Vec::expand (0.0f);
+        lane.y2[(size_t) b] = Vec::expand (0.0f);
+    }
+
+    // Harder strikes give a shorter contact time and so excite more of the upper modes.
+    const auto hardness = 0.5f * hammerHardness + 0.5f * juce::jlimit (0.0f, 1.0f, velocity);
+    lane.pulseLength = juce::jmax (2, static_cast<int> (sampleRate * (0.0045 - 0.0035 * hardness)));
+    lane.pulsePosition = 0;
+    // Unit-area pulse, so the strike energy does not depend on its length.
+    lane.pulseScale = juce::MathConstants<float>::pi / (2.0f * static_cast<float> (lane.pulseLength));
+    return true;
+}
+
+void ModalResonatorBank::stopLane (int laneIndex) noexcept
+{
+    if (juce::isPositiveAndBelow (laneIndex, static_cast<int> (lanes.size())))
+        lanes[(size_t) laneIndex].key = nullptr;
+}
+
+bool ModalResonatorBank::renderLane (int laneIndex, float* left, float* right, int numSamples,
+                                     float gain, float gainCoeff) noexcept
+{
+    if (! juce::isPositiveAndBelow (laneIndex, static_cast<int> (lanes.size())))
+        return false;
+
+    auto& lane = lanes[(size_t) laneIndex];
+
+    if (lane.key == nullptr)
+        return false;
+
+    const auto& key = *lane.key;
+    const auto numBlocks = lane.numBlocks;
+    auto* y1 = lane.y1.data();
+    auto* y2 = lane.y2.data();
+    const auto* a1 = key.a1.data();
+    const auto* a2 = key.a2.data();
+    const auto* input = key.input.data();
+    const auto pulseStep = juce::MathConstants<float>::pi / static_cast<float> (lane.pulseLength);
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        auto sum = Vec::expand (0.0f);
+
+        if (lane.pulsePosition < lane.pulseLength)
+        {
+            const auto force = Vec::expand (lane.pulseScale * std::sin (pulseStep * static_cast<float> (lane.pulsePosition++)));
+
+            for (int b = 0; b < numBlocks; ++b)
+            {
+                const auto y = Vec::multiplyAdd (a1[b] * y1[b] - a2[b] * y2[b], input[b], force);
+                y2[b] = y1[b];
+                y1[b] = y;
+                sum += y;
+            }
+        }
+        else
+        {
+            for (int b = 0; b < numBlocks; ++b)
+            {
+                const auto y = a1[b] * y1[b] - a2[b] * y2[b];
+                y2[b] = y1[b];
+                y1[b] = y;
+                sum += y;
+            }
+        }
+
+        const auto out = gain * key.outputGain * sum.sum();
+        left[i] += out;
+
+        if (right != nullptr)
+            right[i] += out;
+        gain *= gainCoeff;
+    }
+
+    if (lane.pulsePosition < lane.pulseLength)
+        return true;
+
+    // The dropped block is already below the floor, so cutting it leaves no audible step.
+    const auto blockFloor = juce::square (detailFloor / juce::jmax (gain * key.outputGain, 1.0e-12f));
+
+    while (detailFloor > 0.0f && lane.numBlocks > 1)
+    {
+        const auto top = lane.numBlocks - 1;
+
+        if ((y1[top] * y1[top] + y2[top] * y2[top]).sum() >= blockFloor)
+            break;
+
+        --lane.numBlocks;
+    }
+
+    auto energy = Vec::expand (0.0f);
+
+    for (int b = 0; b < lane.numBlocks; ++b)
+        energy += y1[b] * y1[b] + y2[b] * y2[b];
+
+    const auto level = energy.sum() * key.outputGain * key.outputGain;
+    return level >= silenceThreshold * silenceThreshold;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "LaneSource.h"
+#include "SharedResourceCache.h"
+
+// Physically modelled piano tone: each note is a bank of damped two-pole resonators tuned to the stiff-string
+// series f_k = k f0 sqrt (1 + B k^2) and struck by a half-sine hammer force pulse. A note's modes are stored in
+// SIMD-width blocks, so one voice advances several modes per instruction.
+class ModalResonatorBank final : public LaneSource
+{
+public:
+    using Vec = juce::dsp::SIMDRegister<float>;
+
+    static constexpr int minModes = 32;
+    static constexpr int maxModes = 128;
+
+    ModalResonatorBank() = default;
+
+    // Message thread: fetches the mode tables for this sample rate (shared by all instances) and sizes the per-lane state.
+    void prepare (double newSampleRate, int numLanes);
+
+    // Audio thread: both apply to notes started from now on. The mode count is rounded up to whole SIMD blocks.
+    void setModeLimit (int numModes) noexcept { modeLimit = juce::jlimit (minModes, maxModes, numModes); }
+    void setHammerHardness (float hardness) noexcept { hammerHardness = juce::jlimit (0.0f, 1.0f, hardness); }
+
+    // Level of detail: a lane's highest block of modes is dropped once its output falls below this level (0 keeps
+    // them all). Upper modes are damped hardest, so a decaying note sheds them first.
+    void setDetailFloor (float newFloor) noexcept { detailFloor = juce::jmax (0.0f, newFloor); }
+
+    bool startLane (int lane, int midiNoteNumber, float velocity) noexcept override;
+    void stopLane (int lane) noexcept override;
+    bool renderLane (int lane, float* left, float* right, int numSamples, float gain, float gainCoeff) noexcept override;
+
+    // Resonator state owned by this instance alone.
+    size_t getPrivateMemoryBytes() const noexcept;
+
+private:
+    static constexpr int modesPerBlock = static_cast<int> (Vec::SIMDNumElements);
+    static constexpr int maxBlocks = (maxModes + modesPerBlock - 1) / modesPerBlock;
+    static constexpr float silenceThreshold = 1.0e-5f;
+    static constexpr double strikePosition = 0.12;
+
+    // y[n] = a1 y[n-1] - a2 y[n-2] + input x[n], one entry per block of modes.
+    struct KeyModes
+    {
+        std::vector<Vec> a1, a2, input;
+        int numModes = 0;
+        float outputGain = 0.0f;
+    };
+
+    struct LaneState
+    {
+        const KeyModes* key = nullptr;
+        int numBlocks = 0;
+        std::vector<Vec> y1, y2;
+        int pulsePosition = 0;
+        int pulseLength = 0;
+        float pulseScale = 0.0f;
+    };
+
+    struct Tables
+    {
+        std::array<KeyModes, 128> keys;
+
+        size_t getMemoryBytes() const noexcept;
+    };
+
+    static void buildKey (KeyModes&, int midiNoteNumber, double sampleRate);
+
+    juce::SharedResourcePointer<SharedResourceCache> sharedResources;
+    std::shared_ptr<const Tables> tables;
+    std::vector<LaneState> lanes;
+    double sampleRate = 44100.0;
+    int modeLimit = 64;
+    float hammerHardness = 0.5f;
+    float detailFloor = 0.0f;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ModalResonatorBank)
+};
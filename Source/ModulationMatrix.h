@@ -0,0 +1,80 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Routing for the per-voice modulation. Every source has a value per note: its velocity and key, the pressure and
+// timbre of its MPE channel (or poly aftertouch and CC74), a sine LFO and an envelope that both restart with the
+// note. The routes' summed amounts are offsets the voice bank applies at control rate (see VoiceBank::setModulation).
+struct ModulationMatrix
+{
+    enum Source
+    {
+        velocity, // 0 to 1
+        key,      // -1 to 1 over about eight octaves around middle C
+        pressure, // 0 to 1
+        timbre,   // -1 to 1, centred on CC74 = 64
+        lfo,      // -1 to 1
+        envelope, // 1 at the strike, decaying towards 0
+        numSources
+    };
+
+    enum Destination
+    {
+        pitch,      // 1 is an octave up
+        brightness, // 1 tilts the partials up by 6 dB per harmonic, -1 down by as much
+        decay,      // 1 makes the decay and release four times longer, -1 four times shorter
+        numDestinations
+    };
+
+    struct Route
+    {
+        Source source = velocity;
+        Destination destination = pitch;
+        float amount = 0.0f;
+    };
+
+    static constexpr int maxRoutes = numSources * numDestinations;
+
+    // Routes between the same pair add up, so the evaluation cost depends on the distinct pairs in use, not on how
+    // many slots feed them. Zero amounts are left out altogether.
+    void addRoute (Source source, Destination destination, float amount) noexcept
+    {
+        if (amount == 0.0f)
+            return;
+
+        for (int i = 0; i < numRoutes; ++i)
+        {
+            auto& route = routes[(size_t) i];
+
+            if (route.source == source && route.destination == destination)
+            {
+                route.amount += amount;
+                return;
+            }
+        }
+
+        if (numRoutes < maxRoutes)
+            routes[(size_t) numRoutes++] = { source, destination, amount };
+    }
+
+    // Whether a route reads one of the sources every note has (as opposed to expression, which only some notes get).
+    bool usesNoteSources() const noexcept
+    {
+        for (int i = 0; i < numRoutes; ++i)
+        {
+            const auto source = routes[(size_t) i].source;
+
+            if (source != pressure && source != timbre)
+                return true;
+        }
+
+        return false;
+    }
+
+    std::array<Route, maxRoutes> routes {};
+    int numRoutes = 0;
+
+    float lfoHz = 5.0f;
+    float envelopeSeconds = 0.5f;
+    int controlInterval = 32; // samples between evaluations, at the voices' sample rate
+};
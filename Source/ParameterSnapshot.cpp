@@ -0,0 +1,58 @@
+#include "ParameterSnapshot.h"
+
+ParameterSnapshot::ParameterSnapshot (juce::AudioProcessorValueTreeState& state, const juce::StringArray& parameterIDs)
+{
+    entries.resize ((size_t) parameterIDs.size());
+
+    for (int i = 0; i < parameterIDs.size(); ++i)
+    {
+        auto& entry = entries[(size_t) i];
+        entry.source = state.getRawParameterValue (parameterIDs[i]);
+        jassert (entry.source != nullptr);
+        entry.value = entry.source->load (std::memory_order_relaxed);
+    }
+}
+
+bool ParameterSnapshot::update() noexcept
+{
+    const auto next = generation + 1;
+    auto anyChanged = false;
+
+    for (auto& entry : entries)
+    {
+        const auto sourceValue = entry.source->load (std::memory_order_relaxed);
+
+        if (entry.overlaid && sourceValue != entry.overlayBase)
+            entry.overlaid = false;
+
+        const auto value = entry.overlaid ? entry.overlayValue : sourceValue;
+
+        if (value != entry.value || forceChange)
+        {
+            entry.value = value;
+            entry.changedAt = next;
+            anyChanged = true;
+        }
+    }
+
+    forceChange = false;
+
+    if (anyChanged)
+        generation = next;
+
+    return anyChanged;
+}
+
+void ParameterSnapshot::overlay (int index, float value) noexcept
+{
+    auto& entry = entries[(size_t) index];
+    entry.overlaid = true;
+    entry.overlayValue = value;
+    entry.overlayBase = entry.source->load (std::memory_order_relaxed);
+}
+
+void ParameterSnapshot::clearOverlays() noexcept
+{
+    for (auto& entry : entries)
+        entry.overlaid = false;
+}
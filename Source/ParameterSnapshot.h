@@ -0,0 +1,66 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Audio-thread copy of a fixed list of apvts parameters. update() reads each raw value once per block and stamps
+// the ones that moved with a new generation, so consumers recompute derived coefficients only when an input changed.
+class ParameterSnapshot
+{
+public:
+    // Parameters are indexed in the order given here.
+    ParameterSnapshot (juce::AudioProcessorValueTreeState& state, const juce::StringArray& parameterIDs);
+
+    // Audio thread: returns true if any value changed since the last call.
+    bool update() noexcept;
+
+    float get (int index) const noexcept { return entries[(size_t) index].value; }
+    int getInt (int index) const noexcept { return juce::roundToInt (get (index)); }
+
+    // Generation of the latest update(); a consumer stores it after syncing and passes it back to changedSince().
+    juce::uint32 getGeneration() const noexcept { return generation; }
+
+    template <typename... Indices>
+    bool changedSince (juce::uint32 seenGeneration, Indices... indices) const noexcept
+    {
+        return ((entries[(size_t) indices].changedAt > seenGeneration) || ...);
+    }
+
+    // Same, for the inclusive run of indices from first to last.
+    bool changedInRange (juce::uint32 seenGeneration, int first, int last) const noexcept
+    {
+        for (auto index = first; index <= last; ++index)
+            if (entries[(size_t) index].changedAt > seenGeneration)
+                return true;
+
+        return false;
+    }
+
+    // Makes every parameter count as changed on the next update(), e.g. after the sample rate moved.
+    void invalidate() noexcept { forceChange = true; }
+
+    // Audio thread: makes the next update() read a parameter as value without touching the parameter itself, for a
+    // change the message thread is about to make to it. The overlay holds until the parameter's own value moves,
+    // which is the message thread catching up (or the host overriding it in the meantime).
+    void overlay (int index, float value) noexcept;
+
+    // Audio thread: drops every overlay, e.g. once the parameters have been replaced underneath them.
+    void clearOverlays() noexcept;
+
+private:
+    struct Entry
+    {
+        std::atomic<float>* source = nullptr;
+        float value = 0.0f;
+        juce::uint32 changedAt = 0;
+
+        bool overlaid = false;
+        float overlayValue = 0.0f;
+        float overlayBase = 0.0f; // the parameter's value when the overlay was set
+    };
+
+    std::vector<Entry> entries;
+    juce::uint32 generation = 0;
+    bool forceChange = true;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (ParameterSnapshot)
+};
@@ -0,0 +1,144 @@
+#include "PerformanceTelemetry.h"
+
+PerformanceTelemetry::PerformanceTelemetry()
+    : frames (static_cast<size_t> (ringSize))
+{
+    startTimerHz (30);
+}
+
+PerformanceTelemetry::~PerformanceTelemetry()
+{
+    stopTimer();
+    stopTrace();
+}
+
+void PerformanceTelemetry::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate;
+    samplePosition = 0;
+    fifo.reset();
+    droppedFrames = 0;
+    summary = {};
+}
+
+void PerformanceTelemetry::record (juce::int64 blockStartTicks, int numSamples, int activeVoices, int totalSteals,
+                                   juce::int64 totalUnderruns, float peak) noexcept
+{
+    const auto seconds = juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - blockStartTicks);
+    const auto deadline = numSamples / sampleRate;
+
+    Frame frame;
+    frame.samplePosition = samplePosition;
+    frame.blockMicros = static_cast<float> (seconds * 1.0e6);
+    frame.load = deadline > 0.0 ? static_cast<float> (seconds / deadline) : 0.0f;
+    frame.peak = peak;
+    frame.numSamples = numSamples;
+    frame.activeVoices = activeVoices;
+    frame.steals = totalSteals - lastTotalSteals;
+    frame.underruns = static_cast<int> (totalUnderruns - lastTotalUnderruns);
+
+    samplePosition += numSamples;
+    lastTotalSteals = totalSteals;
+    lastTotalUnderruns = totalUnderruns;
+
+    const auto scope = fifo.write (1);
+
+    if (scope.blockSize1 > 0)
+        frames[static_cast<size_t> (scope.startIndex1)] = frame;
+    else
+        droppedFrames.fetch_add (1, std::memory_order_relaxed);
+}
+
+void PerformanceTelemetry::collect()
+{
+    const auto numReady = fifo.getNumReady();
+
+    if (numReady == 0)
+        return;
+
+    float worstLoad = 0.0f;
+    float loadSum = 0.0f;
+    float peak = 0.0f;
+    const auto scope = fifo.read (numReady);
+
+    scope.forEach ([&] (int index)
+    {
+        const auto& frame = frames[static_cast<size_t> (index)];
+
+        worstLoad = juce::jmax (worstLoad, frame.load);
+        loadSum += frame.load;
+        peak = juce::jmax (peak, frame.peak);
+        summary.activeVoices = frame.activeVoices;
+        summary.totalSteals += frame.steals;
+        summary.totalUnderruns += frame.underruns;
+
+        if (trace != nullptr)
+            writeToTrace (frame);
+    });
+
+    summary.load = worstLoad;
+    summary.averageLoad = loadSum / static_cast<float> (numReady);
+    summary.maxLoad = juce::jmax (summary.maxLoad, worstLoad);
+    summary.peak = peak;
+    summary.droppedFrames = droppedFrames.load (std::memory_order_relaxed);
+}
+
+bool PerformanceTelemetry::startTrace (const juce::File& file)
+{
+    stopTrace();
+    file.deleteFile();
+
+    auto stream = std::make_unique<juce::FileOutputStream> (file);
+
+    if (! stream->openedOk())
+        return false;
+
+    binaryTrace = ! file.hasFileExtension ("csv");
+
+    if (binaryTrace)
+    {
+        stream->write ("CPTR", 4);
+        stream->writeInt (binaryTraceVersion);
+        stream->writeDouble (sampleRate);
+    }
+    else
+    {
+        *stream << "sample,block_us,load,peak,samples,voices,steals,underruns\n";
+    }
+
+    trace = std::move (stream);
+    return true;
+}
+
+void PerformanceTelemetry::stopTrace()
+{
+    if (trace != nullptr)
+        trace->flush();
+
+    trace.reset();
+}
+
+void PerformanceTelemetry::writeToTrace (const Frame& frame)
+{
+    if (binaryTrace)
+    {
+        trace->writeInt64 (frame.samplePosition);
+        trace->writeFloat (frame.blockMicros);
+        trace->writeFloat (frame.load);
+        trace->writeFloat (frame.peak);
+        trace->writeInt (frame.numSamples);
+        trace->writeInt (frame.activeVoices);
+        trace->writeInt (frame.steals);
+        trace->writeInt (frame.underruns);
+        return;
+    }
+
+    *trace << juce::String (frame.samplePosition) << ","
+           << juce::String (frame.blockMicros, 1) << ","
+           << juce::String (frame.load, 4) << ","
+           << juce::String (frame.peak, 5) << ","
+           << frame.numSamples << ","
+           << frame.activeVoices << ","
+           << frame.steals << ","
+           << frame.underruns << "\n";
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Per-block performance measurements. The audio thread pushes one frame per processBlock into a
+// lock-free single-producer ring; the message thread drains it into a summary and an optional trace file.
+class PerformanceTelemetry final : private juce::Timer
+{
+public:
+    struct Frame
+    {
+        juce::int64 samplePosition = 0;
+        float blockMicros = 0.0f;
+        float load = 0.0f; // wall time relative to the block's real-time deadline
+        float peak = 0.0f;
+        int numSamples = 0;
+        int activeVoices = 0;
+        int steals = 0;
+        int underruns = 0; // sample streams that ran dry, and pipelined effects blocks that weren't ready
+    };
+
+    // Everything here is computed from the frames drained by the last collect() call, unless noted.
+    struct Summary
+    {
+        float load = 0.0f;
+        float averageLoad = 0.0f;
+        float maxLoad = 0.0f; // since prepare() or resetMaxLoad()
+        float peak = 0.0f;
+        int activeVoices = 0;
+        juce::int64 totalSteals = 0;
+        juce::int64 totalUnderruns = 0;
+        juce::int64 droppedFrames = 0;
+    };
+
+    PerformanceTelemetry();
+    ~PerformanceTelemetry() override;
+
+    // Must not overlap with record().
+    void prepare (double newSampleRate);
+
+    // Audio thread: wait-free; frames are dropped (and counted) if the message thread falls behind.
+    void record (juce::int64 blockStartTicks, int numSamples, int activeVoices, int totalSteals,
+                 juce::int64 totalUnderruns, float peak) noexcept;
+
+    // Message thread: drains pending frames. Runs on a timer, but headless hosts can call it directly.
+    void collect();
+
+    const Summary& getSummary() const noexcept { return summary; }
+    void resetMaxLoad() noexcept { summary.maxLoad = 0.0f; }
+
+    // A ".csv" file gets one text row per block; anything else gets packed little-endian binary frames.
+    bool startTrace (const juce::File& file);
+    void stopTrace();
+    bool isTracing() const noexcept { return trace != nullptr; }
+
+private:
+    static constexpr int ringSize = 4096;
+    static constexpr int binaryTraceVersion = 1;
+
+    void timerCallback() override { collect(); }
+    void writeToTrace (const Frame&);
+
+    juce::AbstractFifo fifo { ringSize };
+    std::vector<Frame> frames;
+    std::atomic<juce::int64> droppedFrames { 0 };
+
+    // Audio thread only.
+    double sampleRate = 44100.0;
+    juce::int64 samplePosition = 0;
+    int lastTotalSteals = 0;
+    juce::int64 lastTotalUnderruns = 0;
+
+    // Message thread only.
+    Summary summary;
+    std::unique_ptr<juce::FileOutputStream> trace;
+    bool binaryTrace = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (PerformanceTelemetry)
+};
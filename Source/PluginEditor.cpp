@@ -1,8 +1,32 @@
 #include "PluginEditor.h"
 
+// Adds the time spent in one paint call to the editor's counters.
+class CodexPianoVST3AudioProcessorEditor::ScopedPaintTimer
+{
+public:
+    explicit ScopedPaintTimer (PaintStats& statsToUpdate)
+        : stats (statsToUpdate), startTicks (juce::Time::getHighResolutionTicks()) {}
+
+    ~ScopedPaintTimer()
+    {
+        ++stats.numPaints;
+        stats.paintSeconds += juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+    }
+
+private:
+    PaintStats& stats;
+    const juce::int64 startTicks;
+
+    JUCE_DECLARE_NON_COPYABLE (ScopedPaintTimer)
+};
+
+// The knob body (shadow, metal, knurling and core) never moves, so it is drawn once per size and pixel scale into an
+// image; only the pointer, the value arc and the highlight over them are drawn per repaint.
 class CodexPianoVST3AudioProcessorEditor::StudioKnobLookAndFeel final : public juce::LookAndFeel_V4
 {
 public:
+    explicit StudioKnobLookAndFeel (PaintStats& statsToUpdate) : stats (statsToUpdate) {}
+
     void drawRotarySlider (juce::Graphics& g,
                            int x,
                            int y,
@@ -13,15 +37,74 @@ public:
                            float rotaryEndAngle,
                            juce::Slider&) override
     {
-        const auto bounds = juce::Rectangle<float> (static_cast<float> (x),
-                                                    static_cast<float> (y),
-                                                    static_cast<float> (width),
-                                                    static_cast<float> (height)).reduced (5.0f);
+        const ScopedPaintTimer paintTimer (stats);
+        const auto area = juce::Rectangle<int> (x, y, width, height).toFloat();
+        const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
 
+        g.drawImage (getBody (width, height, scale), area);
+
+        const auto bounds = area.reduced (5.0f);
         const auto radius = juce::jmin (bounds.getWidth(), bounds.getHeight()) * 0.5f;
         const auto centre = bounds.getCentre();
         const auto angle = rotaryStartAngle + sliderPosProportional * (rotaryEndAngle - rotaryStartAngle);
 
+        // Plastic pointer tip.
+        juce::Path pointer;
+        const auto tipLength = radius * 0.62f;
+        const auto tipWidth = radius * 0.11f;
+        pointer.addRoundedRectangle (-tipWidth, -tipLength, tipWidth * 2.0f, tipLength * 0.45f, tipWidth * 0.45f);
+        pointer.applyTransform (juce::AffineTransform::rotation (angle).translated (centre.x, centre.y));
+        g.setColour (juce::Colour::fromRGB (247, 242, 226));
+        g.fillPath (pointer);
+
+        g.setColour (juce::Colour::fromRGB (33, 29, 24).withAlpha (0.70f));
+        g.strokePath (pointer, juce::PathStrokeType (1.0f));
+
+        g.setColour (juce::Colour::fromRGB (255, 255, 255).withAlpha (0.25f));
+        juce::Path highlightArc;
+        highlightArc.addCentredArc (centre.x, centre.y, radius * 0.93f, radius * 0.93f, 0.0f, rotaryStartAngle, angle, true);
+        g.strokePath (highlightArc, juce::PathStrokeType (2.2f));
+
+        g.setColour (juce::Colour::fromRGB (232, 235, 242).withAlpha (0.45f));
+        g.fillEllipse (centre.x - radius * 0.12f, centre.y - radius * 0.48f, radius * 0.24f, radius * 0.20f);
+    }
+
+private:
+    struct Body
+    {
+        int width = 0, height = 0;
+        float scale = 0.0f;
+        juce::Image image;
+    };
+
+    const juce::Image& getBody (int width, int height, float scale)
+    {
+        for (const auto& body : bodies)
+            if (body.width == width && body.height == height && body.scale == scale)
+                return body.image;
+
+        // All knobs share one size, so this only grows while a window is dragged between displays.
+        if (bodies.size() >= 8)
+            bodies.clear();
+
+        juce::Image image (juce::Image::ARGB, juce::jmax (1, juce::roundToInt (width * scale)),
+                           juce::jmax (1, juce::roundToInt (height * scale)), true);
+        {
+            juce::Graphics g (image);
+            g.addTransform (juce::AffineTransform::scale (scale));
+            drawBody (g, juce::Rectangle<int> (width, height).toFloat().reduced (5.0f));
+        }
+
+        ++stats.numLayerRenders;
+        bodies.push_back ({ width, height, scale, std::move (image) });
+        return bodies.back().image;
+    }
+
+    static void drawBody (juce::Graphics& g, juce::Rectangle<float> bounds)
+    {
+        const auto radius = juce::jmin (bounds.getWidth(), bounds.getHeight()) * 0.5f;
+        const auto centre = bounds.getCentre();
+
         g.setColour (juce::Colours::black.withAlpha (0.38f));
         g.fillEllipse (centre.x - radius, centre.y - radius + 3.0f, radius * 2.0f, radius * 2.0f);
 
@@ -54,33 +137,141 @@ public:
                                         centre.x + core * 0.7f, centre.y + core, false);
         g.setGradientFill (coreShade);
         g.fillEllipse (centre.x - core, centre.y - core, core * 2.0f, core * 2.0f);
+    }
 
-        // Plastic pointer tip.
-        juce::Path pointer;
-        const auto tipLength = radius * 0.62f;
-        const auto tipWidth = radius * 0.11f;
-        pointer.addRoundedRectangle (-tipWidth, -tipLength, tipWidth * 2.0f, tipLength * 0.45f, tipWidth * 0.45f);
-        pointer.applyTransform (juce::AffineTransform::rotation (angle).translated (centre.x, centre.y));
-        g.setColour (juce::Colour::fromRGB (247, 242, 226));
-        g.fillPath (pointer);
+    PaintStats& stats;
+    std::vector<Body> bodies;
+};
 
-        g.setColour (juce::Colour::fromRGB (33, 29, 24).withAlpha (0.70f));
-        g.strokePath (pointer, juce::PathStrokeType (1.0f));
+// Compact DSP load / voice readout. Clicking it starts or stops a CSV trace in the user's documents folder, and its
+// tooltip shows the editor's own paint cost.
+class CodexPianoVST3AudioProcessorEditor::PerformanceMeter final : public juce::Component,
+                                                                    public juce::TooltipClient,
+                                                                    private juce::Timer
+{
+public:
+    PerformanceMeter (PerformanceTelemetry& telemetryToShow, PaintStats& statsToUpdate)
+        : telemetry (telemetryToShow), stats (statsToUpdate)
+    {
+        startTimerHz (15);
+    }
 
-        g.setColour (juce::Colour::fromRGB (255, 255, 255).withAlpha (0.25f));
-        juce::Path highlightArc;
-        highlightArc.addCentredArc (centre.x, centre.y, radius * 0.93f, radius * 0.93f, 0.0f, rotaryStartAngle, angle, true);
-        g.strokePath (highlightArc, juce::PathStrokeType (2.2f));
+    void paint (juce::Graphics& g) override
+    {
+        const ScopedPaintTimer paintTimer (stats);
+        const auto& summary = telemetry.getSummary();
+        auto bounds = getLocalBounds().toFloat();
+
+        g.setColour (juce::Colour::fromRGB (6, 9, 14).withAlpha (0.82f));
+        g.fillRoundedRectangle (bounds, 5.0f);
+        g.setColour (juce::Colour::fromRGB (220, 224, 233).withAlpha (0.18f));
+        g.drawRoundedRectangle (bounds.reduced (0.5f), 5.0f, 1.0f);
+
+        auto content = bounds.reduced (7.0f, 4.0f);
+        auto bar = content.removeFromBottom (3.0f);
+        const auto load = juce::jlimit (0.0f, 1.0f, summary.load);
+        const auto loadColour = load < 0.5f ? juce::Colour::fromRGB (88, 204, 134)
+                              : load < 0.8f ? juce::Colour::fromRGB (255, 176, 66)
+                                            : juce::Colour::fromRGB (240, 72, 64);
+
+        g.setColour (juce::Colours::white.withAlpha (0.10f));
+        g.fillRoundedRectangle (bar, 1.5f);
+        g.setColour (loadColour);
+        g.fillRoundedRectangle (bar.withWidth (bar.getWidth() * load), 1.5f);
+
+        g.setFont (juce::FontOptions (11.0f, juce::Font::bold));
+        g.setColour (juce::Colour::fromRGB (233, 236, 239));
+        g.drawText ("DSP " + juce::String (juce::roundToInt (summary.load * 100.0f)) + "%  max "
+                        + juce::String (juce::roundToInt (summary.maxLoad * 100.0f)) + "%",
+                    content.removeFromTop (content.getHeight() * 0.5f), juce::Justification::centredLeft);
+
+        g.setColour (juce::Colour::fromRGB (233, 236, 239).withAlpha (0.7f));
+        auto voiceText = juce::String (summary.activeVoices) + " voices  " + juce::String (summary.totalSteals) + " steals";
+
+        if (summary.totalUnderruns > 0)
+        {
+            g.setColour (juce::Colour::fromRGB (240, 72, 64));
+            voiceText << "  " << juce::String (summary.totalUnderruns) << " xruns";
+        }
 
-        g.setColour (juce::Colour::fromRGB (232, 235, 242).withAlpha (0.45f));
-        g.fillEllipse (centre.x - radius * 0.12f, centre.y - radius * 0.48f, radius * 0.24f, radius * 0.20f);
+        g.drawText (voiceText, content, juce::Justification::centredLeft);
+
+        if (telemetry.isTracing())
+        {
+            g.setColour (juce::Colour::fromRGB (240, 72, 64));
+            g.fillEllipse (bounds.getRight() - 14.0f, bounds.getY() + 6.0f, 7.0f, 7.0f);
+        }
     }
+
+    void mouseDown (const juce::MouseEvent&) override
+    {
+        if (telemetry.isTracing())
+        {
+            telemetry.stopTrace();
+        }
+        else
+        {
+            const auto folder = juce::File::getSpecialLocation (juce::File::userDocumentsDirectory).getChildFile ("Codex Piano Traces");
+            folder.createDirectory();
+            telemetry.startTrace (folder.getChildFile ("trace-" + juce::Time::getCurrentTime().formatted ("%Y%m%d-%H%M%S") + ".csv"));
+        }
+
+        telemetry.resetMaxLoad();
+        repaint();
+    }
+
+    juce::String getTooltip() override
+    {
+        return juce::String (stats.numPaints) + " paints, " + juce::String (stats.paintSeconds * 1000.0, 1) + " ms total, "
+             + juce::String (stats.paintSeconds * 1.0e6 / static_cast<double> (juce::jmax<juce::int64> (1, stats.numPaints)), 0)
+             + " us each, " + juce::String (stats.numLayerRenders) + " layer renders";
+    }
+
+private:
+    // Everything the meter shows, so a timer tick that would draw the same pixels doesn't repaint.
+    using Display = std::tuple<int, int, int, int, juce::int64, juce::int64, bool>;
+
+    Display getDisplay() const
+    {
+        const auto& summary = telemetry.getSummary();
+        return { juce::roundToInt (summary.load * 100.0f), juce::roundToInt (summary.maxLoad * 100.0f),
+                 juce::roundToInt (juce::jlimit (0.0f, 1.0f, summary.load) * static_cast<float> (getWidth())),
+                 summary.activeVoices, summary.totalSteals, summary.totalUnderruns, telemetry.isTracing() };
+    }
+
+    void timerCallback() override
+    {
+        if (const auto display = getDisplay(); display != lastDisplay)
+        {
+            lastDisplay = display;
+            repaint();
+        }
+    }
+
+    PerformanceTelemetry& telemetry;
+    PaintStats& stats;
+    Display lastDisplay;
 };
 
 CodexPianoVST3AudioProcessorEditor::CodexPianoVST3AudioProcessorEditor (CodexPianoVST3AudioProcessor& p)
     : AudioProcessorEditor (&p), audioProcessor (p)
 {
-    knobLookAndFeel = std::make_unique<StudioKnobLookAndFeel>();
+    // The backdrop covers every pixel, so nothing behind the editor needs repainting with it.
+    setOpaque (true);
+
+    knobLookAndFeel = std::make_unique<StudioKnobLookAndFeel> (paintStats);
+    performanceMeter = std::make_unique<PerformanceMeter> (audioProcessor.getTelemetry(), paintStats);
+    addAndMakeVisible (*performanceMeter);
+
+    sampleFolderButton.setColour (juce::TextButton::buttonColourId, juce::Colour::fromRGB (6, 9, 14).withAlpha (0.82f));
+    sampleFolderButton.setColour (juce::TextButton::textColourOffId, juce::Colour::fromRGB (233, 236, 239));
+    sampleFolderButton.onClick = [this] { chooseSampleFolder(); };
+    addAndMakeVisible (sampleFolderButton);
+
+    impulseResponseButton.setColour (juce::TextButton::buttonColourId, juce::Colour::fromRGB (6, 9, 14).withAlpha (0.82f));
+    impulseResponseButton.setColour (juce::TextButton::textColourOffId, juce::Colour::fromRGB (233, 236, 239));
+    impulseResponseButton.onClick = [this] { chooseImpulseResponse(); };
+    addAndMakeVisible (impulseResponseButton);
 
     setupSlider (gainSlider, gainLabel, "Gain");
     setupSlider (brightnessSlider, brightnessLabel, "Brightness");
@@ -113,6 +304,31 @@ void CodexPianoVST3AudioProcessorEditor::setupSlider (juce::Slider& slider, juce
     addAndMakeVisible (label);
 }
 
+void CodexPianoVST3AudioProcessorEditor::chooseSampleFolder()
+{
+    sampleFolderChooser = std::make_unique<juce::FileChooser> ("Choose a multisample folder", audioProcessor.getSampleFolder());
+
+    sampleFolderChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectDirectories,
+                                      [this] (const juce::FileChooser& chooser)
+    {
+        if (const auto folder = chooser.getResult(); folder.isDirectory())
+            audioProcessor.loadSampleFolder (folder);
+    });
+}
+
+void CodexPianoVST3AudioProcessorEditor::chooseImpulseResponse()
+{
+    impulseResponseChooser = std::make_unique<juce::FileChooser> ("Choose an impulse response for the Convolution reverb",
+                                                                  audioProcessor.getImpulseResponseFile(), "*.wav;*.aif;*.aiff;*.flac");
+
+    impulseResponseChooser->launchAsync (juce::FileBrowserComponent::openMode | juce::FileBrowserComponent::canSelectFiles,
+                                         [this] (const juce::FileChooser& chooser)
+    {
+        if (const auto file = chooser.getResult(); file.existsAsFile())
+            audioProcessor.loadImpulseResponse (file);
+    });
+}
+
 void CodexPianoVST3AudioProcessorEditor::drawPianoBackdrop (juce::Graphics& g)
 {
     auto upper = getLocalBounds().removeFromTop (236).toFloat();
@@ -196,6 +412,27 @@ void CodexPianoVST3AudioProcessorEditor::drawPianoBackdrop (juce::Graphics& g)
 }
 
 void CodexPianoVST3AudioProcessorEditor::paint (juce::Graphics& g)
+{
+    const ScopedPaintTimer paintTimer (paintStats);
+    const auto scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+    if (! backdrop.isValid() || scale != backdropScale)
+    {
+        backdrop = juce::Image (juce::Image::RGB, juce::jmax (1, juce::roundToInt (getWidth() * scale)),
+                                juce::jmax (1, juce::roundToInt (getHeight() * scale)), false);
+        backdropScale = scale;
+
+        juce::Graphics backdropGraphics (backdrop);
+        backdropGraphics.addTransform (juce::AffineTransform::scale (scale));
+        drawBackdrop (backdropGraphics);
+        ++paintStats.numLayerRenders;
+    }
+
+    // Only the clip region is copied, so a knob or meter repaint costs a blit of its own bounds.
+    g.drawImage (backdrop, getLocalBounds().toFloat());
+}
+
+void CodexPianoVST3AudioProcessorEditor::drawBackdrop (juce::Graphics& g)
 {
     juce::ColourGradient gradient (juce::Colour::fromRGB (7, 18, 30), 0.0f, 0.0f,
                                    juce::Colour::fromRGB (34, 24, 15), static_cast<float> (getWidth()), static_cast<float> (getHeight()), false);
@@ -224,6 +461,13 @@ void CodexPianoVST3AudioProcessorEditor::paint (juce::Graphics& g)
 
 void CodexPianoVST3AudioProcessorEditor::resized()
 {
+    backdrop = {};
+
+    // Both sit at the ends of the logo strip drawn by drawPianoBackdrop().
+    performanceMeter->setBounds (getWidth() - 212, 29, 150, 36);
+    sampleFolderButton.setBounds (62, 36, 96, 22);
+    impulseResponseButton.setBounds (164, 36, 60, 22);
+
     auto area = getLocalBounds().removeFromBottom (174).reduced (30, 14);
 
     const auto cell = area.getWidth() / 4;
@@ -12,13 +12,40 @@ public:
     void paint (juce::Graphics&) override;
     void resized() override;
 
+    // Message-thread paint cost of the editor and its knobs and meter, since the editor opened.
+    struct PaintStats
+    {
+        juce::int64 numPaints = 0;
+        juce::int64 numLayerRenders = 0; // backdrop and knob images rebuilt
+        double paintSeconds = 0.0;
+    };
+
+    const PaintStats& getPaintStats() const noexcept { return paintStats; }
+
 private:
     class StudioKnobLookAndFeel;
+    class PerformanceMeter;
+    class ScopedPaintTimer;
     void setupSlider (juce::Slider& slider, juce::Label& label, const juce::String& text);
+    void drawBackdrop (juce::Graphics& g);
     void drawPianoBackdrop (juce::Graphics& g);
+    void chooseSampleFolder();
+    void chooseImpulseResponse();
 
     CodexPianoVST3AudioProcessor& audioProcessor;
+    PaintStats paintStats;
     std::unique_ptr<StudioKnobLookAndFeel> knobLookAndFeel;
+    std::unique_ptr<PerformanceMeter> performanceMeter;
+    juce::TooltipWindow tooltipWindow { this };
+
+    // Everything behind the controls, rendered at the display's pixel scale and rebuilt only on resize or a scale change.
+    juce::Image backdrop;
+    float backdropScale = 0.0f;
+
+    juce::TextButton sampleFolderButton { "Samples..." };
+    std::unique_ptr<juce::FileChooser> sampleFolderChooser;
+    juce::TextButton impulseResponseButton { "IR..." };
+    std::unique_ptr<juce::FileChooser> impulseResponseChooser;
 
     juce::Slider gainSlider;
     juce::Slider brightnessSlider;
@@ -1,183 +1,559 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
 
-PianoVoice::PianoVoice() = default;
+namespace
+{
+const juce::Identifier sampleFolderId { "sampleFolder" };
+const juce::Identifier samplePreloadId { "samplePreloadSeconds" };
+const juce::Identifier impulseResponseId { "impulseResponse" };
+constexpr double defaultSamplePreloadSeconds = 0.5;
+constexpr std::array<int, 4> eventGridSamples { 0, 8, 16, 32 };
+constexpr std::array<int, 4> modulationIntervals { 8, 16, 32, 64 };
+
+// Output below this (about -100 dB) with no voices playing counts as silence.
+constexpr float silenceThreshold = 1.0e-5f;
+constexpr double idleHoldSeconds = 0.2;
+constexpr float minVoiceFloorDb = -120.0f;
+constexpr double programFadeSeconds = 0.005;
+
+// With no block for this long, audio counts as stopped and a program switch is applied straight to the parameters.
+constexpr juce::uint32 audioStoppedMs = 250;
+
+// The offline tier runs the voices at 4x the host rate.
+constexpr size_t offlineOversamplingOrder = 2;
+constexpr size_t oversampledMidiBytes = 16384;
+
+// "CPST", the format version, the size of the rest of the header, then the header (the current program) and the apvts
+// ValueTree in its binary encoding. Version 1 had no header size: the program came straight after the version.
+constexpr int stateMagic = 0x54535043;
+constexpr int stateVersion = 2;
+constexpr int stateHeaderBytes = 4;
+
+// The ParameterSnapshot's parameters, in the order of the processor's SnapshotParameter enum.
+const juce::StringArray snapshotParameterIds { "gain", "brightness", "release", "reverb", "engine", "polyphony",
+                                               "renderThreads", "eventGrid", "modes", "reverbType", "voiceFloor",
+                                               "quality", "mpe", "bendRange", "modRate", "lfoRate", "modEnvelope",
+                                               "mod1Source", "mod1Target", "mod1Amount", "mod2Source", "mod2Target",
+                                               "mod2Amount", "mod3Source", "mod3Target", "mod3Amount", "mod4Source",
+                                               "mod4Target", "mod4Amount" };
+
+// What the modulation slots start out as: pressure and CC74 open up the tone, while vibrato and velocity-dependent
+// sustain are there to be dialled in.
+struct ModulationSlotDefault
+{
+    ModulationMatrix::Source source;
+    ModulationMatrix::Destination destination;
+    float amount;
+};
+
+constexpr ModulationSlotDefault modulationSlotDefaults[] = { { ModulationMatrix::pressure, ModulationMatrix::brightness, 0.5f },
+                                                             { ModulationMatrix::timbre, ModulationMatrix::brightness, 0.3f },
+                                                             { ModulationMatrix::lfo, ModulationMatrix::pitch, 0.0f },
+                                                             { ModulationMatrix::velocity, ModulationMatrix::decay, 0.0f } };
+
+float getReverbRoomSize (float reverbMix)
+{
+    return 0.40f + 0.45f * reverbMix;
+}
+
+juce::Reverb::Parameters getReverbParameters (float reverbMix)
+{
+    juce::Reverb::Parameters reverbParams;
+    reverbParams.roomSize = getReverbRoomSize (reverbMix);
+    reverbParams.damping = 0.30f;
+    reverbParams.width = 0.9f;
+    reverbParams.wetLevel = 0.15f + 0.45f * reverbMix;
+    reverbParams.dryLevel = 1.0f - 0.5f * reverbMix;
+    return reverbParams;
+}
+
+// Quality choices are Auto, Realtime and Offline; Auto follows the host's render mode.
+bool isOfflineTier (int quality, bool nonRealtime) noexcept
+{
+    return quality == 2 || (quality == 0 && nonRealtime);
+}
 
-bool PianoVoice::canPlaySound (juce::SynthesiserSound* sound)
+// 60 dB decay time of juce::Reverb: its longest comb (1617 samples at 44.1 kHz) feeds back by 0.7 + 0.28 * roomSize.
+double getReverbTailSeconds (float roomSize)
 {
-    return dynamic_cast<PianoSound*> (sound) != nullptr;
+    const auto feedback = 0.7 + 0.28 * static_cast<double> (roomSize);
+    return 3.0 * (1617.0 / 44100.0) / -std::log10 (feedback);
 }
+} // namespace
 
-void PianoVoice::startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int)
+CodexPianoVST3AudioProcessor::CodexPianoVST3AudioProcessor()
+    : AudioProcessor (BusesProperties().withOutput ("Output", juce::AudioChannelSet::stereo(), true)),
+      apvts (*this, nullptr, "Parameters", createParameterLayout()),
+      parameters (apvts, snapshotParameterIds)
 {
-    currentFrequency = juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber);
-    sampleRate = getSampleRate() > 0.0 ? getSampleRate() : 44100.0;
+    voiceManager.setLaneSource (VoiceBank::Oscillator::sampled, &sampleStreamer);
+    voiceManager.setLaneSource (VoiceBank::Oscillator::modal, &modalBank);
 
-    updateDeltas();
+    presets = sharedResources->get<PresetBank> ("presets", [] { return std::make_unique<PresetBank> (snapshotParameterIds); });
+    startTimerHz (20);
+}
 
-    level = juce::jlimit (0.0f, 1.0f, velocity);
-    envelope = 1.0f;
-    noteOnSamples = 0.0f;
-    attackNoise = 1.0f;
-    keyIsDown = true;
+CodexPianoVST3AudioProcessor::~CodexPianoVST3AudioProcessor()
+{
+    stopTimer();
 }
 
-void PianoVoice::stopNote (float, bool allowTailOff)
+// Everything processBlock touches is sized here; the audio path itself never allocates or locks
+// (CodexPianoRealtimeCheck enforces this).
+void CodexPianoVST3AudioProcessor::prepareToPlay (double newSampleRate, int samplesPerBlock)
 {
-    keyIsDown = false;
+    // The effects thread may still be on the last chunk of the previous run, so it is stopped before any of the
+    // effects state below changes, and started again once it is all in place.
+    effectsPipeline.release();
+
+    // Workers are spawned here so the audio thread never creates threads: as many as Render Threads asks for, up to
+    // one per core. Lowering the parameter takes effect at once, as fewer workers join in; raising it above what was
+    // spawned only takes effect at the next prepare.
+    const auto renderThreads = static_cast<int> (apvts.getRawParameterValue ("renderThreads")->load());
+    renderPool.prepare (juce::jmin (renderThreads, juce::SystemStats::getNumCpus()) - 1);
 
-    if (! allowTailOff)
+    // The offline tier oversamples the voices, which changes their sample rate and the latency, so the whole tier
+    // is settled here and holds until the next prepare. Hosts prepare again when they switch render mode.
+    offlineTier = isOfflineTier (static_cast<int> (apvts.getRawParameterValue ("quality")->load()), isNonRealtime());
+
+    if (offlineTier)
+    {
+        oversampling = std::make_unique<juce::dsp::Oversampling<float>> (static_cast<size_t> (juce::jmax (1, getTotalNumOutputChannels())),
+                                                                          offlineOversamplingOrder,
+                                                                          juce::dsp::Oversampling<float>::filterHalfBandFIREquiripple,
+                                                                          true, false);
+        oversampling->initProcessing (static_cast<size_t> (samplesPerBlock));
+        oversampledMidi.ensureSize (oversampledMidiBytes);
+    }
+    else
     {
-        clearCurrentNote();
-        envelope = 0.0f;
+        oversampling.reset();
     }
+
+    const auto factor = getOversamplingFactor();
+    const auto voiceRate = newSampleRate * factor;
+    oversamplingBlockSize = samplesPerBlock;
+
+    voiceManager.setCurrentPlaybackSampleRate (voiceRate);
+    voiceManager.prepareScratch (samplesPerBlock * factor, renderPool.getNumParticipants());
+    voiceManager.setWorkerPool (&renderPool);
+    wavetables.prepare (voiceRate, apvts.getRawParameterValue ("brightness")->load());
+    sampleStreamer.prepare (voiceRate);
+    modalBank.prepare (voiceRate, VoiceManager::maxVoices);
+
+    // Both reverbs start at the current levels instead of ramping from their defaults, so the first block of a render
+    // doesn't depend on what the instance did before (preparing snaps their smoothing to the targets).
+    effectsSettings.reverbMix = apvts.getRawParameterValue ("reverb")->load();
+    effectsSettings.convolution = apvts.getRawParameterValue ("reverbType")->load() > 0.5f;
+    effectsSettings.gain = juce::Decibels::decibelsToGain (apvts.getRawParameterValue ("gain")->load());
+    effectsSettings.silent = false;
+    appliedEffects = effectsSettings;
+
+    const auto reverbParams = getReverbParameters (effectsSettings.reverbMix);
+    reverb.setParameters (reverbParams);
+    reverb.setSampleRate (newSampleRate);
+    convolution.setLevels (reverbParams.dryLevel, reverbParams.wetLevel);
+    convolution.prepare (newSampleRate);
+    telemetry.prepare (newSampleRate);
+
+    // Everything derived from the parameters is recomputed for the new sample rate on the first block.
+    outputGain.reset (newSampleRate, 0.02);
+    outputGain.setCurrentAndTargetValue (effectsSettings.gain);
+    parameters.invalidate();
+
+    // The effects thread buys the voices a whole block's deadline at the cost of a block of latency. Offline renders
+    // keep the effects inline, so bounces are identical whether or not the mode is on.
+    if (apvts.getRawParameterValue ("pipelineEffects")->load() > 0.5f && ! isNonRealtime())
+        effectsPipeline.prepare (samplesPerBlock, &processEffectsStage, this);
+
+    const auto oversamplingLatency = oversampling != nullptr ? juce::roundToInt (oversampling->getLatencyInSamples()) : 0;
+    setLatencySamples (effectsPipeline.getLatencySamples() + oversamplingLatency);
+
+    idleHoldSamples = juce::roundToInt (newSampleRate * idleHoldSeconds);
+    silentSamples = 0;
+    programFadeSamples = juce::jmax (1, juce::roundToInt (newSampleRate * programFadeSeconds));
+    fadeInRemaining = 0;
+    audioPrepared.store (true, std::memory_order_relaxed);
 }
 
-void PianoVoice::updateVoiceParameters (float brightnessAmount, float releaseAmount)
+void CodexPianoVST3AudioProcessor::reset()
 {
-    const auto b = juce::jlimit (0.0f, 1.0f, brightnessAmount);
-
-    partialGains[0] = 1.0f;
-    partialGains[1] = 0.30f + 0.45f * b;
-    partialGains[2] = 0.15f + 0.30f * b;
-    partialGains[3] = 0.05f + 0.20f * b;
+    effectsPipeline.reset();
+    voiceManager.reset();
+
+    if (oversampling != nullptr)
+        oversampling->reset();
+
+    reverb.reset();
+    convolution.reset();
+    appliedEffects.silent = effectsSettings.silent = false;
+    fadeInRemaining = 0;
+    outputGain.setCurrentAndTargetValue (outputGain.getTargetValue());
+    parameters.invalidate();
+    silentSamples = 0;
+}
 
-    const auto decaySeconds = 1.0f + 4.0f * juce::jlimit (0.0f, 1.0f, releaseAmount);
-    const auto releaseSeconds = 0.08f + 2.4f * juce::jlimit (0.0f, 1.0f, releaseAmount);
+void CodexPianoVST3AudioProcessor::releaseResources()
+{
+    audioPrepared.store (false, std::memory_order_relaxed);
+
+    // First, so the effects thread is gone before the convolution engines it runs are freed.
+    effectsPipeline.release();
+    wavetables.release();
+    sampleStreamer.release();
+    convolution.release();
+    renderPool.release();
+    oversampling.reset();
+}
 
-    decayCoeff = std::exp (-1.0f / (static_cast<float> (sampleRate) * decaySeconds));
-    releaseCoeff = std::exp (-1.0f / (static_cast<float> (sampleRate) * releaseSeconds));
+#if ! JucePlugin_IsMidiEffect
+bool CodexPianoVST3AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
+{
+    const auto output = layouts.getMainOutputChannelSet();
+    return output == juce::AudioChannelSet::mono() || output == juce::AudioChannelSet::stereo();
 }
+#endif
 
-void PianoVoice::updateDeltas()
+void CodexPianoVST3AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    static constexpr std::array<double, numPartials> multipliers { 1.0, 2.0, 3.0, 4.0 };
+    juce::ScopedNoDenormals noDenormals;
+    const auto blockStartTicks = juce::Time::getHighResolutionTicks();
+    lastBlockMs.store (juce::Time::getMillisecondCounter(), std::memory_order_relaxed);
 
-    for (size_t i = 0; i < multipliers.size(); ++i)
-        phaseDelta[i] = juce::MathConstants<double>::twoPi * currentFrequency * multipliers[i] / sampleRate;
+    for (auto i = getTotalNumInputChannels(); i < getTotalNumOutputChannels(); ++i)
+        buffer.clear (i, 0, buffer.getNumSamples());
+
+    for (const auto metadata : midiMessages)
+        if (const auto message = metadata.getMessage(); message.isProgramChange())
+            setCurrentProgram (message.getProgramChangeNumber());
+
+    updateProgram();
+
+    if (parameters.update())
+        applyParameterChanges();
+
+    const auto numSamples = buffer.getNumSamples();
+
+    // Once the voices and the reverb tail have died away, nothing is rendered until MIDI arrives. clear() also
+    // marks the buffer as silent for hosts that check AudioBuffer::hasBeenCleared().
+    if (silentSamples >= idleHoldSamples && midiMessages.isEmpty() && voiceManager.getNumActiveVoices() == 0)
+    {
+        buffer.clear();
+        telemetry.record (blockStartTicks, numSamples, 0, voiceManager.getNumSteals(),
+                          sampleStreamer.getNumUnderruns() + effectsPipeline.getNumLateBlocks(), 0.0f);
+        return;
+    }
+
+    voiceManager.setWavetables (wavetables.acquire());
+
+    buffer.clear();
+    renderVoices (buffer, midiMessages, numSamples);
+
+    voiceManager.setWavetables (nullptr);
+    wavetables.releaseAcquired();
+    applyProgramFades (buffer, numSamples);
+
+    auto* left = buffer.getWritePointer (0);
+    auto* right = buffer.getNumChannels() > 1 ? buffer.getWritePointer (1) : nullptr;
+    effectsSettings.silent = silentSamples >= idleHoldSamples;
+
+    if (effectsPipeline.isActive())
+        effectsPipeline.process (left, right, numSamples, effectsSettings);
+    else
+        processEffects (left, right, numSamples, effectsSettings);
+
+    const auto peak = buffer.getMagnitude (0, numSamples);
+
+    if (peak < silenceThreshold && voiceManager.getNumActiveVoices() == 0)
+    {
+        silentSamples += numSamples;
+    }
+    else
+    {
+        silentSamples = 0;
+    }
+
+    telemetry.record (blockStartTicks, numSamples, voiceManager.getNumActiveVoices(), voiceManager.getNumSteals(),
+                      sampleStreamer.getNumUnderruns() + effectsPipeline.getNumLateBlocks(), peak);
 }
 
-void PianoVoice::renderNextBlock (juce::AudioBuffer<float>& outputBuffer, int startSample, int numSamples)
+void CodexPianoVST3AudioProcessor::renderVoices (juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages,
+                                                 int numSamples) noexcept
 {
-    if (! isVoiceActive())
+    if (oversampling == nullptr)
+    {
+        voiceManager.renderNextBlock (buffer, midiMessages, 0, numSamples);
         return;
+    }
 
-    auto* left = outputBuffer.getWritePointer (0);
-    auto* right = outputBuffer.getNumChannels() > 1 ? outputBuffer.getWritePointer (1) : nullptr;
+    const auto factor = static_cast<int> (oversampling->getOversamplingFactor());
+    const juce::dsp::AudioBlock<float> block (buffer);
 
-    while (--numSamples >= 0)
+    // The filters hold a prepared block at most, so larger host blocks go through in slices.
+    for (int start = 0; start < numSamples; start += oversamplingBlockSize)
     {
-        float sampleValue = 0.0f;
+        const auto length = juce::jmin (oversamplingBlockSize, numSamples - start);
+        auto slice = block.getSubBlock (static_cast<size_t> (start), static_cast<size_t> (length));
 
-        for (size_t i = 0; i < phase.size(); ++i)
-        {
-            sampleValue += partialGains[i] * std::sin (phase[i]);
-            phase[i] += phaseDelta[i];
+        // Upsampling the silent slice keeps the filter state in step and hands back the oversampled buffer to render into.
+        auto oversampled = oversampling->processSamplesUp (slice);
+        oversampled.clear();
 
-            if (phase[i] >= juce::MathConstants<double>::twoPi)
-                phase[i] -= juce::MathConstants<double>::twoPi;
-        }
+        oversampledMidi.clear();
 
-        const auto attackSamples = static_cast<float> (sampleRate * 0.008);
-        const auto attackEnv = noteOnSamples < attackSamples ? noteOnSamples / attackSamples : 1.0f;
+        // A MidiBuffer stores each event with a 4-byte position and a 2-byte size. Events past what prepareToPlay
+        // reserved are dropped, so a flood of host MIDI can never make the buffer grow on the audio thread.
+        size_t midiBytes = 0;
 
-        if (noteOnSamples < static_cast<float> (sampleRate * 0.02))
+        for (const auto metadata : midiMessages)
         {
-            const auto noiseAmt = 0.08f * attackNoise;
-            sampleValue += noiseAmt * (random.nextFloat() * 2.0f - 1.0f);
-            attackNoise *= 0.9985f;
-        }
+            if (metadata.samplePosition < start || metadata.samplePosition >= start + length)
+                continue;
 
-        sampleValue *= envelope * attackEnv * level;
+            midiBytes += sizeof (juce::int32) + sizeof (juce::uint16) + static_cast<size_t> (metadata.numBytes);
 
-        if (keyIsDown)
-            envelope *= decayCoeff;
-        else
-            envelope *= releaseCoeff;
+            if (midiBytes > oversampledMidiBytes)
+                break;
 
-        if (envelope < 0.00008f)
-        {
-            clearCurrentNote();
-            break;
+            oversampledMidi.addEvent (metadata.data, metadata.numBytes, (metadata.samplePosition - start) * factor);
         }
 
-        left[startSample] += sampleValue;
-        if (right != nullptr)
-            right[startSample] += sampleValue;
+        std::array<float*, 2> channels {};
 
-        ++startSample;
-        noteOnSamples += 1.0f;
+        for (size_t ch = 0; ch < juce::jmin<size_t> (channels.size(), oversampled.getNumChannels()); ++ch)
+            channels[ch] = oversampled.getChannelPointer (ch);
+
+        juce::AudioBuffer<float> view (channels.data(), static_cast<int> (oversampled.getNumChannels()),
+                                       static_cast<int> (oversampled.getNumSamples()));
+        voiceManager.renderNextBlock (view, oversampledMidi, 0, view.getNumSamples());
+        oversampling->processSamplesDown (slice);
     }
 }
 
-CodexPianoVST3AudioProcessor::CodexPianoVST3AudioProcessor()
-    : AudioProcessor (BusesProperties().withOutput ("Output", juce::AudioChannelSet::stereo(), true)),
-      apvts (*this, nullptr, "Parameters", createParameterLayout())
+void CodexPianoVST3AudioProcessor::updateProgram() noexcept
 {
-    synth.clearVoices();
-    for (int i = 0; i < 16; ++i)
-        synth.addVoice (new PianoVoice());
+    // The parameters were replaced since the last block, so a half-done switch must not land on top of them. The
+    // last block faded out for it, so this one fades back in.
+    if (programSwitchCancelled.exchange (false, std::memory_order_acquire))
+    {
+        if (fadingPreset != nullptr)
+            fadeInRemaining = programFadeSamples;
+
+        fadingPreset = nullptr;
+        parameters.clearOverlays();
+    }
 
-    synth.clearSounds();
-    synth.addSound (new PianoSound());
+    // The voices faded out at the end of the last block, so the new settings can land all at once. They are overlaid
+    // on the snapshot rather than written to the parameters, which stay the message thread's to set.
+    if (fadingPreset != nullptr)
+    {
+        for (const auto& setting : fadingPreset->settings)
+            parameters.overlay (setting.snapshotIndex, setting.value);
+
+        presetToAnnounce.store (fadingPreset, std::memory_order_release);
+        fadingPreset = nullptr;
+        fadeInRemaining = programFadeSamples;
+    }
+
+    // Nothing changes yet: this block still plays the old program and fades out at its end.
+    if (auto* preset = pendingPreset.exchange (nullptr, std::memory_order_acquire))
+        fadingPreset = preset;
 }
 
-void CodexPianoVST3AudioProcessor::prepareToPlay (double newSampleRate, int)
+void CodexPianoVST3AudioProcessor::applyProgramFades (juce::AudioBuffer<float>& buffer, int numSamples) noexcept
 {
-    synth.setCurrentPlaybackSampleRate (newSampleRate);
+    if (fadeInRemaining > 0)
+    {
+        const auto length = juce::jmin (fadeInRemaining, numSamples);
+        const auto done = static_cast<float> (programFadeSamples - fadeInRemaining);
+        const auto step = 1.0f / static_cast<float> (programFadeSamples);
 
-    juce::Reverb::Parameters reverbParams;
-    reverbParams.roomSize = 0.55f;
-    reverbParams.damping = 0.35f;
-    reverbParams.width = 0.9f;
-    reverbParams.wetLevel = 0.2f;
-    reverbParams.dryLevel = 0.8f;
-    reverb.setParameters (reverbParams);
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            buffer.applyGainRamp (ch, 0, length, done * step, (done + static_cast<float> (length)) * step);
+
+        fadeInRemaining -= length;
+    }
+
+    if (fadingPreset != nullptr)
+    {
+        const auto length = juce::jmin (programFadeSamples, numSamples);
+
+        for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+            buffer.applyGainRamp (ch, numSamples - length, length, 1.0f, 0.0f);
+    }
+}
+
+void CodexPianoVST3AudioProcessor::timerCallback()
+{
+    if (auto* preset = presetToAnnounce.exchange (nullptr, std::memory_order_acquire))
+        setParametersFromPreset (*preset);
 }
 
-void CodexPianoVST3AudioProcessor::releaseResources() {}
+bool CodexPianoVST3AudioProcessor::isProcessingAudio() const noexcept
+{
+    return audioPrepared.load (std::memory_order_relaxed)
+        && juce::Time::getMillisecondCounter() - lastBlockMs.load (std::memory_order_relaxed) < audioStoppedMs;
+}
 
-#if ! JucePlugin_IsMidiEffect
-bool CodexPianoVST3AudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
+void CodexPianoVST3AudioProcessor::setParametersFromPreset (const PresetBank::Preset& preset)
 {
-    const auto output = layouts.getMainOutputChannelSet();
-    return output == juce::AudioChannelSet::mono() || output == juce::AudioChannelSet::stereo();
+    for (const auto& setting : preset.settings)
+        if (auto* parameter = apvts.getParameter (setting.parameterID))
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (setting.value));
 }
-#endif
 
-void CodexPianoVST3AudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
+void CodexPianoVST3AudioProcessor::cancelProgramSwitch() noexcept
 {
-    juce::ScopedNoDenormals noDenormals;
+    pendingPreset.store (nullptr, std::memory_order_relaxed);
+    presetToAnnounce.store (nullptr, std::memory_order_relaxed);
+    programSwitchCancelled.store (true, std::memory_order_release);
+}
 
-    for (auto i = getTotalNumInputChannels(); i < getTotalNumOutputChannels(); ++i)
-        buffer.clear (i, 0, buffer.getNumSamples());
+void CodexPianoVST3AudioProcessor::applyParameterChanges() noexcept
+{
+    const auto brightness = parameters.get (brightnessParam);
 
-    const auto brightness = apvts.getRawParameterValue ("brightness")->load();
-    const auto release = apvts.getRawParameterValue ("release")->load();
-    const auto gainDb = apvts.getRawParameterValue ("gain")->load();
-    const auto reverbMix = apvts.getRawParameterValue ("reverb")->load();
+    if (parameters.changedSince (appliedParameters, brightnessParam, releaseParam))
+    {
+        voiceManager.updateVoiceParameters (brightness, parameters.get (releaseParam));
+        modalBank.setHammerHardness (brightness);
+        wavetables.requestBrightness (brightness);
+    }
 
-    for (int i = 0; i < synth.getNumVoices(); ++i)
-        if (auto* voice = dynamic_cast<PianoVoice*> (synth.getVoice(i)))
-            voice->updateVoiceParameters (brightness, release);
+    if (parameters.changedSince (appliedParameters, engineParam, polyphonyParam, renderThreadsParam, eventGridParam))
+    {
+        const auto engine = parameters.getInt (engineParam);
+
+        voiceManager.setMaxPolyphony (parameters.getInt (polyphonyParam));
+        voiceManager.setRenderThreads (parameters.getInt (renderThreadsParam));
+        voiceManager.setEventQuantisation (eventGridSamples[(size_t) juce::jlimit (0, 3, parameters.getInt (eventGridParam))]);
+        voiceManager.setOscillator (engine == 3 ? VoiceBank::Oscillator::modal
+                                  : engine == 2 ? VoiceBank::Oscillator::sampled
+                                  : engine == 1 ? VoiceBank::Oscillator::wavetable
+                                                : VoiceBank::Oscillator::additive);
+    }
 
-    buffer.clear();
-    synth.renderNextBlock (buffer, midiMessages, 0, buffer.getNumSamples());
+    // The range goes first, as enabling MPE sets up its zone with the master channel on the current range.
+    if (parameters.changedSince (appliedParameters, bendRangeParam))
+        voiceManager.setPitchBendRange (parameters.getInt (bendRangeParam));
 
-    juce::Reverb::Parameters reverbParams;
-    reverbParams.roomSize = 0.40f + 0.45f * reverbMix;
-    reverbParams.damping = 0.30f;
-    reverbParams.width = 0.9f;
-    reverbParams.wetLevel = 0.15f + 0.45f * reverbMix;
-    reverbParams.dryLevel = 1.0f - 0.5f * reverbMix;
-    reverb.setParameters (reverbParams);
+    if (parameters.changedSince (appliedParameters, mpeParam))
+        voiceManager.setMpeEnabled (parameters.getInt (mpeParam) != 0);
+
+    if (parameters.changedSince (appliedParameters, modRateParam, lfoRateParam, modEnvelopeParam)
+        || parameters.changedInRange (appliedParameters, mod1SourceParam, lastModulationParam))
+    {
+        ModulationMatrix matrix;
 
-    if (buffer.getNumChannels() > 1)
-        reverb.processStereo (buffer.getWritePointer (0), buffer.getWritePointer (1), buffer.getNumSamples());
+        // The control interval is in host samples, so oversampled voices tick as often in real time.
+        matrix.controlInterval = modulationIntervals[(size_t) juce::jlimit (0, 3, parameters.getInt (modRateParam))] * getOversamplingFactor();
+        matrix.lfoHz = parameters.get (lfoRateParam);
+        matrix.envelopeSeconds = parameters.get (modEnvelopeParam);
+
+        for (int slot = 0; slot < numModulationSlots; ++slot)
+        {
+            const auto first = mod1SourceParam + 3 * slot;
+            matrix.addRoute (static_cast<ModulationMatrix::Source> (juce::jlimit (0, ModulationMatrix::numSources - 1, parameters.getInt (first))),
+                             static_cast<ModulationMatrix::Destination> (juce::jlimit (0, ModulationMatrix::numDestinations - 1, parameters.getInt (first + 1))),
+                             parameters.get (first + 2));
+        }
+
+        voiceManager.setModulation (matrix);
+    }
+
+    // The offline tier plays every mode and partial, whatever Modes and Voice Floor say.
+    if (parameters.changedSince (appliedParameters, modesParam))
+        modalBank.setModeLimit (offlineTier ? ModalResonatorBank::maxModes : parameters.getInt (modesParam));
+
+    // Reverb and gain changes reach the effects with the next block they process.
+    effectsSettings.reverbMix = parameters.get (reverbParam);
+    effectsSettings.convolution = parameters.getInt (reverbTypeParam) == 1;
+    effectsSettings.gain = juce::Decibels::decibelsToGain (parameters.get (gainParam));
+
+    // The convolution tail depends on the loaded response and is added in getTailLengthSeconds().
+    if (parameters.changedSince (appliedParameters, releaseParam, reverbParam, reverbTypeParam))
+        tailSeconds.store (voiceManager.getReleaseTailSeconds()
+                               + (effectsSettings.convolution ? 0.0 : getReverbTailSeconds (getReverbRoomSize (effectsSettings.reverbMix))),
+                           std::memory_order_relaxed);
+
+    if (parameters.changedSince (appliedParameters, voiceFloorParam))
+    {
+        // The bottom of the range turns the level of detail off.
+        const auto floorDb = parameters.get (voiceFloorParam);
+        const auto floorLevel = floorDb > minVoiceFloorDb && ! offlineTier ? juce::Decibels::decibelsToGain (floorDb) : 0.0f;
+        voiceManager.setDetailFloor (floorLevel);
+        modalBank.setDetailFloor (floorLevel);
+    }
+
+    appliedParameters = parameters.getGeneration();
+}
+
+void CodexPianoVST3AudioProcessor::processEffects (float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept
+{
+    if (settings.convolution != appliedEffects.convolution || settings.reverbMix != appliedEffects.reverbMix)
+    {
+        // Whatever the newly selected reverb last rang with is stale by now.
+        if (settings.convolution != appliedEffects.convolution)
+        {
+            reverb.reset();
+            convolution.reset();
+        }
+
+        const auto reverbParams = getReverbParameters (settings.reverbMix);
+        reverb.setParameters (reverbParams);
+        convolution.setLevels (reverbParams.dryLevel, reverbParams.wetLevel);
+    }
+
+    if (settings.gain != appliedEffects.gain)
+        outputGain.setTargetValue (settings.gain);
+
+    if (settings.silent)
+    {
+        // The reverb's residue is inaudible by now; clearing it means the next note starts from a clean state.
+        if (! appliedEffects.silent)
+        {
+            reverb.reset();
+            convolution.reset();
+        }
+
+        // Nothing is audible, so a pending gain ramp can finish at once.
+        outputGain.setCurrentAndTargetValue (settings.gain);
+    }
+
+    appliedEffects = settings;
+
+    if (settings.convolution)
+        convolution.process (left, right, numSamples);
+    else if (right != nullptr)
+        reverb.processStereo (left, right, numSamples);
     else
-        reverb.processMono (buffer.getWritePointer (0), buffer.getNumSamples());
+        reverb.processMono (left, numSamples);
+
+    // The per-sample ramp only runs while Gain is actually moving.
+    if (outputGain.isSmoothing())
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto gain = outputGain.getNextValue();
+            left[i] *= gain;
+
+            if (right != nullptr)
+                right[i] *= gain;
+        }
+    }
+    else if (const auto gain = outputGain.getTargetValue(); gain != 1.0f)
+    {
+        juce::FloatVectorOperations::multiply (left, gain, numSamples);
+
+        if (right != nullptr)
+            juce::FloatVectorOperations::multiply (right, gain, numSamples);
+    }
+}
 
-    buffer.applyGain (juce::Decibels::decibelsToGain (gainDb));
+void CodexPianoVST3AudioProcessor::processEffectsStage (void* context, float* left, float* right, int numSamples,
+                                                        const EffectsSettings& settings) noexcept
+{
+    static_cast<CodexPianoVST3AudioProcessor*> (context)->processEffects (left, right, numSamples, settings);
 }
 
 juce::AudioProcessorEditor* CodexPianoVST3AudioProcessor::createEditor()
@@ -224,24 +600,43 @@ bool CodexPianoVST3AudioProcessor::isMidiEffect() const
 
 double CodexPianoVST3AudioProcessor::getTailLengthSeconds() const
 {
-    return 3.5;
+    const auto useConvolution = apvts.getRawParameterValue ("reverbType")->load() > 0.5f;
+    return tailSeconds.load (std::memory_order_relaxed) + (useConvolution ? convolution.getTailSeconds() : 0.0);
 }
 
 int CodexPianoVST3AudioProcessor::getNumPrograms()
 {
-    return 1;
+    return presets->size();
 }
 
 int CodexPianoVST3AudioProcessor::getCurrentProgram()
 {
-    return 0;
+    return currentProgram.load (std::memory_order_relaxed);
 }
 
-void CodexPianoVST3AudioProcessor::setCurrentProgram (int) {}
+void CodexPianoVST3AudioProcessor::setCurrentProgram (int index)
+{
+    if (! juce::isPositiveAndBelow (index, presets->size()))
+        return;
+
+    currentProgram.store (index, std::memory_order_relaxed);
+    const auto& preset = (*presets)[index];
+
+    // A queued switch would wait for a block that may never come, and the state would save the new program next to
+    // the old values, so without audio the parameters are set here and now.
+    if (juce::MessageManager::existsAndIsCurrentThread() && ! isProcessingAudio())
+    {
+        cancelProgramSwitch();
+        setParametersFromPreset (preset);
+        return;
+    }
+
+    pendingPreset.store (&preset, std::memory_order_release);
+}
 
-const juce::String CodexPianoVST3AudioProcessor::getProgramName (int)
+const juce::String CodexPianoVST3AudioProcessor::getProgramName (int index)
 {
-    return {};
+    return juce::isPositiveAndBelow (index, presets->size()) ? (*presets)[index].name : juce::String();
 }
 
 void CodexPianoVST3AudioProcessor::changeProgramName (int, const juce::String&) {}
@@ -250,18 +645,148 @@ void CodexPianoVST3AudioProcessor::getStateInformation (juce::MemoryBlock& destD
 {
     if (const auto state = apvts.copyState(); state.isValid())
     {
-        std::unique_ptr<juce::XmlElement> xml (state.createXml());
-        copyXmlToBinary (*xml, destData);
+        juce::MemoryOutputStream stream (destData, false);
+        stream.writeInt (stateMagic);
+        stream.writeInt (stateVersion);
+        stream.writeInt (stateHeaderBytes);
+        stream.writeInt (getCurrentProgram());
+        state.writeToStream (stream);
     }
 }
 
 void CodexPianoVST3AudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    std::unique_ptr<juce::XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes));
+    juce::ValueTree state;
+    juce::MemoryInputStream stream (data, static_cast<size_t> (juce::jmax (0, sizeInBytes)), false);
+
+    if (sizeInBytes >= 12 && stream.readInt() == stateMagic)
+    {
+        const auto version = stream.readInt();
+        auto program = -1;
+        auto headerValid = true;
+
+        if (version == 1)
+        {
+            program = stream.readInt();
+        }
+        else if (version >= 2)
+        {
+            // The header states its size, so fields a newer version appends are skipped rather than read as the tree.
+            const auto headerBytes = stream.readInt();
+            const auto treeStart = stream.getPosition() + headerBytes;
+            headerValid = headerBytes >= stateHeaderBytes && treeStart <= stream.getTotalLength();
+
+            if (headerValid)
+            {
+                program = stream.readInt();
+                stream.setPosition (treeStart);
+            }
+        }
+        else
+        {
+            headerValid = false;
+        }
+
+        if (headerValid)
+            state = juce::ValueTree::readFromStream (stream);
+
+        // The parameters in the state already hold the program's values, so no switch is queued.
+        if (state.hasType (apvts.state.getType()) && juce::isPositiveAndBelow (program, presets->size()))
+            currentProgram.store (program, std::memory_order_relaxed);
+    }
+    else if (std::unique_ptr<juce::XmlElement> xmlState (getXmlFromBinary (data, sizeInBytes)); xmlState != nullptr)
+    {
+        state = juce::ValueTree::fromXml (*xmlState);
+    }
+
+    // The restored parameters replace whatever a program switch still in progress was going to set.
+    if (state.hasType (apvts.state.getType()))
+    {
+        cancelProgramSwitch();
+        apvts.replaceState (state);
+    }
+
+    reloadSamplesFromState();
+
+    if (const auto file = getImpulseResponseFile(); file != loadedImpulseResponse)
+        loadImpulseResponse (file);
+}
+
+bool CodexPianoVST3AudioProcessor::loadSampleFolder (const juce::File& folder)
+{
+    apvts.state.setProperty (sampleFolderId, folder.getFullPathName(), nullptr);
+    auto pool = SamplePool::loadFolder (folder, getSamplePreloadSeconds());
+    const auto loaded = pool != nullptr;
+
+    loadedSampleFolder = folder;
+    loadedPreloadSeconds = getSamplePreloadSeconds();
+
+    // Files are scanned and heads read above, and the streaming thread is stopped and the rings built before the
+    // audio callback is held off for the swap itself. The old pool goes once the callback is running again.
+    sampleStreamer.beginPoolChange (loaded);
+    std::unique_ptr<SamplePool> oldPool;
+
+    {
+        const juce::ScopedLock callbackLock (getCallbackLock());
+        oldPool = sampleStreamer.swapPool (std::move (pool));
+    }
+
+    sampleStreamer.endPoolChange();
+    return loaded;
+}
+
+juce::File CodexPianoVST3AudioProcessor::getSampleFolder() const
+{
+    const auto path = apvts.state.getProperty (sampleFolderId).toString();
+    return path.isNotEmpty() ? juce::File (path) : juce::File();
+}
+
+void CodexPianoVST3AudioProcessor::loadImpulseResponse (const juce::File& file)
+{
+    apvts.state.setProperty (impulseResponseId, file.getFullPathName(), nullptr);
+    loadedImpulseResponse = file;
+    convolution.loadImpulseResponse (file);
+}
+
+juce::File CodexPianoVST3AudioProcessor::getImpulseResponseFile() const
+{
+    const auto path = apvts.state.getProperty (impulseResponseId).toString();
+    return path.isNotEmpty() ? juce::File (path) : juce::File();
+}
+
+void CodexPianoVST3AudioProcessor::setSamplePreloadSeconds (double seconds)
+{
+    apvts.state.setProperty (samplePreloadId, juce::jlimit (0.0, 30.0, seconds), nullptr);
+
+    if (sampleStreamer.hasPool())
+        loadSampleFolder (getSampleFolder());
+}
+
+double CodexPianoVST3AudioProcessor::getSamplePreloadSeconds() const
+{
+    return static_cast<double> (apvts.state.getProperty (samplePreloadId, defaultSamplePreloadSeconds));
+}
+
+CodexPianoVST3AudioProcessor::MemoryUsage CodexPianoVST3AudioProcessor::getMemoryUsage() const
+{
+    MemoryUsage usage;
+    usage.shared = sharedResources->getReport();
+    usage.privateBytes = voiceManager.getMemoryBytes() + sampleStreamer.getPrivateMemoryBytes()
+                       + modalBank.getPrivateMemoryBytes() + convolution.getPrivateMemoryBytes();
+    return usage;
+}
+
+void CodexPianoVST3AudioProcessor::reloadSamplesFromState()
+{
+    const auto folder = getSampleFolder();
+
+    if (folder == loadedSampleFolder && juce::approximatelyEqual (getSamplePreloadSeconds(), loadedPreloadSeconds))
+        return;
 
-    if (xmlState != nullptr)
-        if (xmlState->hasTagName (apvts.state.getType()))
-            apvts.replaceState (juce::ValueTree::fromXml (*xmlState));
+    if (folder.isDirectory())
+        loadSampleFolder (folder);
+    else if (sampleStreamer.hasPool())
+        loadSampleFolder ({});
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout CodexPianoVST3AudioProcessor::createParameterLayout()
@@ -280,6 +805,67 @@ juce::AudioProcessorValueTreeState::ParameterLayout CodexPianoVST3AudioProcessor
     params.push_back (std::make_unique<juce::AudioParameterFloat> (
         "reverb", "Reverb", juce::NormalisableRange<float> (0.0f, 1.0f, 0.001f), 0.2f));
 
+    params.push_back (std::make_unique<juce::AudioParameterChoice> (
+        "reverbType", "Reverb Type", juce::StringArray { "Algorithmic", "Convolution" }, 0));
+
+    params.push_back (std::make_unique<juce::AudioParameterChoice> (
+        "engine", "Engine", juce::StringArray { "Additive", "Wavetable", "Sampled", "Modal" }, 0));
+
+    params.push_back (std::make_unique<juce::AudioParameterInt> (
+        "modes", "Modes", ModalResonatorBank::minModes, ModalResonatorBank::maxModes, 64));
+
+    params.push_back (std::make_unique<juce::AudioParameterInt> (
+        "polyphony", "Polyphony", 1, VoiceManager::maxVoices, 64));
+
+    params.push_back (std::make_unique<juce::AudioParameterInt> (
+        "renderThreads", "Render Threads", 1, RenderWorkerPool::maxParticipants, 1));
+
+    params.push_back (std::make_unique<juce::AudioParameterChoice> (
+        "eventGrid", "Event Timing", juce::StringArray { "Sample-accurate", "8 Samples", "16 Samples", "32 Samples" }, 0));
+
+    params.push_back (std::make_unique<juce::AudioParameterFloat> (
+        "voiceFloor", "Voice Floor", juce::NormalisableRange<float> (minVoiceFloorDb, -60.0f, 1.0f), -80.0f));
+
+    params.push_back (std::make_unique<juce::AudioParameterBool> (
+        "pipelineEffects", "Pipelined Effects", false));
+
+    params.push_back (std::make_unique<juce::AudioParameterChoice> (
+        "quality", "Quality", juce::StringArray { "Auto", "Realtime", "Offline" }, 0));
+
+    params.push_back (std::make_unique<juce::AudioParameterBool> (
+        "mpe", "MPE", false));
+
+    params.push_back (std::make_unique<juce::AudioParameterInt> (
+        "bendRange", "Bend Range", 0, 24, 2));
+
+    params.push_back (std::make_unique<juce::AudioParameterChoice> (
+        "modRate", "Modulation Rate", juce::StringArray { "8 Samples", "16 Samples", "32 Samples", "64 Samples" }, 2));
+
+    params.push_back (std::make_unique<juce::AudioParameterFloat> (
+        "lfoRate", "LFO Rate", juce::NormalisableRange<float> (0.1f, 12.0f, 0.01f, 0.5f), 5.0f));
+
+    params.push_back (std::make_unique<juce::AudioParameterFloat> (
+        "modEnvelope", "Mod Envelope", juce::NormalisableRange<float> (0.02f, 5.0f, 0.01f, 0.5f), 0.5f));
+
+    static_assert (std::size (modulationSlotDefaults) == numModulationSlots);
+
+    for (int slot = 0; slot < numModulationSlots; ++slot)
+    {
+        const auto id = "mod" + juce::String (slot + 1);
+        const auto name = "Mod " + juce::String (slot + 1) + " ";
+        const auto& defaults = modulationSlotDefaults[slot];
+
+        params.push_back (std::make_unique<juce::AudioParameterChoice> (
+            id + "Source", name + "Source", juce::StringArray { "Velocity", "Key", "Pressure", "Timbre", "LFO", "Envelope" },
+            static_cast<int> (defaults.source)));
+
+        params.push_back (std::make_unique<juce::AudioParameterChoice> (
+            id + "Target", name + "Target", juce::StringArray { "Pitch", "Brightness", "Decay" }, static_cast<int> (defaults.destination)));
+
+        params.push_back (std::make_unique<juce::AudioParameterFloat> (
+            id + "Amount", name + "Amount", juce::NormalisableRange<float> (-1.0f, 1.0f, 0.001f), defaults.amount));
+    }
+
     return { params.begin(), params.end() };
 }
 
@@ -1,63 +1,36 @@
 #pragma once
 
 #include <JuceHeader.h>
-
-class PianoSound final : public juce::SynthesiserSound
+#include "ConvolutionReverb.h"
+#include "EffectsPipeline.h"
+#include "ModalResonator.h"
+#include "ParameterSnapshot.h"
+#include "PerformanceTelemetry.h"
+#include "PresetBank.h"
+#include "SampleStreamer.h"
+#include "SharedResourceCache.h"
+#include "VoiceManager.h"
+#include "Wavetable.h"
+
+class CodexPianoVST3AudioProcessor final : public juce::AudioProcessor,
+                                           private juce::Timer
 {
 public:
-    bool appliesToNote (int) override { return true; }
-    bool appliesToChannel (int) override { return true; }
-};
-
-class PianoVoice final : public juce::SynthesiserVoice
-{
-public:
-    PianoVoice();
-    using juce::SynthesiserVoice::renderNextBlock;
-
-    bool canPlaySound (juce::SynthesiserSound* sound) override;
-    void startNote (int midiNoteNumber, float velocity, juce::SynthesiserSound*, int) override;
-    void stopNote (float velocity, bool allowTailOff) override;
-    void pitchWheelMoved (int) override {}
-    void controllerMoved (int, int) override {}
-    void renderNextBlock (juce::AudioBuffer<float>&, int startSample, int numSamples) override;
-
-    void updateVoiceParameters (float brightnessAmount, float releaseAmount);
-
-private:
-    void updateDeltas();
-
-    static constexpr int numPartials = 4;
-
-    double sampleRate = 44100.0;
-    double currentFrequency = 440.0;
-
-    std::array<double, numPartials> phase {};
-    std::array<double, numPartials> phaseDelta {};
-    std::array<float, numPartials> partialGains { 1.0f, 0.52f, 0.30f, 0.15f };
-
-    float level = 0.0f;
-    float envelope = 0.0f;
-    float decayCoeff = 0.9995f;
-    float releaseCoeff = 0.9990f;
-    float noteOnSamples = 0.0f;
-    float attackNoise = 0.0f;
-
-    bool keyIsDown = false;
+    // Modulation slots, each a source, a target and an amount ("mod1Source", "mod1Target", "mod1Amount", ...).
+    static constexpr int numModulationSlots = 4;
 
-    juce::Random random;
-};
-
-class CodexPianoVST3AudioProcessor final : public juce::AudioProcessor
-{
-public:
     CodexPianoVST3AudioProcessor();
-    ~CodexPianoVST3AudioProcessor() override = default;
+    ~CodexPianoVST3AudioProcessor() override;
     using juce::AudioProcessor::processBlock;
 
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
 
+    // Stops every voice and clears the reverb tails without reallocating. With unchanged parameters, what follows
+    // renders bit-identically to a freshly prepared instance, which lets batch rendering reuse one processor per core.
+    // Not to be called concurrently with processBlock.
+    void reset() override;
+
    #if ! JucePlugin_IsMidiEffect
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
    #endif
@@ -74,12 +47,18 @@ public:
     bool isMidiEffect() const override;
     double getTailLengthSeconds() const override;
 
+    // Programs are the factory presets. Selecting one is safe from any thread, the audio thread included. While audio
+    // runs, the voices fade out at the end of the next block and back in with the new settings, which reach the host
+    // and editor shortly after; with no audio running, a selection on the message thread sets the parameters at once.
+    // MIDI program changes select them too.
     int getNumPrograms() override;
     int getCurrentProgram() override;
     void setCurrentProgram (int index) override;
     const juce::String getProgramName (int index) override;
     void changeProgramName (int index, const juce::String& newName) override;
 
+    // A versioned binary format (the ValueTree's own encoding behind a small header); XML states from older versions
+    // still load.
     void getStateInformation (juce::MemoryBlock& destData) override;
     void setStateInformation (const void* data, int sizeInBytes) override;
 
@@ -87,9 +66,138 @@ public:
 
     static juce::AudioProcessorValueTreeState::ParameterLayout createParameterLayout();
 
+    // How evenly the parallel render mode spread voice groups over its threads.
+    RenderWorkerPool::Stats getRenderThreadStats() const noexcept { return renderPool.getStats(); }
+
+    // Per-block timing, load, voice and level telemetry; read and trace from the message thread.
+    PerformanceTelemetry& getTelemetry() noexcept { return telemetry; }
+
+    // Message thread: loads the multisample folder used by the Sampled engine and remembers it in the plugin state.
+    bool loadSampleFolder (const juce::File& folder);
+    juce::File getSampleFolder() const;
+
+    // Message thread: the impulse response for the Convolution reverb type, loaded in the background and kept in the
+    // plugin state. An empty file selects the built-in room.
+    void loadImpulseResponse (const juce::File& file);
+    juce::File getImpulseResponseFile() const;
+
+    // How much of each sample is kept in memory; the rest streams from disk. Reloads the current folder.
+    void setSamplePreloadSeconds (double seconds);
+    double getSamplePreloadSeconds() const;
+
+    // Message thread: resources shared with every other instance in the process, and what this instance owns alone.
+    struct MemoryUsage
+    {
+        SharedResourceCache::Report shared;
+        size_t privateBytes = 0;
+    };
+
+    MemoryUsage getMemoryUsage() const;
+
+    // How many times faster than the host rate the voices run: 4 in the offline quality tier, otherwise 1. Fixed at
+    // prepareToPlay, like the latency it adds and the rest of the tier.
+    int getOversamplingFactor() const noexcept { return oversampling != nullptr ? static_cast<int> (oversampling->getOversamplingFactor()) : 1; }
+
 private:
-    juce::Synthesiser synth;
+    // Indices into the parameter snapshot, in the order the constructor lists the IDs.
+    enum SnapshotParameter
+    {
+        gainParam,
+        brightnessParam,
+        releaseParam,
+        reverbParam,
+        engineParam,
+        polyphonyParam,
+        renderThreadsParam,
+        eventGridParam,
+        modesParam,
+        reverbTypeParam,
+        voiceFloorParam,
+        qualityParam,
+        mpeParam,
+        bendRangeParam,
+        modRateParam,
+        lfoRateParam,
+        modEnvelopeParam,
+        mod1SourceParam, // then target and amount, and the same three for every further slot
+        lastModulationParam = mod1SourceParam + 3 * numModulationSlots - 1
+    };
+
+    void reloadSamplesFromState();
+
+    // Audio thread: switches to a program picked since the last block, fading the voices around the switch.
+    void updateProgram() noexcept;
+    void applyProgramFades (juce::AudioBuffer<float>& buffer, int numSamples) noexcept;
+
+    // Message thread: brings the parameter objects, and so the host and editor, in line with a program the audio
+    // thread switched to.
+    void timerCallback() override;
+
+    // Whether blocks are arriving, so that a program switch can rely on the audio thread to apply it.
+    bool isProcessingAudio() const noexcept;
+
+    // Message thread: writes a preset's values to the parameters.
+    void setParametersFromPreset (const PresetBank::Preset& preset);
+
+    // Any thread: drops a program switch that is queued or under way, because the parameters were replaced by other
+    // means. The audio thread lets go of its fading preset and overlays at the start of its next block.
+    void cancelProgramSwitch() noexcept;
+
+    // Audio thread: pushes the snapshot values that moved since the last call to the engine.
+    void applyParameterChanges() noexcept;
+
+    // Audio thread: renders the voices into the cleared buffer, oversampled when the offline tier was prepared.
+    void renderVoices (juce::AudioBuffer<float>& buffer, const juce::MidiBuffer& midiMessages, int numSamples) noexcept;
+
+    // The post-synth chain (reverb, then gain). Runs on the audio thread, or on the pipeline's effects thread when
+    // pipelined; either way it is the only code touching the reverbs and the output gain while playing.
+    void processEffects (float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept;
+    static void processEffectsStage (void* context, float* left, float* right, int numSamples, const EffectsSettings& settings) noexcept;
+
+    ParameterSnapshot parameters;
+    juce::uint32 appliedParameters = 0;
+
+    // What the synth wants from the effects (audio thread), and what the effects stage last applied.
+    EffectsSettings effectsSettings, appliedEffects;
+    juce::SmoothedValue<float> outputGain { 1.0f };
+
+    // Release plus reverb decay for the current settings, reported to the host as the tail length.
+    std::atomic<double> tailSeconds { 3.5 };
+    juce::int64 silentSamples = 0;
+    int idleHoldSamples = 0;
+
+    VoiceManager voiceManager;
+    RenderWorkerPool renderPool;
+    WavetableCache wavetables;
+    SampleStreamer sampleStreamer;
+    ModalResonatorBank modalBank;
+    juce::File loadedSampleFolder;
+    double loadedPreloadSeconds = -1.0;
     juce::Reverb reverb;
+    ConvolutionReverb convolution;
+    juce::File loadedImpulseResponse;
+    EffectsPipeline effectsPipeline;
+
+    // The offline tier's voice oversampling and its MIDI retimed to the oversampled rate, both sized in prepareToPlay.
+    std::unique_ptr<juce::dsp::Oversampling<float>> oversampling;
+    juce::MidiBuffer oversampledMidi;
+    int oversamplingBlockSize = 0;
+    bool offlineTier = false;
+    PerformanceTelemetry telemetry;
+    juce::SharedResourcePointer<SharedResourceCache> sharedResources;
+
+    std::shared_ptr<const PresetBank> presets;
+    std::atomic<int> currentProgram { 0 };
+    std::atomic<const PresetBank::Preset*> pendingPreset { nullptr };
+    std::atomic<const PresetBank::Preset*> presetToAnnounce { nullptr };
+    std::atomic<bool> programSwitchCancelled { false };
+    std::atomic<bool> audioPrepared { false };
+    std::atomic<juce::uint32> lastBlockMs { 0 };
+
+    // Audio thread only: the program waiting for its fade-out to finish, and what is left of the fade-in.
+    const PresetBank::Preset* fadingPreset = nullptr;
+    int programFadeSamples = 0;
+    int fadeInRemaining = 0;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (CodexPianoVST3AudioProcessor)
 };
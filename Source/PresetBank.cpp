@@ -0,0 +1,57 @@
+#include "PresetBank.h"
+
+namespace
+{
+struct FactoryPreset
+{
+    const char* name;
+    float gain, brightness, release, reverb, reverbType, engine, modes;
+};
+
+// Engine: 0 additive, 1 wavetable, 3 modal (the sampled engine needs a user folder, so it has no factory preset).
+constexpr FactoryPreset factoryPresets[] =
+{
+    { "Studio Piano",    -6.0f, 0.55f, 0.45f, 0.20f, 0.0f, 0.0f,  64.0f },
+    { "Bright Stage",    -7.0f, 0.85f, 0.35f, 0.12f, 0.0f, 1.0f,  64.0f },
+    { "Soft Felt",       -4.0f, 0.20f, 0.55f, 0.25f, 0.0f, 0.0f,  64.0f },
+    { "Concert Hall",    -6.0f, 0.60f, 0.60f, 0.55f, 1.0f, 1.0f,  64.0f },
+    { "Modal Grand",     -6.0f, 0.60f, 0.50f, 0.25f, 0.0f, 3.0f, 128.0f },
+    { "Modal Upright",   -5.0f, 0.40f, 0.35f, 0.15f, 0.0f, 3.0f,  48.0f },
+    { "Dry Keys",        -6.0f, 0.70f, 0.25f, 0.00f, 0.0f, 1.0f,  64.0f },
+    { "Distant Dream",   -8.0f, 0.30f, 0.80f, 0.85f, 1.0f, 0.0f,  64.0f }
+};
+} // namespace
+
+PresetBank::PresetBank (const juce::StringArray& snapshotParameterIDs)
+{
+    for (const auto& factory : factoryPresets)
+    {
+        const std::pair<const char*, float> values[] = { { "gain", factory.gain }, { "brightness", factory.brightness },
+                                                         { "release", factory.release }, { "reverb", factory.reverb },
+                                                         { "reverbType", factory.reverbType }, { "engine", factory.engine },
+                                                         { "modes", factory.modes } };
+        Preset preset;
+        preset.name = factory.name;
+
+        for (const auto& [id, value] : values)
+        {
+            const auto index = snapshotParameterIDs.indexOf (id);
+            jassert (index >= 0);
+
+            if (index >= 0)
+                preset.settings.push_back ({ id, index, value });
+        }
+
+        presets.push_back (std::move (preset));
+    }
+}
+
+size_t PresetBank::getMemoryBytes() const noexcept
+{
+    auto bytes = sizeof (*this);
+
+    for (const auto& preset : presets)
+        bytes += sizeof (Preset) + preset.settings.capacity() * sizeof (Setting);
+
+    return bytes;
+}
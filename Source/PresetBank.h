@@ -0,0 +1,43 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// The factory programs, resolved once per process to snapshot indices and plain parameter values, so selecting one
+// on the audio thread is a pointer swap followed by a handful of stores. Immutable once built and shared by every
+// instance via the SharedResourceCache.
+//
+// Values rather than finished coefficients: everything derived from them (partial gains, decay coefficients, reverb
+// and modal settings) depends on the sample rate and quality tier an instance was prepared with, so a coefficient
+// bank could be neither built once nor shared. Deriving them takes a handful of exp/pow calls and a pass over the
+// sounding voices in applyParameterChanges, allocation- and lock-free like any automation change, within the fade
+// (CodexPianoBench --suite program-switch times it). A brightness the wavetable cache has not built yet follows a
+// moment later from its builder thread, as it does for automation.
+class PresetBank
+{
+public:
+    struct Setting
+    {
+        juce::String parameterID;
+        int snapshotIndex = -1; // position in the processor's ParameterSnapshot
+        float value = 0.0f;     // in the parameter's own units, as the snapshot holds it
+    };
+
+    struct Preset
+    {
+        juce::String name;
+        std::vector<Setting> settings;
+    };
+
+    // Only sound-shaping parameters are part of a preset; polyphony, threading and the like stay as they are.
+    explicit PresetBank (const juce::StringArray& snapshotParameterIDs);
+
+    int size() const noexcept { return static_cast<int> (presets.size()); }
+    const Preset& operator[] (int index) const noexcept { return presets[(size_t) juce::jlimit (0, size() - 1, index)]; }
+
+    size_t getMemoryBytes() const noexcept;
+
+private:
+    std::vector<Preset> presets;
+
+    JUCE_DECLARE_NON_COPYABLE (PresetBank)
+};
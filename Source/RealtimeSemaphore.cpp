@@ -0,0 +1,86 @@
+#include "RealtimeSemaphore.h"
+
+#if JUCE_WINDOWS
+ #ifndef NOMINMAX
+  #define NOMINMAX
+ #endif
+ #include <windows.h>
+#elif JUCE_MAC || JUCE_IOS
+ #include <dispatch/dispatch.h>
+#else
+ #include <cerrno>
+ #include <ctime>
+ #include <semaphore.h>
+#endif
+
+#if JUCE_WINDOWS
+struct RealtimeSemaphore::Native
+{
+    Native() : handle (CreateSemaphoreW (nullptr, 0, LONG_MAX, nullptr)) {}
+    ~Native() { CloseHandle (handle); }
+
+    void post() noexcept { ReleaseSemaphore (handle, 1, nullptr); }
+    void wait() noexcept { WaitForSingleObject (handle, INFINITE); }
+    bool wait (int timeoutMs) noexcept { return WaitForSingleObject (handle, static_cast<DWORD> (timeoutMs)) == WAIT_OBJECT_0; }
+
+    HANDLE handle;
+};
+#elif JUCE_MAC || JUCE_IOS
+struct RealtimeSemaphore::Native
+{
+    Native() : semaphore (dispatch_semaphore_create (0)) {}
+    ~Native() { dispatch_release (semaphore); }
+
+    void post() noexcept { dispatch_semaphore_signal (semaphore); }
+    void wait() noexcept { dispatch_semaphore_wait (semaphore, DISPATCH_TIME_FOREVER); }
+
+    bool wait (int timeoutMs) noexcept
+    {
+        return dispatch_semaphore_wait (semaphore, dispatch_time (DISPATCH_TIME_NOW, static_cast<int64_t> (timeoutMs) * NSEC_PER_MSEC)) == 0;
+    }
+
+    dispatch_semaphore_t semaphore;
+};
+#else
+struct RealtimeSemaphore::Native
+{
+    Native() { sem_init (&semaphore, 0, 0); }
+    ~Native() { sem_destroy (&semaphore); }
+
+    void post() noexcept { sem_post (&semaphore); }
+
+    void wait() noexcept
+    {
+        while (sem_wait (&semaphore) != 0 && errno == EINTR)
+        {
+        }
+    }
+
+    bool wait (int timeoutMs) noexcept
+    {
+        timespec deadline {};
+        clock_gettime (CLOCK_REALTIME, &deadline);
+        const auto nanoseconds = static_cast<long long> (deadline.tv_nsec) + static_cast<long long> (timeoutMs) * 1000000;
+        deadline.tv_sec += static_cast<time_t> (nanoseconds / 1000000000);
+        deadline.tv_nsec = static_cast<long> (nanoseconds % 1000000000);
+
+        for (;;)
+        {
+            if (sem_timedwait (&semaphore, &deadline) == 0)
+                return true;
+
+            if (errno != EINTR)
+                return false;
+        }
+    }
+
+    sem_t semaphore;
+};
+#endif
+
+RealtimeSemaphore::RealtimeSemaphore() : native (std::make_unique<Native>()) {}
+RealtimeSemaphore::~RealtimeSemaphore() = default;
+
+void RealtimeSemaphore::post() noexcept { native->post(); }
+void RealtimeSemaphore::wait() noexcept { native->wait(); }
+bool RealtimeSemaphore::wait (int timeoutMs) noexcept { return native->wait (timeoutMs); }
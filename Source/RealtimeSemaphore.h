@@ -0,0 +1,24 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Counting semaphore whose post() never takes a lock, so the audio thread can wake a worker thread every block.
+// juce::WaitableEvent signals under a mutex, which the audio thread must not touch.
+class RealtimeSemaphore
+{
+public:
+    RealtimeSemaphore();
+    ~RealtimeSemaphore();
+
+    void post() noexcept;
+    void wait() noexcept;
+
+    // Returns false if timeoutMs passed without a post.
+    bool wait (int timeoutMs) noexcept;
+
+private:
+    struct Native;
+    std::unique_ptr<Native> native;
+
+    JUCE_DECLARE_NON_COPYABLE (RealtimeSemaphore)
+};
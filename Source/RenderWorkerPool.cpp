@@ -0,0 +1,167 @@
+#include "RenderWorkerPool.h"
+
+class RenderWorkerPool::Worker final : public juce::Thread
+{
+public:
+    Worker (RenderWorkerPool& ownerToUse, int participantIndex)
+        : juce::Thread ("Codex Piano render " + juce::String (participantIndex)),
+          owner (ownerToUse),
+          participant (participantIndex)
+    {
+    }
+
+    void run() override
+    {
+        auto lastWorkMs = juce::Time::getMillisecondCounter();
+
+        while (! threadShouldExit())
+        {
+            if (participant < owner.activeParticipants.load (std::memory_order_relaxed) && owner.runOneChunk (participant))
+            {
+                lastWorkMs = juce::Time::getMillisecondCounter();
+                continue;
+            }
+
+            // Stay hot between consecutive audio blocks, then back off once the stream has stopped.
+            if (juce::Time::getMillisecondCounter() - lastWorkMs < spinWindowMs)
+                std::this_thread::yield();
+            else
+                juce::Thread::sleep (1);
+        }
+    }
+
+private:
+    static constexpr juce::uint32 spinWindowMs = 50;
+
+    RenderWorkerPool& owner;
+    const int participant;
+};
+
+//==============================================================================
+RenderWorkerPool::RenderWorkerPool() = default;
+
+RenderWorkerPool::~RenderWorkerPool()
+{
+    release();
+}
+
+void RenderWorkerPool::prepare (int numWorkerThreads)
+{
+    const auto numWanted = juce::jlimit (0, maxParticipants - 1, numWorkerThreads);
+
+    if (numWanted == static_cast<int> (workers.size()))
+        return;
+
+    release();
+
+    for (int i = 0; i < numWanted; ++i)
+    {
+        auto worker = std::make_unique<Worker> (*this, i + 1);
+
+        if (! worker->startRealtimeThread (juce::Thread::RealtimeOptions{}))
+            worker->startThread (juce::Thread::Priority::highest);
+
+        workers.push_back (std::move (worker));
+    }
+
+    resetStats();
+}
+
+void RenderWorkerPool::release()
+{
+    for (auto& worker : workers)
+        worker->signalThreadShouldExit();
+
+    for (auto& worker : workers)
+        worker->stopThread (1000);
+
+    workers.clear();
+}
+
+void RenderWorkerPool::run (ChunkFunction function, void* context, int numChunks, int participantLimit) noexcept
+{
+    jassert (numChunks >= 0 && static_cast<juce::uint64> (numChunks) <= fieldMask);
+
+    if (numChunks <= 0)
+        return;
+
+    jobFunction.store (function, std::memory_order_relaxed);
+    jobContext.store (context, std::memory_order_relaxed);
+    completedChunks.store (0, std::memory_order_relaxed);
+    activeParticipants.store (juce::jlimit (1, getNumParticipants(), participantLimit), std::memory_order_relaxed);
+
+    generation = (generation + 1) & ((juce::uint64 (1) << (64 - genShift)) - 1);
+    claimState.store ((generation << genShift) | (static_cast<juce::uint64> (numChunks) << countShift), std::memory_order_release);
+
+    while (runOneChunk (0))
+    {
+    }
+
+    while (completedChunks.load (std::memory_order_acquire) < numChunks)
+        std::this_thread::yield();
+
+    batchCount.fetch_add (1, std::memory_order_relaxed);
+}
+
+bool RenderWorkerPool::runOneChunk (int participant) noexcept
+{
+    auto claim = claimState.load (std::memory_order_acquire);
+
+    for (;;)
+    {
+        const auto numChunks = (claim >> countShift) & fieldMask;
+        const auto next = claim & fieldMask;
+
+        if (next >= numChunks)
+            return false;
+
+        // The job fields are only rewritten once every chunk of the current job has been claimed,
+        // so a successful claim guarantees they still belong to this job.
+        const auto function = jobFunction.load (std::memory_order_relaxed);
+        auto* context = jobContext.load (std::memory_order_relaxed);
+
+        if (claimState.compare_exchange_weak (claim, claim + 1, std::memory_order_acq_rel, std::memory_order_acquire))
+        {
+            function (context, static_cast<int> (next), participant);
+            chunkCounts[static_cast<size_t> (participant)].fetch_add (1, std::memory_order_relaxed);
+            completedChunks.fetch_add (1, std::memory_order_release);
+            return true;
+        }
+    }
+}
+
+float RenderWorkerPool::Stats::getBalance() const noexcept
+{
+    juce::int64 total = 0, busiest = 0;
+
+    for (int i = 0; i < numParticipants; ++i)
+    {
+        total += chunksPerParticipant[static_cast<size_t> (i)];
+        busiest = juce::jmax (busiest, chunksPerParticipant[static_cast<size_t> (i)]);
+    }
+
+    if (busiest == 0)
+        return 1.0f;
+
+    return static_cast<float> (total) / (static_cast<float> (busiest) * static_cast<float> (numParticipants));
+}
+
+RenderWorkerPool::Stats RenderWorkerPool::getStats() const noexcept
+{
+    Stats stats;
+    stats.numParticipants = getNumParticipants();
+    stats.numBatches = batchCount.load (std::memory_order_relaxed);
+
+    for (size_t i = 0; i < chunkCounts.size(); ++i)
+        stats.chunksPerParticipant[i] = chunkCounts[i].load (std::memory_order_relaxed);
+
+    return stats;
+}
+
+void RenderWorkerPool::resetStats() noexcept
+{
+    for (auto& count : chunkCounts)
+        count.store (0, std::memory_order_relaxed);
+
+    batchCount.store (0, std::memory_order_relaxed);
+}
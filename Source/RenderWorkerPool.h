@@ -0,0 +1,63 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Pre-spawned real-time worker threads that help the audio thread through a batch of independent chunks.
+// Handoff is a single 64-bit atomic (job generation, chunk count, next chunk), so neither side ever locks.
+// The calling thread always works on the batch itself, so sleeping or descheduled workers only cost speed.
+class RenderWorkerPool
+{
+public:
+    using ChunkFunction = void (*) (void* context, int chunkIndex, int participant);
+
+    static constexpr int maxParticipants = 16;
+
+    RenderWorkerPool();
+    ~RenderWorkerPool();
+
+    // Message thread: (re)spawns the workers. Participant 0 is always the calling audio thread.
+    void prepare (int numWorkerThreads);
+    void release();
+
+    int getNumParticipants() const noexcept { return static_cast<int> (workers.size()) + 1; }
+
+    // Audio thread: runs numChunks chunks on up to participantLimit threads and returns when all have finished.
+    void run (ChunkFunction function, void* context, int numChunks, int participantLimit) noexcept;
+
+    // How the chunks were spread over the participants since the last reset; readable from any thread.
+    struct Stats
+    {
+        std::array<juce::int64, maxParticipants> chunksPerParticipant {};
+        juce::int64 numBatches = 0;
+        int numParticipants = 1;
+
+        // Mean share of the busiest participant's load: 1.0 when perfectly even, 1/N when one thread did it all.
+        float getBalance() const noexcept;
+    };
+
+    Stats getStats() const noexcept;
+    void resetStats() noexcept;
+
+private:
+    class Worker;
+
+    static constexpr int genShift = 40;
+    static constexpr int countShift = 20;
+    static constexpr juce::uint64 fieldMask = (1u << countShift) - 1;
+
+    bool runOneChunk (int participant) noexcept;
+
+    std::vector<std::unique_ptr<Worker>> workers;
+
+    std::atomic<juce::uint64> claimState { 0 };
+    std::atomic<int> completedChunks { 0 };
+    std::atomic<int> activeParticipants { 1 };
+    std::atomic<ChunkFunction> jobFunction { nullptr };
+    std::atomic<void*> jobContext { nullptr };
+    juce::uint64 generation = 0;
+
+    std::array<std::atomic<juce::int64>, maxParticipants> chunkCounts {};
+    std::atomic<juce::int64> batchCount { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (RenderWorkerPool)
+};
@@ -0,0 +1,514 @@
+#include "SampleStreamer.h"
+
+namespace
+{
+struct SampleName
+{
+    int rootNote = -1;
+    int layer = 0;
+};
+
+SampleName parseSampleName (const juce::String& name)
+{
+    SampleName parsed;
+    juce::StringArray tokens;
+    tokens.addTokens (name, "_- .", {});
+
+    for (const auto& token : tokens)
+    {
+        const auto isNumber = token.isNotEmpty() && token.containsOnly ("0123456789");
+
+        if (token.length() > 1 && (token[0] == 'v' || token[0] == 'V') && token.substring (1).containsOnly ("0123456789"))
+            parsed.layer = token.substring (1).getIntValue();
+        else if (parsed.rootNote < 0 && isNumber && token.getIntValue() <= 127)
+            parsed.rootNote = token.getIntValue();
+    }
+
+    return parsed;
+}
+
+// WAV and AIFF can be mapped, so streaming reads become memory copies and page faults land on the streaming thread.
+std::unique_ptr<juce::AudioFormatReader> openReader (juce::AudioFormatManager& formats, const juce::File& file)
+{
+    for (int i = 0; i < formats.getNumKnownFormats(); ++i)
+    {
+        auto* format = formats.getKnownFormat (i);
+
+        if (! format->canHandleFile (file))
+            continue;
+
+        if (std::unique_ptr<juce::MemoryMappedAudioFormatReader> mapped { format->createMemoryMappedReader (file) })
+            if (mapped->mapEntireFile())
+                return mapped;
+    }
+
+    return std::unique_ptr<juce::AudioFormatReader> (formats.createReaderFor (file));
+}
+} // namespace
+
+std::unique_ptr<SamplePool> SamplePool::loadFolder (const juce::File& folder, double preloadSeconds)
+{
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    juce::SharedResourcePointer<SharedResourceCache> sharedResources;
+
+    auto pool = std::make_unique<SamplePool>();
+    std::vector<int> layerOfSample;
+
+    for (const auto& file : folder.findChildFiles (juce::File::findFiles, false))
+    {
+        const auto name = parseSampleName (file.getFileNameWithoutExtension());
+
+        if (name.rootNote < 0)
+            continue;
+
+        auto reader = openReader (formats, file);
+
+        if (reader == nullptr || reader->lengthInSamples <= 0 || reader->sampleRate <= 0.0)
+            continue;
+
+        auto sample = std::make_unique<Sample>();
+        sample->file = file;
+        sample->rootNote = name.rootNote;
+        sample->sampleRate = reader->sampleRate;
+        sample->lengthInFrames = reader->lengthInSamples;
+
+        const auto headFrames = static_cast<int> (juce::jmin (sample->lengthInFrames,
+                                                              static_cast<juce::int64> (std::ceil (juce::jmax (0.0, preloadSeconds) * reader->sampleRate))));
+        const auto key = "sample-head/" + file.getFullPathName() + "@" + juce::String (file.getLastModificationTime().toMilliseconds())
+                       + "/" + juce::String (headFrames);
+
+        // Instances loading the same folder share the heads; each keeps its own reader for streaming.
+        sample->head = sharedResources->get<Head> (key, [&reader, headFrames]
+        {
+            auto head = std::make_unique<Head>();
+            head->audio.setSize (2, headFrames);
+            head->audio.clear();
+            reader->read (&head->audio, 0, headFrames, 0, true, true);
+            return head;
+        });
+
+        sample->reader = std::move (reader);
+
+        pool->samples.push_back (std::move (sample));
+        layerOfSample.push_back (name.layer);
+    }
+
+    if (pool->samples.empty())
+        return {};
+
+    // Layer numbers need not be contiguous; they are ranked so velocity spreads evenly over the ones present.
+    auto layerNumbers = layerOfSample;
+    std::sort (layerNumbers.begin(), layerNumbers.end());
+    layerNumbers.erase (std::unique (layerNumbers.begin(), layerNumbers.end()), layerNumbers.end());
+
+    for (auto& layer : layerOfSample)
+        layer = static_cast<int> (std::lower_bound (layerNumbers.begin(), layerNumbers.end(), layer) - layerNumbers.begin());
+
+    pool->numLayers = static_cast<int> (layerNumbers.size());
+    pool->sampleForNoteAndLayer.assign (static_cast<size_t> (128 * pool->numLayers), 0);
+
+    for (int layer = 0; layer < pool->numLayers; ++layer)
+    {
+        for (int note = 0; note < 128; ++note)
+        {
+            auto bestDistance = std::numeric_limits<int>::max();
+
+            for (size_t i = 0; i < pool->samples.size(); ++i)
+            {
+                const auto distance = std::abs (pool->samples[i]->rootNote - note);
+
+                if (layerOfSample[i] == layer && distance < bestDistance)
+                {
+                    bestDistance = distance;
+                    pool->sampleForNoteAndLayer[static_cast<size_t> (layer * 128 + note)] = static_cast<int> (i);
+                }
+            }
+        }
+    }
+
+    return pool;
+}
+
+size_t SamplePool::getPrivateMemoryBytes() const noexcept
+{
+    return sizeof (*this) + samples.size() * sizeof (Sample) + sampleForNoteAndLayer.size() * sizeof (int);
+}
+
+int SamplePool::findSample (int midiNoteNumber, float velocity) const noexcept
+{
+    const auto layer = juce::jlimit (0, numLayers - 1, static_cast<int> (velocity * static_cast<float> (numLayers)));
+    return sampleForNoteAndLayer[static_cast<size_t> (layer * 128 + juce::jlimit (0, 127, midiNoteNumber))];
+}
+
+//==============================================================================
+SampleStreamer::SampleStreamer()
+    : juce::Thread ("Codex Piano sample streamer")
+{
+}
+
+SampleStreamer::~SampleStreamer()
+{
+    release();
+}
+
+void SampleStreamer::beginPoolChange (bool willHavePool)
+{
+    stopStreaming();
+
+    // The rings are allocated once, the first time a pool arrives, and kept from then on.
+    if (willHavePool && streams.empty() && pendingStreams.empty())
+    {
+        pendingStreams.reserve (static_cast<size_t> (maxStreams));
+        candidates.reserve (static_cast<size_t> (maxStreams));
+
+        for (int i = 0; i < maxStreams; ++i)
+        {
+            auto stream = std::make_unique<Stream>();
+            stream->ring.setSize (2, ringFrames);
+            stream->window.setSize (2, windowFrames);
+            pendingStreams.push_back (std::move (stream));
+        }
+    }
+}
+
+std::unique_ptr<SamplePool> SampleStreamer::swapPool (std::unique_ptr<SamplePool> newPool) noexcept
+{
+    if (newPool != nullptr && streams.empty())
+        streams.swap (pendingStreams);
+
+    for (auto& stream : streams)
+    {
+        stream->request = 0;
+        stream->readyGeneration = 0;
+        stream->fifo.reset();
+        stream->generation = 0;
+        stream->sample = nullptr;
+        stream->servedGeneration = 0;
+        stream->servedSample = -1;
+    }
+
+    pool.swap (newPool);
+    return newPool;
+}
+
+void SampleStreamer::endPoolChange()
+{
+    if (prepared && pool != nullptr)
+        startThread (juce::Thread::Priority::high);
+}
+
+void SampleStreamer::prepare (double newSampleRate)
+{
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    prepared = true;
+
+    if (pool != nullptr && ! isThreadRunning())
+        startThread (juce::Thread::Priority::high);
+}
+
+void SampleStreamer::release()
+{
+    prepared = false;
+    stopStreaming();
+}
+
+void SampleStreamer::stopStreaming()
+{
+    // The streaming thread may be blocked on the semaphore rather than the thread's own event.
+    signalThreadShouldExit();
+    workQueued.post();
+    stopThread (2000);
+}
+
+size_t SampleStreamer::getPrivateMemoryBytes() const noexcept
+{
+    const auto perStream = sizeof (Stream) + static_cast<size_t> (2 * (ringFrames + windowFrames)) * sizeof (float);
+    return streams.size() * perStream + (pool != nullptr ? pool->getPrivateMemoryBytes() : 0);
+}
+
+bool SampleStreamer::startLane (int lane, int midiNoteNumber, float velocity) noexcept
+{
+    if (pool == nullptr || lane < 0 || lane >= static_cast<int> (streams.size()))
+        return false;
+
+    auto& stream = *streams[static_cast<size_t> (lane)];
+    const auto index = pool->findSample (midiNoteNumber, velocity);
+    auto& sample = pool->getSample (index);
+
+    stream.sample = &sample;
+    stream.position = 0.0;
+    stream.nextFrame = 0;
+    stream.windowStart = 0;
+    stream.windowFill = 0;
+
+    const auto ratio = std::pow (2.0, (midiNoteNumber - sample.rootNote) / 12.0) * sample.sampleRate / sampleRate;
+    stream.increment = juce::jlimit (1.0 / maxPitchRatio, maxPitchRatio, ratio);
+    stream.framesPerSecond.store (static_cast<float> (sampleRate * stream.increment), std::memory_order_relaxed);
+
+    ++stream.generation;
+    stream.request.store ((static_cast<juce::uint64> (stream.generation) << 32) | static_cast<juce::uint64> (index + 1),
+                          std::memory_order_release);
+
+    // Only the first note since the streaming thread last looked pays for the post.
+    if (! wakePending.exchange (true))
+        workQueued.post();
+
+    return true;
+}
+
+void SampleStreamer::stopLane (int lane) noexcept
+{
+    if (lane < 0 || lane >= static_cast<int> (streams.size()))
+        return;
+
+    auto& stream = *streams[static_cast<size_t> (lane)];
+
+    if (stream.sample == nullptr)
+        return;
+
+    stream.sample = nullptr;
+    ++stream.generation;
+    stream.request.store (static_cast<juce::uint64> (stream.generation) << 32, std::memory_order_release);
+}
+
+bool SampleStreamer::renderLane (int lane, float* left, float* right, int numSamples, float gain, float gainCoeff) noexcept
+{
+    if (lane < 0 || lane >= static_cast<int> (streams.size()))
+        return false;
+
+    auto& stream = *streams[static_cast<size_t> (lane)];
+
+    if (stream.sample == nullptr)
+        return false;
+
+    for (int done = 0; done < numSamples;)
+    {
+        const auto chunk = juce::jmin (renderChunk, numSamples - done);
+
+        if (renderChunkOf (stream, left + done, right != nullptr ? right + done : nullptr, chunk, gain, gainCoeff) < 0)
+            return false;
+
+        done += chunk;
+    }
+
+    return true;
+}
+
+int SampleStreamer::renderChunkOf (Stream& stream, float* left, float* right, int numSamples, float& gain, float gainCoeff) noexcept
+{
+    const auto lastFrame = stream.sample->lengthInFrames - 1;
+
+    if (stream.position >= static_cast<double> (lastFrame))
+        return -1;
+
+    const auto firstNeeded = static_cast<juce::int64> (stream.position);
+    const auto lastNeeded = juce::jmin (lastFrame, static_cast<juce::int64> (stream.position + (numSamples - 1) * stream.increment) + 1);
+
+    // Slide the window up to the play position, skipping source frames that fast playback jumped over.
+    const auto drop = static_cast<int> (juce::jmin (firstNeeded - stream.windowStart, static_cast<juce::int64> (stream.windowFill)));
+
+    if (drop > 0)
+    {
+        for (int ch = 0; ch < 2; ++ch)
+        {
+            auto* data = stream.window.getWritePointer (ch);
+            std::memmove (data, data + drop, static_cast<size_t> (stream.windowFill - drop) * sizeof (float));
+        }
+
+        stream.windowStart += drop;
+        stream.windowFill -= drop;
+    }
+
+    if (stream.windowFill == 0 && stream.nextFrame < firstNeeded)
+    {
+        pullFrames (stream, static_cast<int> (firstNeeded - stream.nextFrame), false);
+        stream.windowStart = stream.nextFrame;
+    }
+
+    if (stream.nextFrame <= lastNeeded && stream.nextFrame >= firstNeeded)
+        pullFrames (stream, static_cast<int> (lastNeeded + 1 - stream.nextFrame), true);
+
+    const auto* windowLeft = stream.window.getReadPointer (0);
+    const auto* windowRight = stream.window.getReadPointer (1);
+    int rendered = 0;
+
+    for (; rendered < numSamples; ++rendered)
+    {
+        if (stream.position >= static_cast<double> (lastFrame))
+            break;
+
+        const auto frame = static_cast<juce::int64> (stream.position);
+        const auto index = static_cast<int> (frame - stream.windowStart);
+
+        if (index < 0 || index + 1 >= stream.windowFill)
+        {
+            // The disk fell behind: hold the play position until the ring catches up.
+            underruns.fetch_add (1, std::memory_order_relaxed);
+            break;
+        }
+
+        const auto frac = static_cast<float> (stream.position - static_cast<double> (frame));
+        const auto l = windowLeft[index] + frac * (windowLeft[index + 1] - windowLeft[index]);
+        const auto r = windowRight[index] + frac * (windowRight[index + 1] - windowRight[index]);
+
+        if (right != nullptr)
+        {
+            left[rendered] += gain * l;
+            right[rendered] += gain * r;
+        }
+        else
+        {
+            left[rendered] += gain * 0.5f * (l + r);
+        }
+
+        gain *= gainCoeff;
+        stream.position += stream.increment;
+    }
+
+    // The envelope keeps moving through a stall, exactly as the VoiceBank lane's does.
+    for (int i = rendered; i < numSamples; ++i)
+        gain *= gainCoeff;
+
+    return stream.position >= static_cast<double> (lastFrame) ? -1 : rendered;
+}
+
+int SampleStreamer::pullFrames (Stream& stream, int numFrames, bool keep) noexcept
+{
+    auto& sample = *stream.sample;
+    const auto headFrames = static_cast<juce::int64> (sample.head->audio.getNumSamples());
+
+    if (keep)
+        numFrames = juce::jmin (numFrames, windowFrames - stream.windowFill);
+
+    int pulled = 0;
+
+    auto take = [&] (const juce::AudioBuffer<float>& source, int sourceStart, int count)
+    {
+        if (keep)
+        {
+            for (int ch = 0; ch < 2; ++ch)
+                stream.window.copyFrom (ch, stream.windowFill, source, ch, sourceStart, count);
+
+            stream.windowFill += count;
+        }
+
+        stream.nextFrame += count;
+        pulled += count;
+    };
+
+    if (stream.nextFrame < headFrames)
+        take (sample.head->audio, static_cast<int> (stream.nextFrame), static_cast<int> (juce::jmin (static_cast<juce::int64> (numFrames), headFrames - stream.nextFrame)));
+
+    if (pulled < numFrames && stream.readyGeneration.load (std::memory_order_acquire) == stream.generation)
+    {
+        const auto scope = stream.fifo.read (juce::jmin (numFrames - pulled, stream.fifo.getNumReady()));
+
+        if (scope.blockSize1 > 0)
+            take (stream.ring, scope.startIndex1, scope.blockSize1);
+
+        if (scope.blockSize2 > 0)
+            take (stream.ring, scope.startIndex2, scope.blockSize2);
+    }
+
+    return pulled;
+}
+
+void SampleStreamer::run()
+{
+    while (! threadShouldExit())
+    {
+        // Cleared before looking at the requests, so a note started during the pass posts again and the wait
+        // below returns at once. A leftover post costs one extra pass.
+        wakePending.store (false);
+
+        if (serviceStreams())
+            continue;
+
+        if (idleWaitMs < 0)
+            workQueued.wait();
+        else
+            workQueued.wait (idleWaitMs);
+    }
+}
+
+void SampleStreamer::acceptRequest (Stream& stream)
+{
+    const auto request = stream.request.load (std::memory_order_acquire);
+    const auto generation = static_cast<juce::uint32> (request >> 32);
+
+    if (generation == stream.servedGeneration)
+        return;
+
+    // The audio thread stops reading a ring as soon as it posts a new request, so it can be reset here.
+    stream.servedGeneration = generation;
+    stream.servedSample = static_cast<int> (request & 0xffffffffu) - 1;
+    stream.fifo.reset();
+
+    if (stream.servedSample >= 0)
+        stream.nextReadFrame = pool->getSample (stream.servedSample).head->audio.getNumSamples();
+
+    stream.readyGeneration.store (generation, std::memory_order_release);
+}
+
+bool SampleStreamer::serviceStreams()
+{
+    candidates.clear();
+    idleWaitMs = -1;
+
+    for (size_t i = 0; i < streams.size(); ++i)
+    {
+        auto& stream = *streams[i];
+        acceptRequest (stream);
+
+        if (stream.servedSample < 0)
+            continue;
+
+        const auto remaining = pool->getSample (stream.servedSample).lengthInFrames - stream.nextReadFrame;
+
+        if (remaining <= 0)
+            continue;
+
+        if (stream.fifo.getFreeSpace() >= juce::jmin (static_cast<juce::int64> (minReadFrames), remaining))
+        {
+            candidates.emplace_back (stream.fifo.getNumReady(), static_cast<int> (i));
+            continue;
+        }
+
+        // Full enough to skip: sleep until this ring has drained to half, then top everything up in one pass.
+        const auto framesPerSecond = juce::jmax (1.0f, stream.framesPerSecond.load (std::memory_order_relaxed));
+        const auto drainMs = juce::jmax (1, static_cast<int> (static_cast<float> (stream.fifo.getNumReady() - ringFrames / 2)
+                                                              * 1000.0f / framesPerSecond));
+        idleWaitMs = idleWaitMs < 0 ? drainMs : juce::jmin (idleWaitMs, drainMs);
+    }
+
+    if (candidates.empty())
+        return false;
+
+    // Emptiest rings first. Reads shrink as more voices stream, so every ring gets topped up on each pass
+    // instead of a few voices hogging the disk with long reads while the others starve.
+    std::sort (candidates.begin(), candidates.end());
+    const auto readFrames = juce::jlimit (minReadFrames, ringFrames / 2, ringFrames * 2 / static_cast<int> (candidates.size()));
+
+    for (const auto& candidate : candidates)
+    {
+        if (threadShouldExit())
+            break;
+
+        auto& stream = *streams[static_cast<size_t> (candidate.second)];
+        auto& sample = pool->getSample (stream.servedSample);
+        const auto count = static_cast<int> (juce::jmin (static_cast<juce::int64> (juce::jmin (readFrames, stream.fifo.getFreeSpace())),
+                                                         sample.lengthInFrames - stream.nextReadFrame));
+        const auto scope = stream.fifo.write (count);
+
+        if (scope.blockSize1 > 0)
+            sample.reader->read (&stream.ring, scope.startIndex1, scope.blockSize1, stream.nextReadFrame, true, true);
+
+        if (scope.blockSize2 > 0)
+            sample.reader->read (&stream.ring, scope.startIndex2, scope.blockSize2, stream.nextReadFrame + scope.blockSize1, true, true);
+
+        stream.nextReadFrame += count;
+    }
+
+    return true;
+}
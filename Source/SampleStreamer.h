@@ -0,0 +1,145 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "LaneSource.h"
+#include "RealtimeSemaphore.h"
+#include "SharedResourceCache.h"
+
+// A folder of multisampled notes. Only the attack head of each file is kept in memory; the rest is
+// read on demand, through a memory-mapped reader when the format supports one.
+class SamplePool
+{
+public:
+    // The preloaded start of a file, always stereo. Shared between instances through the SharedResourceCache.
+    struct Head
+    {
+        juce::AudioBuffer<float> audio;
+
+        size_t getMemoryBytes() const noexcept
+        {
+            return sizeof (*this) + static_cast<size_t> (audio.getNumChannels() * audio.getNumSamples()) * sizeof (float);
+        }
+    };
+
+    struct Sample
+    {
+        juce::File file;
+        int rootNote = 60;
+        double sampleRate = 44100.0;
+        juce::int64 lengthInFrames = 0;
+        std::shared_ptr<const Head> head;
+        std::unique_ptr<juce::AudioFormatReader> reader; // only used by the streaming thread once installed
+    };
+
+    // File names give the root note as their first number (0-127) and an optional velocity layer as "v<n>",
+    // e.g. "Piano_060_v3.wav". Layers are ordered by number, softest first. Returns null if nothing usable was found.
+    static std::unique_ptr<SamplePool> loadFolder (const juce::File& folder, double preloadSeconds);
+
+    int getNumSamples() const noexcept { return static_cast<int> (samples.size()); }
+    Sample& getSample (int index) noexcept { return *samples[static_cast<size_t> (index)]; }
+
+    // Index of the closest sample of the matching velocity layer; constant time.
+    int findSample (int midiNoteNumber, float velocity) const noexcept;
+
+    // Reader state and mapping tables owned by this pool alone (the heads are shared).
+    size_t getPrivateMemoryBytes() const noexcept;
+
+private:
+    std::vector<std::unique_ptr<Sample>> samples;
+    std::vector<int> sampleForNoteAndLayer; // 128 * numLayers
+    int numLayers = 0;
+};
+
+// Plays SamplePool samples for VoiceBank lanes. Each lane owns a lock-free ring that a background
+// thread keeps filled from disk while the lane plays the preloaded head, so the audio thread never touches a file.
+class SampleStreamer final : public LaneSource,
+                             private juce::Thread
+{
+public:
+    static constexpr int maxStreams = 256;
+
+    SampleStreamer();
+    ~SampleStreamer() override;
+
+    // Changing the pool is split so the audio callback is only locked out for the swap itself. On the message
+    // thread: beginPoolChange stops the streaming thread and allocates the stream rings, swapPool (with the callback
+    // locked out) exchanges the pools and hands back the old one, to be destroyed once the lock is released, and
+    // endPoolChange restarts the thread. Pass null to unload.
+    void beginPoolChange (bool willHavePool);
+    std::unique_ptr<SamplePool> swapPool (std::unique_ptr<SamplePool> newPool) noexcept;
+    void endPoolChange();
+    bool hasPool() const noexcept { return pool != nullptr; }
+
+    // Message thread: starts and stops the streaming thread.
+    void prepare (double newSampleRate);
+    void release();
+
+    bool startLane (int lane, int midiNoteNumber, float velocity) noexcept override;
+    void stopLane (int lane) noexcept override;
+    bool renderLane (int lane, float* left, float* right, int numSamples, float gain, float gainCoeff) noexcept override;
+
+    // Number of times a lane ran out of streamed audio and had to stall.
+    juce::int64 getNumUnderruns() const noexcept { return underruns.load (std::memory_order_relaxed); }
+
+    // Message thread: stream rings and windows plus the pool's own bookkeeping; the sample heads are shared.
+    size_t getPrivateMemoryBytes() const noexcept;
+
+private:
+    static constexpr int ringFrames = 8192;
+    static constexpr int minReadFrames = 512;
+    static constexpr int renderChunk = 256;
+    static constexpr double maxPitchRatio = 8.0;
+    static constexpr int windowFrames = static_cast<int> (renderChunk * maxPitchRatio) + 4;
+
+    struct Stream
+    {
+        // Audio thread -> streaming thread: (generation << 32) | (sample index + 1), zero index meaning idle.
+        std::atomic<juce::uint64> request { 0 };
+        // Audio thread -> streaming thread: source frames the lane consumes per second, stored before the request.
+        std::atomic<float> framesPerSecond { 44100.0f };
+        // Streaming thread -> audio thread: the generation whose data is in the ring.
+        std::atomic<juce::uint32> readyGeneration { 0 };
+
+        juce::AbstractFifo fifo { ringFrames };
+        juce::AudioBuffer<float> ring;
+
+        // Audio thread only.
+        juce::uint32 generation = 0;
+        SamplePool::Sample* sample = nullptr;
+        double position = 0.0;
+        double increment = 1.0;
+        juce::int64 nextFrame = 0;
+        juce::int64 windowStart = 0;
+        int windowFill = 0;
+        juce::AudioBuffer<float> window;
+
+        // Streaming thread only.
+        juce::uint32 servedGeneration = 0;
+        int servedSample = -1;
+        juce::int64 nextReadFrame = 0;
+    };
+
+    void run() override;
+    bool serviceStreams();
+    void stopStreaming();
+    void acceptRequest (Stream&);
+
+    int pullFrames (Stream&, int numFrames, bool keep) noexcept;
+    int renderChunkOf (Stream&, float* left, float* right, int numSamples, float& gain, float gainCoeff) noexcept;
+
+    std::unique_ptr<SamplePool> pool;
+    std::vector<std::unique_ptr<Stream>> streams;
+    std::vector<std::unique_ptr<Stream>> pendingStreams; // built by beginPoolChange, moved in by swapPool
+    std::vector<std::pair<int, int>> candidates; // (frames ready, stream), streaming thread only
+    std::atomic<juce::int64> underruns { 0 };
+
+    // startLane posts at most once per pass of the streaming thread, which otherwise sleeps until the first ring
+    // drains to half, or indefinitely while nothing streams.
+    RealtimeSemaphore workQueued;
+    std::atomic<bool> wakePending { false };
+    int idleWaitMs = -1; // streaming thread only, set by serviceStreams
+    double sampleRate = 44100.0;
+    bool prepared = false;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SampleStreamer)
+};
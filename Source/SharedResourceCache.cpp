@@ -0,0 +1,54 @@
+#include "SharedResourceCache.h"
+
+std::shared_ptr<const void> SharedResourceCache::find (const juce::String& key)
+{
+    const auto found = entries.find (key);
+
+    if (found == entries.end())
+        return nullptr;
+
+    auto resource = found->second.resource.lock();
+
+    if (resource == nullptr)
+        entries.erase (found);
+
+    return resource;
+}
+
+void SharedResourceCache::finishBuilding (const juce::String& key, std::shared_ptr<const void> resource, size_t bytes)
+{
+    {
+        const std::lock_guard<std::mutex> scopedLock (mutex);
+        building.erase (key);
+
+        if (resource != nullptr)
+            entries[key] = { resource, bytes };
+
+        // Entries whose last holder has gone are dropped here rather than tracked with custom deleters.
+        for (auto it = entries.begin(); it != entries.end();)
+            it = it->second.resource.expired() ? entries.erase (it) : std::next (it);
+    }
+
+    buildFinished.notify_all();
+}
+
+SharedResourceCache::Report SharedResourceCache::getReport() const
+{
+    const std::lock_guard<std::mutex> scopedLock (mutex);
+    Report report;
+
+    for (const auto& [key, entry] : entries)
+    {
+        const auto holders = static_cast<int> (entry.resource.use_count());
+
+        if (holders == 0)
+            continue;
+
+        report.sharedBytes += entry.bytes;
+        report.unsharedBytes += entry.bytes * static_cast<size_t> (holders);
+        report.numHolders += holders;
+        ++report.numResources;
+    }
+
+    return report;
+}
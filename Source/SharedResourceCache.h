@@ -0,0 +1,77 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+
+// Process-wide store of immutable DSP resources (wavetables, modal tables, sample heads, impulse responses), reached
+// through juce::SharedResourcePointer so every plugin instance in the host shares it. Resources are built lazily,
+// once per key even when several instances ask at the same time, and are held weakly: a resource is freed as soon
+// as the last instance drops its shared_ptr. Never call from the audio thread.
+class SharedResourceCache
+{
+public:
+    struct Report
+    {
+        size_t sharedBytes = 0;   // memory actually used by the live resources
+        size_t unsharedBytes = 0; // what it would take if every holder had its own copy
+        int numResources = 0;
+        int numHolders = 0;
+    };
+
+    SharedResourceCache() = default;
+
+    // Keys must identify the content and sample rate, prefixed with the kind of resource.
+    // build() returns a std::unique_ptr<T> (null on failure, which is not cached); T needs getMemoryBytes(). If build()
+    // throws, the exception reaches the caller and the key is free to be built again.
+    template <typename T, typename Builder>
+    std::shared_ptr<const T> get (const juce::String& key, Builder&& build)
+    {
+        {
+            std::unique_lock<std::mutex> scopedLock (mutex);
+            buildFinished.wait (scopedLock, [&] { return building.count (key) == 0; });
+
+            if (auto existing = find (key))
+                return std::static_pointer_cast<const T> (existing);
+
+            building.insert (key);
+        }
+
+        std::shared_ptr<const T> resource;
+
+        try
+        {
+            resource = build();
+        }
+        catch (...)
+        {
+            // Anyone waiting on the key would otherwise sleep forever; they get to try the build themselves instead.
+            finishBuilding (key, nullptr, 0);
+            throw;
+        }
+
+        finishBuilding (key, resource, resource != nullptr ? resource->getMemoryBytes() : 0);
+        return resource;
+    }
+
+    Report getReport() const;
+
+private:
+    struct Entry
+    {
+        std::weak_ptr<const void> resource;
+        size_t bytes = 0;
+    };
+
+    std::shared_ptr<const void> find (const juce::String& key);
+    void finishBuilding (const juce::String& key, std::shared_ptr<const void> resource, size_t bytes);
+
+    mutable std::mutex mutex;
+    std::condition_variable buildFinished;
+    std::map<juce::String, Entry> entries;
+    std::set<juce::String> building;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (SharedResourceCache)
+};
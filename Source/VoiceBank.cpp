@@ -0,0 +1,1100 @@
+#include "VoiceBank.h"
+
+VoiceBank::VoiceBank()
+{
+    setSampleRate (sampleRate);
+    setCapacity (16);
+}
+
+void VoiceBank::setCapacity (int numVoices)
+{
+    const auto numGroups = (juce::jmax (1, numVoices) + lanesPerGroup - 1) / lanesPerGroup;
+
+    groups.clear();
+    groups.resize (static_cast<size_t> (numGroups));
+    capacity = numVoices;
+    reset();
+}
+
+void VoiceBank::reset()
+{
+    for (auto& group : groups)
+    {
+        group = Group();
+
+        for (int p = 0; p < numPartials; ++p)
+        {
+            group.sinState[(size_t) p] = Vec::expand (0.0f);
+            group.cosState[(size_t) p] = Vec::expand (1.0f);
+            group.sinDelta[(size_t) p] = Vec::expand (0.0f);
+            group.cosDelta[(size_t) p] = Vec::expand (1.0f);
+            group.gain[(size_t) p] = Vec::expand (0.0f);
+            group.gainStep[(size_t) p] = Vec::expand (0.0f);
+            group.baseSinDelta[(size_t) p] = Vec::expand (0.0f);
+            group.baseCosDelta[(size_t) p] = Vec::expand (1.0f);
+            group.sinDeltaStep[(size_t) p] = Vec::expand (0.0f);
+            group.cosDeltaStep[(size_t) p] = Vec::expand (0.0f);
+            group.modGain[(size_t) p] = Vec::expand (1.0f);
+            group.modGainStep[(size_t) p] = Vec::expand (0.0f);
+        }
+
+        for (auto& source : group.modSources)
+            source = Vec::expand (0.0f);
+
+        group.bend = Vec::expand (0.0f);
+        group.modEnvCoeff = Vec::expand (0.0f);
+        group.decayScale.fill (1.0f);
+
+        group.envelope = Vec::expand (0.0f);
+        group.envCoeff = Vec::expand (0.0f);
+        group.level = Vec::expand (0.0f);
+        group.noteOnSamples = Vec::expand (attackSamples);
+        group.decayCoeff.fill (0.9995f);
+        group.releaseCoeff.fill (0.9990f);
+        group.transient.fill (hammerTables->getSilence());
+        group.transientPosition.fill (transientEnd);
+        group.sustainDepth.fill (0.0f);
+    }
+
+    // Variants follow the order of the strikes, so a render is reproducible for the same MIDI, parameters and block size.
+    strikeCount = 0;
+}
+
+void VoiceBank::setSampleRate (double newSampleRate)
+{
+    sampleRate = newSampleRate > 0.0 ? newSampleRate : 44100.0;
+    attackSamples = static_cast<float> (sampleRate * 0.008);
+    cullCoeff = static_cast<float> (std::exp (std::log (0.001) / (sampleRate * cullFadeSeconds)));
+
+    hammerTables = sharedResources->get<HammerTransientTables> ("hammer@" + juce::String (sampleRate), [this]
+    {
+        return std::make_unique<HammerTransientTables> (sampleRate);
+    });
+
+    transientEnd = hammerTables->getLength() - 1;
+    updateModulationRates();
+
+    // Lanes must not keep pointers into the tables of the previous rate.
+    for (auto& group : groups)
+    {
+        group.transient.fill (hammerTables->getSilence());
+        group.transientPosition.fill (transientEnd);
+    }
+}
+
+bool VoiceBank::isLaneActive (int lane) const noexcept
+{
+    return (groupFor (lane).activeMask & (1u << slotFor (lane))) != 0;
+}
+
+float VoiceBank::getLaneLoudness (int lane) const noexcept
+{
+    const auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+    return group.envelope.get (slot) * group.level.get (slot);
+}
+
+void VoiceBank::startLane (int lane, double frequency, float velocity, Oscillator oscillator)
+{
+    static constexpr std::array<double, numPartials> multipliers { 1.0, 2.0, 3.0, 4.0 };
+
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+    // With the level of detail on, partials above hearing are dropped as well as those above Nyquist.
+    const auto cutoff = detailFloor > 0.0f ? juce::jmin (sampleRate * 0.5, audibleLimitHz) : sampleRate * 0.5;
+
+    group.audiblePartials[slot] = 0;
+
+    for (size_t p = 0; p < multipliers.size(); ++p)
+    {
+        const auto delta = juce::MathConstants<double>::twoPi * frequency * multipliers[p] / sampleRate;
+        group.sinState[p].set (slot, 0.0f);
+        group.cosState[p].set (slot, 1.0f);
+        group.sinDelta[p].set (slot, static_cast<float> (std::sin (delta)));
+        group.cosDelta[p].set (slot, static_cast<float> (std::cos (delta)));
+        group.gainStep[p].set (slot, 0.0f);
+        group.baseSinDelta[p].set (slot, group.sinDelta[p].get (slot));
+        group.baseCosDelta[p].set (slot, group.cosDelta[p].get (slot));
+        group.sinDeltaStep[p].set (slot, 0.0f);
+        group.cosDeltaStep[p].set (slot, 0.0f);
+        group.modGain[p].set (slot, 1.0f);
+        group.modGainStep[p].set (slot, 0.0f);
+
+        if (frequency * multipliers[p] < cutoff)
+            group.audiblePartials[slot] = static_cast<int> (p) + 1;
+    }
+
+    if (oscillator == Oscillator::wavetable)
+    {
+        group.wavetableMask |= 1u << slot;
+        group.tablePhase[slot] = 0.0f;
+        group.tableDelta[slot] = static_cast<float> (frequency / sampleRate);
+        group.tableOctave[slot] = WavetableSet::octaveForFrequency (frequency);
+        group.audiblePartials[slot] = 0;
+    }
+    else
+    {
+        group.wavetableMask &= ~(1u << slot);
+    }
+
+    if (usesLaneSource (oscillator))
+        group.audiblePartials[slot] = 0;
+
+    group.sourceMask &= ~(1u << slot);
+    group.sources[slot] = nullptr;
+
+    for (size_t p = 0; p < multipliers.size(); ++p)
+        if (static_cast<int> (p) >= group.audiblePartials[slot])
+            group.gain[p].set (slot, 0.0f);
+
+    group.detailPartials[slot] = group.audiblePartials[slot];
+    group.cullMask &= ~(1u << slot);
+
+    // The note starts unmodulated, with its expression cleared until the voice manager sets it, and the group ticks
+    // at once so the lane's first targets are in place before it is heard.
+    group.baseAngle[slot] = static_cast<float> (juce::MathConstants<double>::twoPi * frequency / sampleRate);
+    group.baseTableDelta[slot] = static_cast<float> (frequency / sampleRate);
+    group.tableDeltaStep[slot] = 0.0f;
+    group.decayScale[slot] = 1.0f;
+    group.lfoPhase[slot] = 0.0f;
+    group.bend.set (slot, 0.0f);
+    group.modSources[ModulationMatrix::velocity].set (slot, juce::jlimit (0.0f, 1.0f, velocity));
+    group.modSources[ModulationMatrix::key].set (slot, static_cast<float> (juce::jlimit (-1.0, 1.0, std::log2 (frequency / 261.6256) / 4.0)));
+    group.modSources[ModulationMatrix::pressure].set (slot, 0.0f);
+    group.modSources[ModulationMatrix::timbre].set (slot, 0.0f);
+    group.modSources[ModulationMatrix::lfo].set (slot, 0.0f);
+    group.modSources[ModulationMatrix::envelope].set (slot, 1.0f);
+    group.expressionMask &= ~(1u << slot);
+    group.snapMask |= 1u << slot;
+    group.controlRemaining = 0;
+
+    group.sustainDepth[slot] = 0.0f;
+    group.level.set (slot, juce::jlimit (0.0f, 1.0f, velocity));
+    group.envelope.set (slot, 1.0f);
+    group.envCoeff.set (slot, group.decayCoeff[slot]);
+    group.noteOnSamples.set (slot, 0.0f);
+    group.transient[slot] = hammerTables->getTable (frequency, velocity, strikeCount++);
+    group.transientPosition[slot] = 0;
+    group.activeMask |= 1u << slot;
+    group.keyDownMask |= 1u << slot;
+}
+
+void VoiceBank::startSourceLane (int lane, int midiNoteNumber, float velocity, LaneSource* source)
+{
+    // Any source engine will do here: it only tells startLane that no partials sound.
+    startLane (lane, juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber), velocity, Oscillator::sampled);
+
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    // Sources make their own attack, so the synthetic attack ramp and hammer transient are skipped.
+    group.noteOnSamples.set (slot, attackSamples);
+    group.transient[slot] = hammerTables->getSilence();
+    group.transientPosition[slot] = transientEnd;
+    group.sourceMask |= 1u << slot;
+    group.sources[slot] = source;
+
+    if (source == nullptr || ! source->startLane (lane, midiNoteNumber, velocity))
+        group.envelope.set (slot, 0.0f);
+}
+
+void VoiceBank::releaseLane (int lane)
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    group.keyDownMask &= ~(1u << slot);
+
+    if ((group.cullMask & (1u << slot)) == 0)
+        group.envCoeff.set (slot, releasedCoeff (group, slot));
+}
+
+void VoiceBank::restrikeLane (int lane, double frequency, float velocity)
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+    const auto newLevel = juce::jlimit (1.0e-3f, 1.0f, velocity);
+
+    // Current amplitude, attack ramp included; a softer strike than what still rings just carries on from there.
+    const auto current = group.envelope.get (slot) * group.level.get (slot)
+                       * juce::jmin (group.noteOnSamples.get (slot) / attackSamples, 1.0f);
+    const auto ratio = current / newLevel;
+
+    group.level.set (slot, newLevel);
+    group.envelope.set (slot, juce::jmax (1.0f, ratio));
+    group.noteOnSamples.set (slot, attackSamples * juce::jmin (1.0f, ratio));
+    group.transient[slot] = hammerTables->getTable (frequency, velocity, strikeCount++);
+    group.transientPosition[slot] = 0;
+    group.detailPartials[slot] = group.audiblePartials[slot];
+    group.sustainDepth[slot] = 0.0f;
+    group.cullMask &= ~(1u << slot);
+    group.keyDownMask |= 1u << slot;
+    group.envCoeff.set (slot, group.decayCoeff[slot]);
+    group.modSources[ModulationMatrix::velocity].set (slot, newLevel);
+    group.modSources[ModulationMatrix::envelope].set (slot, 1.0f);
+}
+
+void VoiceBank::setLaneSustain (int lane, float depth)
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    group.sustainDepth[slot] = juce::jlimit (0.0f, 1.0f, depth);
+
+    if ((group.keyDownMask & (1u << slot)) == 0 && (group.cullMask & (1u << slot)) == 0)
+        group.envCoeff.set (slot, releasedCoeff (group, slot));
+}
+
+void VoiceBank::chokeLane (int lane)
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    group.cullMask |= 1u << slot;
+    group.envCoeff.set (slot, cullCoeff);
+}
+
+float VoiceBank::releasedCoeff (const Group& group, size_t slot) noexcept
+{
+    // Interpolating the decay rates (the logs of the coefficients) makes each step of the pedal an even change
+    // in release time, rather than bunching all the audible change at one end.
+    const auto depth = group.sustainDepth[slot];
+
+    if (depth <= 0.0f)
+        return group.releaseCoeff[slot];
+
+    if (depth >= 1.0f)
+        return group.decayCoeff[slot];
+
+    return std::pow (group.releaseCoeff[slot], 1.0f - depth) * std::pow (group.decayCoeff[slot], depth);
+}
+
+bool VoiceBank::isInAttack (const Group& group, size_t slot) const noexcept
+{
+    return group.noteOnSamples.get (slot) < attackSamples || group.transientPosition[slot] < transientEnd;
+}
+
+void VoiceBank::clearLane (int lane)
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    if (group.sources[slot] != nullptr)
+        group.sources[slot]->stopLane (lane);
+
+    group.envelope.set (slot, 0.0f);
+    group.noteOnSamples.set (slot, attackSamples);
+    group.transient[slot] = hammerTables->getSilence();
+    group.transientPosition[slot] = transientEnd;
+    group.activeMask &= ~(1u << slot);
+    group.keyDownMask &= ~(1u << slot);
+    group.wavetableMask &= ~(1u << slot);
+    group.sourceMask &= ~(1u << slot);
+    group.cullMask &= ~(1u << slot);
+    group.sources[slot] = nullptr;
+}
+
+void VoiceBank::setLaneParameters (int lane, const std::array<float, numPartials>& gains, float decayCoeff, float releaseCoeff)
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    // Wavetable lanes, partials above Nyquist and partials the level of detail dropped keep a zero gain so the
+    // additive kernel skips them for free. A partial still fading out stops at once, but it is below the floor.
+    for (size_t p = 0; p < gains.size(); ++p)
+    {
+        group.gain[p].set (slot, static_cast<int> (p) < group.detailPartials[slot] ? gains[p] : 0.0f);
+        group.gainStep[p].set (slot, 0.0f);
+    }
+
+    // Sources decay by themselves, so a held note keeps a flat envelope until release.
+    group.decayCoeff[slot] = (group.sourceMask & (1u << slot)) != 0 ? 1.0f : decayCoeff;
+    group.releaseCoeff[slot] = releaseCoeff;
+
+    if ((group.cullMask & (1u << slot)) == 0)
+        group.envCoeff.set (slot, (group.keyDownMask & (1u << slot)) != 0 ? group.decayCoeff[slot] : releasedCoeff (group, slot));
+}
+
+void VoiceBank::setModulation (const ModulationMatrix& newMatrix) noexcept
+{
+    modulation = newMatrix;
+    modulation.controlInterval = juce::jmax (1, modulation.controlInterval);
+    noteSourcesRouted = modulation.usesNoteSources();
+    updateModulationRates();
+}
+
+void VoiceBank::updateModulationRates() noexcept
+{
+    const auto interval = static_cast<double> (modulation.controlInterval);
+    lfoSegmentPhase = static_cast<float> (modulation.lfoHz * interval / sampleRate);
+    envelopeSegmentCoeff = static_cast<float> (std::exp (-interval / (juce::jmax (0.001f, modulation.envelopeSeconds) * sampleRate)));
+}
+
+void VoiceBank::setLaneExpression (int lane, float bendSemitones, float pressure, float timbre) noexcept
+{
+    auto& group = groupFor (lane);
+    const auto slot = slotFor (lane);
+
+    group.bend.set (slot, bendSemitones);
+    group.modSources[ModulationMatrix::pressure].set (slot, pressure);
+    group.modSources[ModulationMatrix::timbre].set (slot, timbre);
+
+    if (bendSemitones != 0.0f || pressure != 0.0f || timbre != 0.0f)
+        group.expressionMask |= 1u << slot;
+    else
+        group.expressionMask &= ~(1u << slot);
+}
+
+bool VoiceBank::needsModulation (const Group& group) const noexcept
+{
+    // Groups whose lanes all play the notes' own settings keep the plain kernels, and so does a matrix without routes
+    // until some note gets expression. A group that was ramping carries on until it has settled back.
+    return group.modulated || (group.expressionMask & group.activeMask) != 0
+        || (noteSourcesRouted && (group.activeMask & ~group.sourceMask) != 0);
+}
+
+void VoiceBank::updateModulation (Group& group) noexcept
+{
+    const auto interval = modulation.controlInterval;
+    const auto invInterval = 1.0f / static_cast<float> (interval);
+    group.controlRemaining = interval;
+
+    for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+    {
+        auto& phase = group.lfoPhase[i];
+        phase += lfoSegmentPhase;
+        phase -= std::floor (phase);
+        group.modSources[ModulationMatrix::lfo].set (i, std::sin (juce::MathConstants<float>::twoPi * phase));
+    }
+
+    group.modSources[ModulationMatrix::envelope] = group.modSources[ModulationMatrix::envelope] * Vec::expand (envelopeSegmentCoeff);
+
+    // The whole matrix is a multiply-add per route on a full group of lanes.
+    std::array<Vec, ModulationMatrix::numDestinations> targets;
+    targets.fill (Vec::expand (0.0f));
+
+    for (int r = 0; r < modulation.numRoutes; ++r)
+    {
+        const auto& route = modulation.routes[(size_t) r];
+        auto& target = targets[(size_t) route.destination];
+        target = Vec::multiplyAdd (target, Vec::expand (route.amount), group.modSources[(size_t) route.source]);
+    }
+
+    const auto semitones = group.bend + targets[ModulationMatrix::pitch] * Vec::expand (12.0f);
+    auto active = false;
+
+    for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+    {
+        const auto bit = 1u << i;
+        const auto live = (group.activeMask & bit) != 0 && (group.sourceMask & bit) == 0;
+        const auto semis = live ? semitones.get (i) : 0.0f;
+        const auto bright = live ? juce::jlimit (-1.0f, 1.0f, targets[ModulationMatrix::brightness].get (i)) : 0.0f;
+        const auto decay = live ? juce::jlimit (-1.0f, 1.0f, targets[ModulationMatrix::decay].get (i)) : 0.0f;
+        const auto snap = ! live || (group.snapMask & bit) != 0;
+
+        active = active || semis != 0.0f || bright != 0.0f || decay != 0.0f;
+
+        // Harmonic p + 1 of the bent fundamental, by the same angle-addition recurrence the oscillators run on.
+        const auto ratio = semis != 0.0f ? std::exp2 (semis / 12.0f) : 1.0f;
+        const auto angle = group.baseAngle[i] * ratio;
+        const auto sin1 = std::sin (angle);
+        const auto cos1 = std::cos (angle);
+        auto sinP = sin1;
+        auto cosP = cos1;
+
+        for (size_t p = 0; p < numPartials; ++p)
+        {
+            const auto unbent = semis == 0.0f;
+            const auto sinTarget = unbent ? group.baseSinDelta[p].get (i) : sinP;
+            const auto cosTarget = unbent ? group.baseCosDelta[p].get (i) : cosP;
+
+            // Partials bent past Nyquist are faded out rather than left to alias.
+            const auto gainTarget = static_cast<float> (p + 1) * angle >= juce::MathConstants<float>::pi
+                                        ? 0.0f
+                                        : (bright != 0.0f ? std::exp2 (bright * static_cast<float> (p)) : 1.0f);
+
+            if (snap)
+            {
+                group.sinDelta[p].set (i, sinTarget);
+                group.cosDelta[p].set (i, cosTarget);
+                group.modGain[p].set (i, gainTarget);
+                group.sinDeltaStep[p].set (i, 0.0f);
+                group.cosDeltaStep[p].set (i, 0.0f);
+                group.modGainStep[p].set (i, 0.0f);
+            }
+            else
+            {
+                group.sinDeltaStep[p].set (i, (sinTarget - group.sinDelta[p].get (i)) * invInterval);
+                group.cosDeltaStep[p].set (i, (cosTarget - group.cosDelta[p].get (i)) * invInterval);
+                group.modGainStep[p].set (i, (gainTarget - group.modGain[p].get (i)) * invInterval);
+            }
+
+            const auto nextSin = sinP * cos1 + cosP * sin1;
+            cosP = cosP * cos1 - sinP * sin1;
+            sinP = nextSin;
+        }
+
+        if ((group.wavetableMask & bit) != 0)
+        {
+            const auto tableTarget = group.baseTableDelta[i] * ratio;
+
+            if (snap)
+                group.tableDelta[i] = tableTarget;
+
+            group.tableDeltaStep[i] = snap ? 0.0f : (tableTarget - group.tableDelta[i]) * invInterval;
+            group.tableOctave[i] = WavetableSet::octaveForFrequency (static_cast<double> (tableTarget) * sampleRate);
+        }
+
+        group.decayScale[i] = decay != 0.0f ? std::exp2 (-2.0f * decay) : 1.0f;
+    }
+
+    group.snapMask = 0;
+
+    // One more ramped segment after the targets return to rest, so the lanes glide back before the plain kernels
+    // take over from exactly the notes' own deltas.
+    group.modulated = active || group.modulationActive;
+    group.modulationActive = active;
+
+    if (! group.modulated)
+    {
+        for (size_t p = 0; p < numPartials; ++p)
+        {
+            group.sinDelta[p] = group.baseSinDelta[p];
+            group.cosDelta[p] = group.baseCosDelta[p];
+            group.modGain[p] = Vec::expand (1.0f);
+        }
+
+        for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+        {
+            group.tableDelta[i] = group.baseTableDelta[i];
+            group.tableDeltaStep[i] = 0.0f;
+        }
+    }
+}
+
+void VoiceBank::updateModulatedDecay (Group& group) noexcept
+{
+    // The envelope coefficient changes with key-up, the pedal and culls, so the scaled one follows it for every run.
+    for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+    {
+        const auto coeff = group.envCoeff.get (i);
+        const auto scale = group.decayScale[i];
+        const auto culled = (group.cullMask & (1u << i)) != 0;
+        group.modEnvCoeff.set (i, scale == 1.0f || culled ? coeff : std::pow (coeff, scale));
+    }
+}
+
+void VoiceBank::renderGroup (int groupIndex, float* left, float* right, int numSamples)
+{
+    auto& group = groups[static_cast<size_t> (groupIndex)];
+    updateLevelOfDetail (group);
+
+    if (group.sourceMask != 0)
+        renderSourceLanes (group, groupIndex * lanesPerGroup, left, right, numSamples);
+
+    renderGroupState (group, left, right, numSamples);
+}
+
+void VoiceBank::renderSourceLanes (Group& group, int firstLane, float* left, float* right, int numSamples)
+{
+    // Sources get the same per-sample envelope the kernel is about to apply. Their partial gains are zero,
+    // so the kernel only advances their envelopes; a lane whose source ended is zeroed and collected afterwards.
+    for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+    {
+        if ((group.sourceMask & (1u << i)) == 0)
+            continue;
+
+        auto* source = group.sources[i];
+        const auto gain = group.envelope.get (i) * group.level.get (i);
+
+        if (source == nullptr || ! source->renderLane (firstLane + static_cast<int> (i), left, right, numSamples, gain, group.envCoeff.get (i)))
+            group.envelope.set (i, 0.0f);
+    }
+}
+
+void VoiceBank::updateLevelOfDetail (Group& group) noexcept
+{
+    // A finished fade leaves its partials at exactly zero.
+    if (group.fadeRemaining == 0)
+    {
+        for (size_t p = 0; p < numPartials; ++p)
+        {
+            for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+            {
+                if (group.gainStep[p].get (i) != 0.0f)
+                {
+                    group.gain[p].set (i, 0.0f);
+                    group.gainStep[p].set (i, 0.0f);
+                }
+            }
+        }
+    }
+
+    auto startFade = false;
+    group.decimated = detailFloor > 0.0f && group.wavetableMask == 0 && group.fadeRemaining == 0;
+
+    for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup) && detailFloor > 0.0f; ++i)
+    {
+        const auto bit = 1u << i;
+
+        if ((group.activeMask & bit) == 0)
+            continue;
+
+        // Attack ramps and hammer transients are per-sample detail, so nothing is simplified until they are over.
+        if (isInAttack (group, i))
+        {
+            group.decimated = false;
+            continue;
+        }
+
+        const auto loudness = group.envelope.get (i) * group.level.get (i);
+
+        if (loudness < detailFloor && (group.cullMask & bit) == 0)
+        {
+            group.cullMask |= bit;
+            group.envCoeff.set (i, cullCoeff);
+        }
+
+        // Higher partials are quieter, so they go first, one per lane and fade; the fundamental stays until the cull.
+        const auto top = static_cast<size_t> (juce::jmax (0, group.detailPartials[i] - 1));
+
+        if (group.fadeRemaining == 0 && top > 0 && loudness * std::abs (group.gain[top].get (i)) < detailFloor)
+        {
+            group.gainStep[top].set (i, group.gain[top].get (i) / static_cast<float> (partialFadeSamples));
+            group.detailPartials[i] = static_cast<int> (top);
+            startFade = true;
+        }
+
+        // Linear interpolation between every other sample misses a sinusoid by at most its amplitude times (1 - cos w).
+        auto interpolationError = 0.0f;
+
+        for (size_t p = 0; p < numPartials; ++p)
+            interpolationError += std::abs (group.gain[p].get (i)) * (1.0f - group.cosDelta[p].get (i));
+
+        if (loudness * interpolationError >= detailFloor)
+            group.decimated = false;
+    }
+
+    if (startFade)
+    {
+        group.fadeRemaining = partialFadeSamples;
+        group.decimated = false;
+    }
+
+    // Idle lanes keep their last gains but are silent, so only active ones count. A partial skipped here keeps its
+    // phase frozen, which is fine as it is either restarted by startLane or comes back at an arbitrary phase anyway.
+    group.numLivePartials = 0;
+
+    for (int p = numPartials; --p >= 0 && group.numLivePartials == 0;)
+        for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+            if ((group.activeMask & (1u << i)) != 0 && group.gain[(size_t) p].get (i) != 0.0f)
+                group.numLivePartials = p + 1;
+}
+
+void VoiceBank::renderGroupState (Group& group, float* left, float* right, int numSamples)
+{
+    // One Newton step back onto the unit circle keeps the rotation oscillators from drifting.
+    const auto half = Vec::expand (0.5f);
+    const auto threeHalves = Vec::expand (1.5f);
+    const auto numLive = static_cast<size_t> (group.numLivePartials);
+
+    for (size_t p = 0; p < numLive; ++p)
+    {
+        const auto magnitude = group.sinState[p] * group.sinState[p] + group.cosState[p] * group.cosState[p];
+        const auto norm = threeHalves - half * magnitude;
+        group.sinState[p] = group.sinState[p] * norm;
+        group.cosState[p] = group.cosState[p] * norm;
+    }
+
+    const auto stereo = right != nullptr;
+    const auto modulating = needsModulation (group);
+
+    // Segments restart with the next tick whenever a group stops being modulated.
+    if (! modulating)
+        group.controlRemaining = 0;
+
+    if (group.decimated && ! modulating)
+    {
+        if (referenceRendering)
+            renderGroupDecimatedReference (group, left, right, numSamples);
+        else
+            (this->*selectDecimatedKernel (stereo, group.numLivePartials)) (group, left, right, numSamples);
+
+        return;
+    }
+
+    // The attack phase lasts while any lane still ramps up or plays its hammer transient; idle lanes sit past both.
+    float attackRemaining = 0.0f;
+
+    for (size_t i = 0; i < static_cast<size_t> (lanesPerGroup); ++i)
+        if ((group.activeMask & (1u << i)) != 0)
+            attackRemaining = juce::jmax (attackRemaining, attackSamples - group.noteOnSamples.get (i),
+                                          static_cast<float> (transientEnd - group.transientPosition[i]));
+
+    const auto attackRun = juce::jlimit (0, numSamples, static_cast<int> (std::ceil (attackRemaining)));
+    const auto fadeRun = juce::jmin (numSamples, group.fadeRemaining);
+    const auto withWavetables = group.wavetableMask != 0 && wavetables != nullptr;
+
+    // The block is split where the attack and any partial fade end, and at control ticks while modulating; each run
+    // gets the kernel built for exactly that combination, so the steady-state loop has no per-sample branches.
+    for (int done = 0; done < numSamples;)
+    {
+        if (modulating && group.controlRemaining == 0)
+            updateModulation (group);
+
+        if (group.modulated)
+            updateModulatedDecay (group);
+
+        const auto inAttack = done < attackRun;
+        const auto inFade = done < fadeRun;
+        auto end = juce::jmin (numSamples, inAttack ? attackRun : numSamples, inFade ? fadeRun : numSamples);
+
+        if (modulating)
+        {
+            end = juce::jmin (end, done + group.controlRemaining);
+            group.controlRemaining -= end - done;
+        }
+
+        if (referenceRendering)
+        {
+            renderGroupReference (group, left + done, stereo ? right + done : nullptr, end - done,
+                                  inAttack, inFade, withWavetables, group.modulated);
+        }
+        else
+        {
+            const auto kernel = selectKernel (stereo, group.numLivePartials, inAttack, inFade, withWavetables, group.modulated);
+            (this->*kernel) (group, left + done, stereo ? right + done : nullptr, end - done);
+        }
+
+        done = end;
+    }
+
+    group.fadeRemaining -= fadeRun;
+}
+
+template <int numChannels, int numLive, size_t... flags>
+constexpr auto VoiceBank::makeFlagKernels (std::index_sequence<flags...>) noexcept
+{
+    // Indexed by (modulated << 3) | (attack << 2) | (fades << 1) | wavetables.
+    return std::array<Kernel, sizeof... (flags)> {
+        &VoiceBank::renderGroupSamples<numChannels, numLive, (flags & 4) != 0, (flags & 2) != 0, (flags & 1) != 0, (flags & 8) != 0>... };
+}
+
+template <int numChannels, size_t... partialCounts>
+constexpr auto VoiceBank::makeKernelTable (std::index_sequence<partialCounts...>) noexcept
+{
+    // Indexed by partial count, then by the flags above.
+    return std::array<std::array<Kernel, 16>, sizeof... (partialCounts)> { {
+        makeFlagKernels<numChannels, static_cast<int> (partialCounts)> (std::make_index_sequence<16>())... } };
+}
+
+VoiceBank::Kernel VoiceBank::selectKernel (bool stereo, int numLive, bool attack, bool withFades, bool withWavetables,
+                                           bool modulated) noexcept
+{
+    static constexpr auto monoKernels = makeKernelTable<1> (std::make_index_sequence<numPartials + 1>());
+    static constexpr auto stereoKernels = makeKernelTable<2> (std::make_index_sequence<numPartials + 1>());
+
+    const auto& kernels = (stereo ? stereoKernels : monoKernels)[static_cast<size_t> (juce::jlimit (0, numPartials, numLive))];
+    return kernels[(modulated ? 8u : 0u) | (attack ? 4u : 0u) | (withFades ? 2u : 0u) | (withWavetables ? 1u : 0u)];
+}
+
+template <int numChannels, size_t... partialCounts>
+constexpr auto VoiceBank::makeDecimatedKernelTable (std::index_sequence<partialCounts...>) noexcept
+{
+    return std::array<Kernel, sizeof... (partialCounts)> { &VoiceBank::renderGroupDecimated<numChannels, static_cast<int> (partialCounts)>... };
+}
+
+VoiceBank::Kernel VoiceBank::selectDecimatedKernel (bool stereo, int numLive) noexcept
+{
+    static constexpr auto monoKernels = makeDecimatedKernelTable<1> (std::make_index_sequence<numPartials + 1>());
+    static constexpr auto stereoKernels = makeDecimatedKernelTable<2> (std::make_index_sequence<numPartials + 1>());
+
+    return (stereo ? stereoKernels : monoKernels)[static_cast<size_t> (juce::jlimit (0, numPartials, numLive))];
+}
+
+template <int numChannels, int numLive>
+void VoiceBank::renderGroupDecimated (Group& group, float* left, float* right, int numSamples)
+{
+    // Every lane is past its attack, so the output is just partials times envelope and level. The oscillators and
+    // envelopes step two samples at a time exactly, so switching between this and the full-rate kernel is seamless;
+    // only the odd samples are interpolated.
+    std::array<Vec, numPartials> sinDelta2, cosDelta2;
+
+    for (size_t p = 0; p < static_cast<size_t> (numLive); ++p)
+    {
+        sinDelta2[p] = Vec::expand (2.0f) * group.sinDelta[p] * group.cosDelta[p];
+        cosDelta2[p] = group.cosDelta[p] * group.cosDelta[p] - group.sinDelta[p] * group.sinDelta[p];
+    }
+
+    const auto envCoeff2 = group.envCoeff * group.envCoeff;
+    auto sinState = group.sinState;
+    auto cosState = group.cosState;
+    auto envelope = group.envelope;
+
+    auto output = [&]
+    {
+        auto sum = Vec::expand (0.0f);
+
+        for (size_t p = 0; p < static_cast<size_t> (numLive); ++p)
+            sum = Vec::multiplyAdd (sum, group.gain[p], sinState[p]);
+
+        return (sum * envelope * group.level).sum();
+    };
+
+    auto previous = output();
+    const auto numPairs = numSamples / 2;
+
+    for (int n = 0; n < numPairs; ++n)
+    {
+        for (size_t p = 0; p < static_cast<size_t> (numLive); ++p)
+        {
+            const auto sPrev = sinState[p];
+            sinState[p] = sPrev * cosDelta2[p] + cosState[p] * sinDelta2[p];
+            cosState[p] = cosState[p] * cosDelta2[p] - sPrev * sinDelta2[p];
+        }
+
+        envelope = envelope * envCoeff2;
+        const auto next = output();
+        const auto between = 0.5f * (previous + next);
+
+        left[2 * n] += previous;
+        left[2 * n + 1] += between;
+
+        if constexpr (numChannels > 1)
+        {
+            right[2 * n] += previous;
+            right[2 * n + 1] += between;
+        }
+
+        previous = next;
+    }
+
+    group.sinState = sinState;
+    group.cosState = cosState;
+    group.envelope = envelope;
+    group.noteOnSamples = group.noteOnSamples + Vec::expand (static_cast<float> (2 * numPairs));
+
+    if (numSamples % 2 != 0)
+        renderGroupSamples<numChannels, numLive, false, false, false, false> (group, left + numSamples - 1,
+                                                                       numChannels > 1 ? right + numSamples - 1 : nullptr, 1);
+}
+
+template <bool modulated>
+void VoiceBank::addWavetableSamples (Group& group, Vec& sum)
+{
+    // One table read per lane and sample, whatever the number of partials baked into the table.
+    for (size_t lane = 0; lane < static_cast<size_t> (lanesPerGroup); ++lane)
+    {
+        if ((group.wavetableMask & (1u << lane)) == 0)
+            continue;
+
+        auto& phase = group.tablePhase[lane];
+        sum.set (lane, sum.get (lane) + WavetableSet::lookup (wavetables->getTable (group.tableOctave[lane]), phase));
+        phase += group.tableDelta[lane];
+
+        if (phase >= 1.0f)
+            phase -= 1.0f;
+
+        if constexpr (modulated)
+            group.tableDelta[lane] += group.tableDeltaStep[lane];
+    }
+}
+
+template <int numChannels, int numLive, bool attack, bool withFades, bool withWavetables, bool modulated>
+void VoiceBank::renderGroupSamples (Group& group, float* left, float* right, int numSamples)
+{
+    const auto one = Vec::expand (1.0f);
+    const auto invAttack = Vec::expand (1.0f / attackSamples);
+    const auto envCoeff = modulated ? group.modEnvCoeff : group.envCoeff;
+
+    auto sinState = group.sinState;
+    auto cosState = group.cosState;
+    auto sinDelta = group.sinDelta;
+    auto cosDelta = group.cosDelta;
+    auto modGain = group.modGain;
+    auto envelope = group.envelope;
+    auto noteOnSamples = group.noteOnSamples;
+    auto gain = group.gain;
+    auto transientPosition = group.transientPosition;
+
+    for (int i = 0; i < numSamples; ++i)
+    {
+        auto sum = Vec::expand (0.0f);
+
+        for (size_t p = 0; p < static_cast<size_t> (numLive); ++p)
+        {
+            if constexpr (modulated)
+                sum = Vec::multiplyAdd (sum, gain[p] * modGain[p], sinState[p]);
+            else
+                sum = Vec::multiplyAdd (sum, gain[p], sinState[p]);
+
+            if constexpr (withFades)
+                gain[p] = gain[p] - group.gainStep[p];
+
+            const auto sPrev = sinState[p];
+            sinState[p] = sPrev * cosDelta[p] + cosState[p] * sinDelta[p];
+            cosState[p] = cosState[p] * cosDelta[p] - sPrev * sinDelta[p];
+
+            // Pitch and brightness glide to the segment's targets one step per sample.
+            if constexpr (modulated)
+            {
+                sinDelta[p] += group.sinDeltaStep[p];
+                cosDelta[p] += group.cosDeltaStep[p];
+                modGain[p] += group.modGainStep[p];
+            }
+        }
+
+        if constexpr (withWavetables)
+            addWavetableSamples<modulated> (group, sum);
+
+        auto out = 0.0f;
+
+        if constexpr (attack)
+        {
+            // One read per lane with no branches: lanes without a strike read silence, and finished ones park on
+            // the table's final zero.
+            alignas (sizeof (Vec)) std::array<float, lanesPerGroup> strike;
+
+            for (size_t lane = 0; lane < static_cast<size_t> (lanesPerGroup); ++lane)
+            {
+                strike[lane] = group.transient[lane][transientPosition[lane]];
+                transientPosition[lane] = juce::jmin (transientPosition[lane] + 1, transientEnd);
+            }
+
+            sum += Vec::fromRawArray (strike.data());
+            const auto attackEnv = Vec::min (noteOnSamples * invAttack, one);
+            out = (sum * envelope * attackEnv * group.level).sum();
+            noteOnSamples = noteOnSamples + one;
+        }
+        else
+        {
+            out = (sum * envelope * group.level).sum();
+        }
+
+        envelope = envelope * envCoeff;
+
+        left[i] += out;
+
+        if constexpr (numChannels > 1)
+            right[i] += out;
+    }
+
+    // Past the attack the sample count only has to stay ahead of the attack windows, so it is advanced once.
+    if constexpr (! attack)
+        noteOnSamples = noteOnSamples + Vec::expand (static_cast<float> (numSamples));
+
+    group.sinState = sinState;
+    group.cosState = cosState;
+    group.envelope = envelope;
+    group.noteOnSamples = noteOnSamples;
+
+    if constexpr (attack)
+        group.transientPosition = transientPosition;
+
+    if constexpr (withFades)
+        group.gain = gain;
+
+    if constexpr (modulated)
+    {
+        group.sinDelta = sinDelta;
+        group.cosDelta = cosDelta;
+        group.modGain = modGain;
+    }
+}
+
+void VoiceBank::renderGroupReference (Group& group, float* left, float* right, int numSamples,
+                                      bool attack, bool withFades, bool withWavetables, bool modulated)
+{
+    // The same run as renderGroupSamples, one lane at a time in plain floats: the state of every lane comes out
+    // identical, and the output differs only in the order the lanes are summed.
+    const auto numLive = static_cast<size_t> (group.numLivePartials);
+    const auto invAttack = 1.0f / attackSamples;
+
+    for (size_t lane = 0; lane < static_cast<size_t> (lanesPerGroup); ++lane)
+    {
+        if ((group.activeMask & (1u << lane)) == 0)
+            continue;
+
+        std::array<float, numPartials> s {}, c {}, sd {}, cd {}, gain {}, modGain {};
+
+        for (size_t p = 0; p < numLive; ++p)
+        {
+            s[p] = group.sinState[p].get (lane);
+            c[p] = group.cosState[p].get (lane);
+            sd[p] = group.sinDelta[p].get (lane);
+            cd[p] = group.cosDelta[p].get (lane);
+            gain[p] = group.gain[p].get (lane);
+            modGain[p] = group.modGain[p].get (lane);
+        }
+
+        auto envelope = group.envelope.get (lane);
+        auto noteOnSamples = group.noteOnSamples.get (lane);
+        const auto envCoeff = (modulated ? group.modEnvCoeff : group.envCoeff).get (lane);
+        const auto level = group.level.get (lane);
+        const auto* table = withWavetables && (group.wavetableMask & (1u << lane)) != 0
+                                ? wavetables->getTable (group.tableOctave[lane]) : nullptr;
+        auto& tablePhase = group.tablePhase[lane];
+        auto& tableDelta = group.tableDelta[lane];
+        auto& transientPosition = group.transientPosition[lane];
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            auto sum = 0.0f;
+
+            for (size_t p = 0; p < numLive; ++p)
+            {
+                sum += (modulated ? gain[p] * modGain[p] : gain[p]) * s[p];
+
+                if (withFades)
+                    gain[p] -= group.gainStep[p].get (lane);
+
+                const auto sPrev = s[p];
+                s[p] = sPrev * cd[p] + c[p] * sd[p];
+                c[p] = c[p] * cd[p] - sPrev * sd[p];
+
+                if (modulated)
+                {
+                    sd[p] += group.sinDeltaStep[p].get (lane);
+                    cd[p] += group.cosDeltaStep[p].get (lane);
+                    modGain[p] += group.modGainStep[p].get (lane);
+                }
+            }
+
+            if (table != nullptr)
+            {
+                sum += WavetableSet::lookup (table, tablePhase);
+                tablePhase += tableDelta;
+
+                if (tablePhase >= 1.0f)
+                    tablePhase -= 1.0f;
+
+                if (modulated)
+                    tableDelta += group.tableDeltaStep[lane];
+            }
+
+            auto out = 0.0f;
+
+            if (attack)
+            {
+                sum += group.transient[lane][transientPosition];
+                transientPosition = juce::jmin (transientPosition + 1, transientEnd);
+                out = sum * envelope * juce::jmin (noteOnSamples * invAttack, 1.0f) * level;
+                noteOnSamples += 1.0f;
+            }
+            else
+            {
+                out = sum * envelope * level;
+            }
+
+            envelope *= envCoeff;
+
+            left[i] += out;
+
+            if (right != nullptr)
+                right[i] += out;
+        }
+
+        if (! attack)
+            noteOnSamples += static_cast<float> (numSamples);
+
+        for (size_t p = 0; p < numLive; ++p)
+        {
+            group.sinState[p].set (lane, s[p]);
+            group.cosState[p].set (lane, c[p]);
+
+            if (withFades)
+                group.gain[p].set (lane, gain[p]);
+
+            if (modulated)
+            {
+                group.sinDelta[p].set (lane, sd[p]);
+                group.cosDelta[p].set (lane, cd[p]);
+                group.modGain[p].set (lane, modGain[p]);
+            }
+        }
+
+        group.envelope.set (lane, envelope);
+        group.noteOnSamples.set (lane, noteOnSamples);
+    }
+}
+
+void VoiceBank::renderGroupDecimatedReference (Group& group, float* left, float* right, int numSamples)
+{
+    // Interpolating each lane and summing equals interpolating the sum, so this matches renderGroupDecimated
+    // to rounding as well.
+    const auto numLive = static_cast<size_t> (group.numLivePartials);
+    const auto numPairs = numSamples / 2;
+
+    for (size_t lane = 0; lane < static_cast<size_t> (lanesPerGroup); ++lane)
+    {
+        if ((group.activeMask & (1u << lane)) == 0)
+            continue;
+
+        std::array<float, numPartials> s {}, c {}, sd2 {}, cd2 {};
+
+        for (size_t p = 0; p < numLive; ++p)
+        {
+            const auto sd = group.sinDelta[p].get (lane);
+            const auto cd = group.cosDelta[p].get (lane);
+            s[p] = group.sinState[p].get (lane);
+            c[p] = group.cosState[p].get (lane);
+            sd2[p] = 2.0f * sd * cd;
+            cd2[p] = cd * cd - sd * sd;
+        }
+
+        const auto envCoeff = group.envCoeff.get (lane);
+        const auto envCoeff2 = envCoeff * envCoeff;
+        const auto level = group.level.get (lane);
+        auto envelope = group.envelope.get (lane);
+
+        auto output = [&]
+        {
+            auto sum = 0.0f;
+
+            for (size_t p = 0; p < numLive; ++p)
+                sum += group.gain[p].get (lane) * s[p];
+
+            return sum * envelope * level;
+        };
+
+        auto previous = output();
+
+        for (int n = 0; n < numPairs; ++n)
+        {
+            for (size_t p = 0; p < numLive; ++p)
+            {
+                const auto sPrev = s[p];
+                s[p] = sPrev * cd2[p] + c[p] * sd2[p];
+                c[p] = c[p] * cd2[p] - sPrev * sd2[p];
+            }
+
+            envelope *= envCoeff2;
+            const auto next = output();
+            const auto between = 0.5f * (previous + next);
+
+            left[2 * n] += previous;
+            left[2 * n + 1] += between;
+
+            if (right != nullptr)
+            {
+                right[2 * n] += previous;
+                right[2 * n + 1] += between;
+            }
+
+            previous = next;
+        }
+
+        for (size_t p = 0; p < numLive; ++p)
+        {
+            group.sinState[p].set (lane, s[p]);
+            group.cosState[p].set (lane, c[p]);
+        }
+
+        group.envelope.set (lane, envelope);
+        group.noteOnSamples.set (lane, group.noteOnSamples.get (lane) + static_cast<float> (2 * numPairs));
+    }
+
+    if (numSamples % 2 != 0)
+        renderGroupReference (group, left + numSamples - 1, right != nullptr ? right + numSamples - 1 : nullptr, 1,
+                              false, false, false, false);
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "HammerTransient.h"
+#include "LaneSource.h"
+#include "ModulationMatrix.h"
+#include "SharedResourceCache.h"
+#include "Wavetable.h"
+
+// Oscillator and envelope state for every PianoVoice, stored as groups of SIMD-width lanes
+// (one lane per voice) so the render kernel can advance several voices per instruction.
+class VoiceBank
+{
+public:
+    using Vec = juce::dsp::SIMDRegister<float>;
+
+    static constexpr int numPartials = 4;
+    static constexpr int lanesPerGroup = static_cast<int> (Vec::SIMDNumElements);
+
+    enum class Oscillator
+    {
+        additive,
+        wavetable,
+        sampled,
+        modal
+    };
+
+    static constexpr int numOscillators = 4;
+
+    // Engines that are rendered by a LaneSource rather than the oscillator kernel.
+    static constexpr bool usesLaneSource (Oscillator oscillator) noexcept
+    {
+        return oscillator == Oscillator::sampled || oscillator == Oscillator::modal;
+    }
+
+    VoiceBank();
+
+    void setCapacity (int numVoices);
+
+    // Silences every lane and returns all state to what setCapacity leaves, without reallocating.
+    void reset();
+    int getCapacity() const noexcept { return capacity; }
+    size_t getMemoryBytes() const noexcept { return groups.capacity() * sizeof (Group); }
+
+    // Message thread: also fetches the hammer transient tables for this rate, so every lane must be idle.
+    void setSampleRate (double newSampleRate);
+
+    // Level of detail, as a linear output level (0 turns it off). Partials whose contribution
+    // falls below the floor fade out, groups whose voices are quiet enough for linear interpolation to stay below it
+    // render at half rate, and voices that fall below it fade out quickly and are freed.
+    void setDetailFloor (float newFloor) noexcept { detailFloor = juce::jmax (0.0f, newFloor); }
+    float getDetailFloor() const noexcept { return detailFloor; }
+
+    void startLane (int lane, double frequency, float velocity, Oscillator oscillator);
+
+    // Hands the lane to a LaneSource instead of the oscillators; the lane ends when the source does.
+    // A null source gives a lane that finishes straight away.
+    void startSourceLane (int lane, int midiNoteNumber, float velocity, LaneSource* source);
+    void releaseLane (int lane);
+    void clearLane (int lane);
+
+    // Strikes a sounding oscillator lane again, keeping its phases so the string carries on rather than restarting.
+    // The level ramps from where it is to the new velocity over the attack, with a fresh hammer transient.
+    void restrikeLane (int lane, double frequency, float velocity);
+
+    // Damper position for a released lane: 0 damps it with the release time, 1 lets it ring as if the key were held,
+    // and anything between is a half pedal. Has no effect while the key is down.
+    void setLaneSustain (int lane, float depth);
+
+    // Fades a lane out within a few milliseconds, e.g. to make room for a re-struck key.
+    void chokeLane (int lane);
+    bool isLaneActive (int lane) const noexcept;
+    float getLaneLoudness (int lane) const noexcept;
+
+    void setLaneParameters (int lane, const std::array<float, numPartials>& gains, float decayCoeff, float releaseCoeff);
+
+    // Per-voice modulation of the oscillator engines. Each group evaluates the routes once per control interval and
+    // the kernels ramp pitch and partial gains linearly to the results, so a route costs a multiply-add per group and
+    // tick rather than anything per sample. Groups with nothing to modulate keep the plain kernels.
+    void setModulation (const ModulationMatrix& newMatrix) noexcept;
+
+    // Note expression: bend in semitones, pressure 0 to 1, timbre -1 to 1. Reaches the lane at its group's next
+    // control tick; a lane that has just started jumps straight there rather than gliding from its unbent pitch.
+    void setLaneExpression (int lane, float bendSemitones, float pressure, float timbre) noexcept;
+
+    // Tables used by wavetable lanes for the next render call; lanes render silence while this is null.
+    void setWavetables (const WavetableSet* tablesToUse) noexcept { wavetables = tablesToUse; }
+
+    // Swaps the SIMD kernels for scalar reference kernels that advance each lane on its own in plain float
+    // arithmetic. Level of detail and modulation decisions are shared, so the two differ only by rounding;
+    // CodexPianoRealtimeCheck --reference holds them to that.
+    void setReferenceRendering (bool shouldUseReference) noexcept { referenceRendering = shouldUseReference; }
+    bool isReferenceRendering() const noexcept { return referenceRendering; }
+
+    // Renders every active lane. onLaneFinished (lane) is called for lanes that died.
+    template <typename LaneFinishedCallback>
+    void renderAll (float* left, float* right, int numSamples, LaneFinishedCallback&& onLaneFinished)
+    {
+        for (int g = 0; g < getNumGroups(); ++g)
+            if (isGroupActive (g))
+                renderGroup (g, left, right, numSamples);
+
+        collectFinishedLanes (onLaneFinished);
+    }
+
+    // Groups never share state, so different groups may be rendered concurrently into different buffers.
+    int getNumGroups() const noexcept { return static_cast<int> (groups.size()); }
+    bool isGroupActive (int groupIndex) const noexcept { return groups[static_cast<size_t> (groupIndex)].activeMask != 0; }
+    void renderGroup (int groupIndex, float* left, float* right, int numSamples);
+
+    // Must run on the thread that owns the voices, after every group of the block has been rendered.
+    template <typename LaneFinishedCallback>
+    void collectFinishedLanes (LaneFinishedCallback&& onLaneFinished)
+    {
+        for (size_t g = 0; g < groups.size(); ++g)
+        {
+            if (groups[g].activeMask == 0)
+                continue;
+
+            for (int i = 0; i < lanesPerGroup; ++i)
+            {
+                const auto lane = static_cast<int> (g) * lanesPerGroup + i;
+
+                if (isLaneActive (lane) && groups[g].envelope.get (static_cast<size_t> (i)) < silenceThreshold)
+                {
+                    clearLane (lane);
+                    onLaneFinished (lane);
+                }
+            }
+        }
+    }
+
+private:
+    struct Group
+    {
+        std::array<Vec, numPartials> sinState, cosState, sinDelta, cosDelta, gain;
+        Vec envelope, envCoeff, level, noteOnSamples;
+        std::array<float, lanesPerGroup> decayCoeff {}, releaseCoeff {}, sustainDepth {};
+        std::array<float, lanesPerGroup> tablePhase {}, tableDelta {};
+        std::array<int, lanesPerGroup> tableOctave {};
+        std::array<int, lanesPerGroup> audiblePartials {};
+        std::array<Vec, numPartials> gainStep;           // subtracted every sample while dropped partials fade out
+        std::array<int, lanesPerGroup> detailPartials {}; // audible partials the level of detail still keeps
+        int fadeRemaining = 0;
+        int numLivePartials = 0; // partials any lane still renders, so the kernel skips the rest
+        bool decimated = false;
+        uint32_t cullMask = 0;
+        std::array<const float*, lanesPerGroup> transient {}; // hammer table, or silence for lanes past their strike
+        std::array<int, lanesPerGroup> transientPosition {}; // parked on transientEnd once the strike is over
+        uint32_t activeMask = 0;
+        uint32_t keyDownMask = 0;
+        uint32_t wavetableMask = 0;
+        uint32_t sourceMask = 0;
+        std::array<LaneSource*, lanesPerGroup> sources {};
+
+        // Modulation. The base deltas are the notes' unbent pitch; the steps ramp the live deltas, the partial gain
+        // multipliers and the table deltas to the targets of the current control segment.
+        std::array<Vec, numPartials> baseSinDelta, baseCosDelta, sinDeltaStep, cosDeltaStep, modGain, modGainStep;
+        std::array<Vec, ModulationMatrix::numSources> modSources;
+        Vec bend, modEnvCoeff;
+        std::array<float, lanesPerGroup> baseAngle {}, baseTableDelta {}, tableDeltaStep {}, decayScale {}, lfoPhase {};
+        uint32_t expressionMask = 0; // lanes with bend, pressure or timbre away from rest
+        uint32_t snapMask = 0;       // lanes that take their targets at once at the next tick
+        int controlRemaining = 0;    // samples left in the current control segment
+        bool modulated = false;      // the kernels ramp during this segment
+        bool modulationActive = false; // the last targets were away from the notes' own settings
+    };
+
+    static constexpr float silenceThreshold = 0.00008f;
+    static constexpr int partialFadeSamples = 256;
+    static constexpr double cullFadeSeconds = 0.01;
+    static constexpr double audibleLimitHz = 20000.0;
+
+    Group& groupFor (int lane) noexcept { return groups[static_cast<size_t> (lane / lanesPerGroup)]; }
+    const Group& groupFor (int lane) const noexcept { return groups[static_cast<size_t> (lane / lanesPerGroup)]; }
+    static size_t slotFor (int lane) noexcept { return static_cast<size_t> (lane % lanesPerGroup); }
+    static float releasedCoeff (const Group& group, size_t slot) noexcept;
+    bool isInAttack (const Group& group, size_t slot) const noexcept;
+
+    // Kernels are specialised on channel count, live partial count, attack phase, partial fades, wavetable lanes and
+    // modulation ramps; the dispatcher picks one per run of samples, so the steady-state loop has no per-sample branches.
+    using Kernel = void (VoiceBank::*) (Group&, float* left, float* right, int numSamples);
+
+    void updateLevelOfDetail (Group& group) noexcept;
+    void renderGroupState (Group& group, float* left, float* right, int numSamples);
+    void renderSourceLanes (Group& group, int firstLane, float* left, float* right, int numSamples);
+
+    // Modulation ticks: evaluates the routes for the segment ahead and sets the kernels' ramps towards the results.
+    bool needsModulation (const Group& group) const noexcept;
+    void updateModulation (Group& group) noexcept;
+    void updateModulatedDecay (Group& group) noexcept;
+    void updateModulationRates() noexcept;
+
+    template <bool modulated>
+    void addWavetableSamples (Group& group, Vec& sum);
+
+    template <int numChannels, int numLive, bool attack, bool withFades, bool withWavetables, bool modulated>
+    void renderGroupSamples (Group& group, float* left, float* right, int numSamples);
+
+    // Half-rate kernel for quiet groups past their attack (see setDetailFloor).
+    template <int numChannels, int numLive>
+    void renderGroupDecimated (Group& group, float* left, float* right, int numSamples);
+
+    // Scalar counterparts of the two kernels above (see setReferenceRendering).
+    void renderGroupReference (Group& group, float* left, float* right, int numSamples,
+                               bool attack, bool withFades, bool withWavetables, bool modulated);
+    void renderGroupDecimatedReference (Group& group, float* left, float* right, int numSamples);
+
+    template <int numChannels, int numLive, size_t... flags>
+    static constexpr auto makeFlagKernels (std::index_sequence<flags...>) noexcept;
+
+    template <int numChannels, size_t... partialCounts>
+    static constexpr auto makeKernelTable (std::index_sequence<partialCounts...>) noexcept;
+
+    template <int numChannels, size_t... partialCounts>
+    static constexpr auto makeDecimatedKernelTable (std::index_sequence<partialCounts...>) noexcept;
+
+    static Kernel selectKernel (bool stereo, int numLive, bool attack, bool withFades, bool withWavetables, bool modulated) noexcept;
+    static Kernel selectDecimatedKernel (bool stereo, int numLive) noexcept;
+
+    juce::SharedResourcePointer<SharedResourceCache> sharedResources;
+    std::shared_ptr<const HammerTransientTables> hammerTables;
+    juce::uint32 strikeCount = 0;
+
+    std::vector<Group> groups;
+    const WavetableSet* wavetables = nullptr;
+    int capacity = 0;
+    double sampleRate = 44100.0;
+    float attackSamples = 352.8f;
+    int transientEnd = 0;
+    float cullCoeff = 0.984f;
+    float detailFloor = 0.0f;
+    bool referenceRendering = false;
+
+    ModulationMatrix modulation;
+    bool noteSourcesRouted = false;
+    float lfoSegmentPhase = 0.0f;       // LFO cycles per control segment
+    float envelopeSegmentCoeff = 1.0f;  // envelope source decay per control segment
+};
@@ -0,0 +1,827 @@
+#include "VoiceManager.h"
+
+PianoVoice::PianoVoice (VoiceBank& bankToUse, int laneIndex)
+    : bank (bankToUse), lane (laneIndex)
+{
+}
+
+void PianoVoice::startNote (int midiChannel, int midiNoteNumber, float velocity)
+{
+    note = midiNoteNumber;
+    channel = midiChannel;
+    keyDown = true;
+    sostenutoHeld = false;
+    choked = false;
+    sustain = 0.0f;
+
+    if (VoiceBank::usesLaneSource (oscillator))
+        bank.startSourceLane (lane, midiNoteNumber, velocity, source);
+    else
+        bank.startLane (lane, juce::MidiMessage::getMidiNoteInHertz (midiNoteNumber), velocity, oscillator);
+}
+
+void PianoVoice::stopNote (bool allowTailOff)
+{
+    keyDown = false;
+
+    if (allowTailOff)
+        bank.releaseLane (lane);
+    else
+        bank.clearLane (lane);
+}
+
+void PianoVoice::restrikeNote (float velocity)
+{
+    keyDown = true;
+    sustain = 0.0f;
+    bank.restrikeLane (lane, juce::MidiMessage::getMidiNoteInHertz (note), velocity);
+}
+
+void PianoVoice::setSustain (float depth)
+{
+    sustain = depth;
+    bank.setLaneSustain (lane, depth);
+}
+
+void PianoVoice::choke()
+{
+    keyDown = false;
+    choked = true;
+    sustain = 0.0f;
+    bank.chokeLane (lane);
+}
+
+void PianoVoice::setParameters (const std::array<float, VoiceBank::numPartials>& gains, float decayCoeff, float releaseCoeff)
+{
+    bank.setLaneParameters (lane, gains, decayCoeff, releaseCoeff);
+}
+
+//==============================================================================
+VoiceManager::VoiceManager()
+{
+    bank.setCapacity (maxVoices);
+
+    voices.reserve (maxVoices);
+    freeVoices.reserve (maxVoices);
+    activeVoices.reserve (maxVoices);
+
+    for (int i = 0; i < maxVoices; ++i)
+        voices.push_back (std::make_unique<PianoVoice> (bank, i));
+
+    reset();
+}
+
+void VoiceManager::reset()
+{
+    allNotesOff (false);
+
+    // Pushed in reverse so the lowest lanes are handed out first and the active lanes stay packed in few SIMD groups.
+    freeVoices.clear();
+
+    for (auto it = voices.rbegin(); it != voices.rend(); ++it)
+        freeVoices.push_back (it->get());
+
+    sustainPedal.fill (0.0f);
+    sostenutoPedal.fill (false);
+    channelExpression.fill ({});
+    numSteals = 0;
+
+    // Back to the zones MPE starts with, whatever configuration messages did since. The zone layout notifies its
+    // listeners on every change, and this also makes the first of those happen on construction, not on the audio thread.
+    setMpeEnabled (mpeEnabled);
+    bank.reset();
+}
+
+void VoiceManager::setCurrentPlaybackSampleRate (double newRate)
+{
+    allNotesOff (false);
+    sampleRate = newRate > 0.0 ? newRate : 44100.0;
+    bank.setSampleRate (sampleRate);
+}
+
+void VoiceManager::prepareScratch (int maximumBlockSize, int numParticipants)
+{
+    maxBlockSize = juce::jmax (1, maximumBlockSize);
+    scratchBuffers.resize (static_cast<size_t> (juce::jlimit (1, RenderWorkerPool::maxParticipants, numParticipants)));
+
+    for (auto& scratch : scratchBuffers)
+        scratch.setSize (2, maxBlockSize);
+
+    parallelGroups.reserve (static_cast<size_t> (bank.getNumGroups()));
+}
+
+size_t VoiceManager::getMemoryBytes() const noexcept
+{
+    auto bytes = sizeof (*this) + bank.getMemoryBytes() + voices.size() * sizeof (PianoVoice)
+               + (freeVoices.capacity() + activeVoices.capacity()) * sizeof (PianoVoice*)
+               + parallelGroups.capacity() * sizeof (int);
+
+    for (const auto& scratch : scratchBuffers)
+        bytes += static_cast<size_t> (scratch.getNumChannels() * scratch.getNumSamples()) * sizeof (float);
+
+    return bytes;
+}
+
+void VoiceManager::setMaxPolyphony (int numVoices) noexcept
+{
+    maxPolyphony = juce::jlimit (1, maxVoices, numVoices);
+}
+
+void VoiceManager::updateVoiceParameters (float brightnessAmount, float releaseAmount)
+{
+    WavetableSet::harmonicSpectrum (brightnessAmount, partialGains.data(), VoiceBank::numPartials);
+
+    const auto decaySeconds = 1.0f + 4.0f * juce::jlimit (0.0f, 1.0f, releaseAmount);
+    const auto releaseSeconds = 0.08f + 2.4f * juce::jlimit (0.0f, 1.0f, releaseAmount);
+
+    decayCoeff = std::exp (-1.0f / (static_cast<float> (sampleRate) * decaySeconds));
+    releaseCoeff = std::exp (-1.0f / (static_cast<float> (sampleRate) * releaseSeconds));
+    releaseTailSeconds = std::log (1000.0f) * releaseSeconds;
+
+    for (auto* voice : activeVoices)
+        voice->setParameters (partialGains, decayCoeff, releaseCoeff);
+}
+
+void VoiceManager::setModulation (const ModulationMatrix& matrix) noexcept
+{
+    controlInterval = juce::jmax (1, matrix.controlInterval);
+    bank.setModulation (matrix);
+}
+
+void VoiceManager::setPitchBendRange (int semitones) noexcept
+{
+    pitchBendRange = juce::jlimit (0, 96, semitones);
+
+    // Zones keep their own per-note range, which only MPE configuration messages change.
+    if (mpeEnabled)
+    {
+        const auto lower = zoneLayout.getLowerZone();
+        const auto upper = zoneLayout.getUpperZone();
+
+        if (lower.isActive())
+            zoneLayout.setLowerZone (lower.numMemberChannels, lower.perNotePitchbendRange, pitchBendRange);
+
+        if (upper.isActive())
+            zoneLayout.setUpperZone (upper.numMemberChannels, upper.perNotePitchbendRange, pitchBendRange);
+    }
+
+    updateAllExpression();
+}
+
+void VoiceManager::setMpeEnabled (bool shouldBeEnabled) noexcept
+{
+    mpeEnabled = shouldBeEnabled;
+
+    if (mpeEnabled)
+        zoneLayout.setLowerZone (15, 48, pitchBendRange);
+    else
+        zoneLayout.clearAllZones();
+
+    updateAllExpression();
+}
+
+void VoiceManager::renderNextBlock (juce::AudioBuffer<float>& outputAudio, const juce::MidiBuffer& midiData, int startSample, int numSamples)
+{
+    const auto endSample = startSample + numSamples;
+    auto position = startSample;
+
+    for (const auto metadata : midiData)
+    {
+        // Events the voices ignore don't split the block, so controller traffic costs nothing in either mode.
+        // They are filtered on the raw bytes, as building a MidiMessage for a long SysEx would allocate.
+        const auto kind = classifyEvent (metadata.data, metadata.numBytes);
+
+        if (kind == EventKind::ignored)
+            continue;
+
+        const auto message = metadata.getMessage();
+        const auto grid = kind == EventKind::expression ? juce::jmax (eventGrid, controlInterval) : eventGrid;
+
+        auto eventPosition = juce::jlimit (startSample, endSample, metadata.samplePosition);
+
+        if (grid > 0)
+            eventPosition = startSample + ((eventPosition - startSample) / grid) * grid;
+
+        if (eventPosition > position)
+        {
+            renderVoices (outputAudio, position, eventPosition - position);
+            position = eventPosition;
+        }
+
+        handleMidiEvent (message);
+    }
+
+    if (position < endSample)
+        renderVoices (outputAudio, position, endSample - position);
+
+    updateLoudness();
+}
+
+VoiceManager::EventKind VoiceManager::classifyEvent (const juce::uint8* data, int numBytes) noexcept
+{
+    if (numBytes < 2)
+        return EventKind::ignored;
+
+    const auto status = data[0] & 0xf0;
+
+    // Channel pressure is the only one here with a single data byte.
+    if (status == 0xd0)
+        return EventKind::expression;
+
+    if (numBytes < 3)
+        return EventKind::ignored;
+
+    if (status == 0x80 || status == 0x90)
+        return EventKind::voice;
+
+    if (status == 0xe0 || status == 0xa0)
+        return EventKind::expression;
+
+    if (status != 0xb0)
+        return EventKind::ignored;
+
+    switch (data[1])
+    {
+        // Sustain, sostenuto, all sound off, reset all controllers and all notes off.
+        case 64: case 66: case 120: case 121: case 123:
+            return EventKind::voice;
+
+        // Timbre, and the RPN and data entry controllers that carry MPE configuration.
+        case 74: case 6: case 38: case 100: case 101:
+            return EventKind::expression;
+
+        default:
+            return EventKind::ignored;
+    }
+}
+
+void VoiceManager::handleMidiEvent (const juce::MidiMessage& message)
+{
+    if (message.isNoteOn())
+        noteOn (message.getChannel(), message.getNoteNumber(), message.getFloatVelocity());
+    else if (message.isNoteOff())
+        noteOff (message.getChannel(), message.getNoteNumber(), true);
+    else if (message.isPitchWheel())
+        setChannelBend (message.getChannel(), message.getPitchWheelValue());
+    else if (message.isChannelPressure())
+        setChannelPressure (message.getChannel(), static_cast<float> (message.getChannelPressureValue()) / 127.0f);
+    else if (message.isAftertouch())
+        setPolyPressure (message.getChannel(), message.getNoteNumber(), static_cast<float> (message.getAfterTouchValue()) / 127.0f);
+    else if (message.isController())
+        handleControllerEvent (message);
+}
+
+void VoiceManager::handleControllerEvent (const juce::MidiMessage& message)
+{
+    const auto channels = getChannelsControlledBy (message.getChannel());
+    const auto controller = message.getControllerNumber();
+
+    if (controller == 6 || controller == 38 || controller == 100 || controller == 101)
+    {
+        // MPE configuration arrives as RPN 6 on a master channel and may add, resize or remove zones.
+        if (mpeEnabled)
+        {
+            zoneLayout.processNextMidiEvent (message);
+            updateAllExpression();
+        }
+    }
+    else if (message.isAllNotesOff())
+        allNotesOff (true);
+    else if (message.isAllSoundOff())
+        allNotesOff (false);
+    else if (message.isResetAllControllers())
+    {
+        for (auto channel = channels.getStart(); channel < channels.getEnd(); ++channel)
+        {
+            setSustainPedal (channel, 0);
+            setSostenutoPedal (channel, false);
+        }
+
+        resetChannelExpression (message.getChannel());
+    }
+    else if (controller == 64)
+    {
+        for (auto channel = channels.getStart(); channel < channels.getEnd(); ++channel)
+            setSustainPedal (channel, message.getControllerValue());
+    }
+    else if (controller == 66)
+    {
+        for (auto channel = channels.getStart(); channel < channels.getEnd(); ++channel)
+            setSostenutoPedal (channel, message.getControllerValue() >= 64);
+    }
+    else if (controller == 74)
+        setChannelTimbre (message.getChannel(), message.getControllerValue());
+}
+
+juce::Range<int> VoiceManager::getChannelsControlledBy (int midiChannel) const noexcept
+{
+    if (mpeEnabled)
+    {
+        const auto lower = zoneLayout.getLowerZone();
+        const auto upper = zoneLayout.getUpperZone();
+
+        if (lower.isActive() && midiChannel == lower.getMasterChannel())
+            return { lower.getMasterChannel(), lower.getLastMemberChannel() + 1 };
+
+        if (upper.isActive() && midiChannel == upper.getMasterChannel())
+            return { upper.getLastMemberChannel(), upper.getMasterChannel() + 1 };
+    }
+
+    return { midiChannel, midiChannel + 1 };
+}
+
+void VoiceManager::setChannelBend (int midiChannel, int value)
+{
+    expressionFor (midiChannel).bend = juce::jlimit (-1.0f, 1.0f, static_cast<float> (value - 8192) / 8192.0f);
+
+    // A master channel's bend moves every note in its zone.
+    const auto channels = getChannelsControlledBy (midiChannel);
+
+    for (auto* voice : activeVoices)
+        if (channels.contains (voice->getChannel()))
+            updateExpression (*voice);
+}
+
+void VoiceManager::setChannelPressure (int midiChannel, float pressure)
+{
+    expressionFor (midiChannel).pressure = pressure;
+
+    for (auto* voice : activeVoices)
+    {
+        if (voice->getChannel() == midiChannel)
+        {
+            voice->pressure = pressure;
+            updateExpression (*voice);
+        }
+    }
+}
+
+void VoiceManager::setPolyPressure (int midiChannel, int midiNoteNumber, float pressure)
+{
+    for (auto* voice = keyHead (midiChannel, midiNoteNumber); voice != nullptr; voice = voice->keyNext)
+    {
+        voice->pressure = pressure;
+        updateExpression (*voice);
+    }
+}
+
+void VoiceManager::setChannelTimbre (int midiChannel, int value)
+{
+    expressionFor (midiChannel).timbre = juce::jlimit (-1.0f, 1.0f, static_cast<float> (value - 64) / 63.0f);
+
+    for (auto* voice : activeVoices)
+        if (voice->getChannel() == midiChannel)
+            updateExpression (*voice);
+}
+
+void VoiceManager::resetChannelExpression (int midiChannel)
+{
+    expressionFor (midiChannel) = {};
+    const auto channels = getChannelsControlledBy (midiChannel);
+
+    for (auto* voice : activeVoices)
+    {
+        if (voice->getChannel() == midiChannel)
+            voice->pressure = 0.0f;
+
+        if (channels.contains (voice->getChannel()))
+            updateExpression (*voice);
+    }
+}
+
+float VoiceManager::getBendSemitones (int midiChannel) const noexcept
+{
+    const auto bend = expressionFor (midiChannel).bend;
+
+    if (mpeEnabled)
+    {
+        for (const auto& zone : { zoneLayout.getLowerZone(), zoneLayout.getUpperZone() })
+        {
+            if (! zone.isActive())
+                continue;
+
+            const auto masterBend = expressionFor (zone.getMasterChannel()).bend * static_cast<float> (zone.masterPitchbendRange);
+
+            if (midiChannel == zone.getMasterChannel())
+                return masterBend;
+
+            if (zone.isUsingChannelAsMemberChannel (midiChannel))
+                return bend * static_cast<float> (zone.perNotePitchbendRange) + masterBend;
+        }
+    }
+
+    return bend * static_cast<float> (pitchBendRange);
+}
+
+VoiceManager::ChannelExpression& VoiceManager::expressionFor (int midiChannel) noexcept
+{
+    return channelExpression[static_cast<size_t> (juce::jlimit (1, numChannels, midiChannel) - 1)];
+}
+
+const VoiceManager::ChannelExpression& VoiceManager::expressionFor (int midiChannel) const noexcept
+{
+    return channelExpression[static_cast<size_t> (juce::jlimit (1, numChannels, midiChannel) - 1)];
+}
+
+void VoiceManager::updateExpression (const PianoVoice& voice) noexcept
+{
+    bank.setLaneExpression (voice.getLane(), getBendSemitones (voice.getChannel()), voice.pressure,
+                            expressionFor (voice.getChannel()).timbre);
+}
+
+void VoiceManager::updateAllExpression() noexcept
+{
+    for (auto* voice : activeVoices)
+        updateExpression (*voice);
+}
+
+void VoiceManager::noteOn (int midiChannel, int midiNoteNumber, float velocity)
+{
+    // A real key has one set of strings, so a key still sounding on an oscillator engine is struck again in place.
+    // Repeated notes under the pedal then cost nothing extra, however fast they come.
+    if (auto* ringing = keyHead (midiChannel, midiNoteNumber);
+        ringing != nullptr && ! ringing->choked && ringing->oscillator == oscillator && ! VoiceBank::usesLaneSource (oscillator))
+    {
+        ringing->restrikeNote (velocity);
+        ringing->setParameters (partialGains, decayCoeff, releaseCoeff);
+        ringing->pressure = expressionFor (midiChannel).pressure;
+        updateExpression (*ringing);
+        unlinkFromList (*ringing);
+        linkToList (*ringing, listIndexFor (ringing->getLoudness(), true));
+        return;
+    }
+
+    // Otherwise the key's previous voices are released and crossfade with the new one, and any beyond the per-key
+    // limit are choked so the key can't pile up voices.
+    noteOff (midiChannel, midiNoteNumber, true);
+    limitVoicesOnKey (midiChannel, midiNoteNumber, maxVoicesPerKey - 1);
+
+    auto* voice = allocateVoice();
+
+    voice->setOscillator (oscillator, laneSources[static_cast<size_t> (oscillator)]);
+    voice->startNote (midiChannel, midiNoteNumber, velocity);
+    voice->setParameters (partialGains, decayCoeff, releaseCoeff);
+
+    // A note starts with whatever its channel's expression is already at.
+    voice->pressure = expressionFor (midiChannel).pressure;
+    updateExpression (*voice);
+
+    voice->activeIndex = static_cast<int> (activeVoices.size());
+    activeVoices.push_back (voice);
+
+    linkToKey (*voice);
+    linkToList (*voice, listIndexFor (voice->getLoudness(), true));
+}
+
+void VoiceManager::noteOff (int midiChannel, int midiNoteNumber, bool allowTailOff)
+{
+    auto* voice = keyHead (midiChannel, midiNoteNumber);
+
+    while (voice != nullptr)
+    {
+        auto* next = voice->keyNext;
+
+        if (voice->isKeyDown())
+        {
+            if (allowTailOff)
+                voice->setSustain (getSustainFor (*voice));
+
+            voice->stopNote (allowTailOff);
+
+            if (allowTailOff)
+            {
+                unlinkFromList (*voice);
+                linkToList (*voice, listIndexFor (voice->getLoudness(), voice->isHeld()));
+            }
+            else
+            {
+                retireVoice (*voice);
+            }
+        }
+
+        voice = next;
+    }
+}
+
+void VoiceManager::allNotesOff (bool allowTailOff)
+{
+    for (int i = static_cast<int> (activeVoices.size()); --i >= 0;)
+    {
+        auto* voice = activeVoices[static_cast<size_t> (i)];
+
+        if (! allowTailOff)
+        {
+            voice->stopNote (false);
+            retireVoice (*voice);
+        }
+        else if (voice->isKeyDown())
+        {
+            noteOff (voice->getChannel(), voice->getCurrentlyPlayingNote(), true);
+        }
+    }
+}
+
+void VoiceManager::setSustainPedal (int midiChannel, int value)
+{
+    auto& pedal = sustainPedal[static_cast<size_t> (juce::jlimit (1, numChannels, midiChannel) - 1)];
+    const auto depth = sustainDepthFor (value);
+
+    if (depth == pedal)
+        return;
+
+    pedal = depth;
+
+    // Held keys don't care about the dampers yet; they pick the pedal up when they are released.
+    for (auto* voice : activeVoices)
+        if (voice->getChannel() == midiChannel && ! voice->isKeyDown() && ! voice->sostenutoHeld && ! voice->choked)
+            voice->setSustain (depth);
+}
+
+void VoiceManager::setSostenutoPedal (int midiChannel, bool isDown)
+{
+    const auto index = static_cast<size_t> (juce::jlimit (1, numChannels, midiChannel) - 1);
+
+    if (sostenutoPedal[index] == isDown)
+        return;
+
+    sostenutoPedal[index] = isDown;
+
+    // Only the keys down at the moment the pedal goes down are latched; releasing it hands them back to the sustain pedal.
+    for (auto* voice : activeVoices)
+    {
+        if (voice->getChannel() != midiChannel || voice->choked)
+            continue;
+
+        if (isDown)
+        {
+            voice->sostenutoHeld = voice->isKeyDown();
+        }
+        else if (voice->sostenutoHeld)
+        {
+            voice->sostenutoHeld = false;
+
+            if (! voice->isKeyDown())
+                voice->setSustain (sustainPedal[index]);
+        }
+    }
+}
+
+float VoiceManager::sustainDepthFor (int controllerValue) noexcept
+{
+    // Pedals rarely rest at exactly 0 or 127, so both ends have a small dead zone; in between the dampers lift
+    // gradually, which is what half-pedalling relies on.
+    return juce::jlimit (0.0f, 1.0f, static_cast<float> (controllerValue - 8) / 104.0f);
+}
+
+float VoiceManager::getSustainFor (const PianoVoice& voice) const noexcept
+{
+    return voice.sostenutoHeld ? 1.0f : sustainPedal[static_cast<size_t> (juce::jlimit (1, numChannels, voice.getChannel()) - 1)];
+}
+
+void VoiceManager::limitVoicesOnKey (int midiChannel, int midiNoteNumber, int numToKeep)
+{
+    // The key chain runs newest first, so the voices past numToKeep are the oldest.
+    auto numKept = 0;
+
+    for (auto* voice = keyHead (midiChannel, midiNoteNumber); voice != nullptr; voice = voice->keyNext)
+    {
+        if (voice->choked)
+            continue;
+
+        if (numKept < numToKeep)
+        {
+            ++numKept;
+            continue;
+        }
+
+        voice->choke();
+        unlinkFromList (*voice);
+        linkToList (*voice, listIndexFor (voice->getLoudness(), false));
+    }
+}
+
+void VoiceManager::renderVoices (juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+{
+    // Hosts occasionally exceed the block size they announced; rendering in prepared-size pieces means the scratch
+    // buffers never have to grow on the audio thread.
+    if (numSamples > maxBlockSize)
+    {
+        for (int done = 0; done < numSamples; done += maxBlockSize)
+            renderVoices (outputAudio, startSample + done, juce::jmin (maxBlockSize, numSamples - done));
+
+        return;
+    }
+
+    if (renderVoicesInParallel (outputAudio, startSample, numSamples))
+        return;
+
+    auto* left = outputAudio.getWritePointer (0, startSample);
+    auto* right = outputAudio.getNumChannels() > 1 ? outputAudio.getWritePointer (1, startSample) : nullptr;
+
+    bank.renderAll (left, right, numSamples, [this] (int finishedLane)
+    {
+        retireVoice (*voices[static_cast<size_t> (finishedLane)]);
+    });
+}
+
+bool VoiceManager::renderVoicesInParallel (juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples)
+{
+    const auto numThreads = workerPool != nullptr ? juce::jmin (renderThreads, workerPool->getNumParticipants(),
+                                                                static_cast<int> (scratchBuffers.size()))
+                                                  : 1;
+
+    if (numThreads < 2 || numSamples < minParallelSamples)
+        return false;
+
+    parallelGroups.clear();
+
+    for (int g = 0; g < bank.getNumGroups(); ++g)
+        if (bank.isGroupActive (g))
+            parallelGroups.push_back (g);
+
+    if (static_cast<int> (parallelGroups.size()) < minParallelGroups)
+        return false;
+
+    parallelNumSamples = numSamples;
+    parallelStereo = outputAudio.getNumChannels() > 1;
+    scratchUsed.fill (false);
+
+    workerPool->run (&VoiceManager::renderGroupChunk, this, static_cast<int> (parallelGroups.size()), numThreads);
+
+    for (size_t p = 0; p < scratchBuffers.size(); ++p)
+    {
+        if (! scratchUsed[p])
+            continue;
+
+        for (int ch = 0; ch < (parallelStereo ? 2 : 1); ++ch)
+            outputAudio.addFrom (ch, startSample, scratchBuffers[p], ch, 0, numSamples);
+    }
+
+    bank.collectFinishedLanes ([this] (int finishedLane)
+    {
+        retireVoice (*voices[static_cast<size_t> (finishedLane)]);
+    });
+
+    return true;
+}
+
+void VoiceManager::renderGroupChunk (void* context, int chunkIndex, int participant)
+{
+    auto& manager = *static_cast<VoiceManager*> (context);
+    auto& scratch = manager.scratchBuffers[static_cast<size_t> (participant)];
+    const auto numSamples = manager.parallelNumSamples;
+
+    const auto numChannels = manager.parallelStereo ? 2 : 1;
+
+    // Each participant mixes into its own buffer, cleared the first time it picks up work in this block.
+    if (! manager.scratchUsed[static_cast<size_t> (participant)])
+    {
+        for (int ch = 0; ch < numChannels; ++ch)
+            scratch.clear (ch, 0, numSamples);
+
+        manager.scratchUsed[static_cast<size_t> (participant)] = true;
+    }
+
+    // A mono bus gets the mono kernels here too.
+    manager.bank.renderGroup (manager.parallelGroups[static_cast<size_t> (chunkIndex)], scratch.getWritePointer (0),
+                              numChannels > 1 ? scratch.getWritePointer (1) : nullptr, numSamples);
+}
+
+void VoiceManager::updateLoudness()
+{
+    for (auto* voice : activeVoices)
+    {
+        const auto index = listIndexFor (voice->getLoudness(), voice->isHeld());
+
+        if (index != voice->listIndex)
+        {
+            unlinkFromList (*voice);
+            linkToList (*voice, index);
+        }
+    }
+}
+
+int VoiceManager::listIndexFor (float loudness, bool held) noexcept
+{
+    // Each step of the binary exponent is 6 dB; bucket 0 collects everything below about -90 dB.
+    const auto bucket = loudness > 0.0f ? juce::jlimit (0, numLoudnessBuckets - 1, std::ilogb (loudness) + numLoudnessBuckets)
+                                        : 0;
+    return bucket * 2 + (held ? 1 : 0);
+}
+
+PianoVoice* VoiceManager::allocateVoice()
+{
+    while (static_cast<int> (activeVoices.size()) >= maxPolyphony || freeVoices.empty())
+    {
+        auto* victim = findStealVictim();
+        victim->stopNote (false);
+        retireVoice (*victim);
+        ++numSteals;
+    }
+
+    auto* voice = freeVoices.back();
+    freeVoices.pop_back();
+    return voice;
+}
+
+PianoVoice* VoiceManager::findStealVictim() const noexcept
+{
+    // Quietest bucket first; within a bucket released voices go before held ones, oldest first.
+    for (const auto& list : lists)
+        if (list.head != nullptr)
+            return list.head;
+
+    jassertfalse;
+    return activeVoices.front();
+}
+
+void VoiceManager::retireVoice (PianoVoice& voice)
+{
+    if (voice.activeIndex < 0)
+        return;
+
+    unlinkFromList (voice);
+    unlinkFromKey (voice);
+
+    auto* last = activeVoices.back();
+    activeVoices[static_cast<size_t> (voice.activeIndex)] = last;
+    last->activeIndex = voice.activeIndex;
+    activeVoices.pop_back();
+
+    voice.activeIndex = -1;
+    voice.keyDown = false;
+    voice.note = -1;
+    freeVoices.push_back (&voice);
+}
+
+void VoiceManager::linkToList (PianoVoice& voice, int index) noexcept
+{
+    auto& list = lists[static_cast<size_t> (index)];
+
+    voice.listIndex = index;
+    voice.listPrev = list.tail;
+    voice.listNext = nullptr;
+
+    if (list.tail != nullptr)
+        list.tail->listNext = &voice;
+    else
+        list.head = &voice;
+
+    list.tail = &voice;
+}
+
+void VoiceManager::unlinkFromList (PianoVoice& voice) noexcept
+{
+    if (voice.listIndex < 0)
+        return;
+
+    auto& list = lists[static_cast<size_t> (voice.listIndex)];
+
+    if (voice.listPrev != nullptr)
+        voice.listPrev->listNext = voice.listNext;
+    else
+        list.head = voice.listNext;
+
+    if (voice.listNext != nullptr)
+        voice.listNext->listPrev = voice.listPrev;
+    else
+        list.tail = voice.listPrev;
+
+    voice.listPrev = voice.listNext = nullptr;
+    voice.listIndex = -1;
+}
+
+PianoVoice*& VoiceManager::keyHead (int midiChannel, int midiNoteNumber) noexcept
+{
+    return voicesOnKey[static_cast<size_t> (juce::jlimit (1, numChannels, midiChannel) - 1)]
+                      [static_cast<size_t> (juce::jlimit (0, 127, midiNoteNumber))];
+}
+
+void VoiceManager::linkToKey (PianoVoice& voice) noexcept
+{
+    auto& head = keyHead (voice.channel, voice.note);
+
+    voice.keyPrev = nullptr;
+    voice.keyNext = head;
+
+    if (head != nullptr)
+        head->keyPrev = &voice;
+
+    head = &voice;
+}
+
+void VoiceManager::unlinkFromKey (PianoVoice& voice) noexcept
+{
+    if (voice.note < 0)
+        return;
+
+    if (voice.keyPrev != nullptr)
+        voice.keyPrev->keyNext = voice.keyNext;
+    else
+        keyHead (voice.channel, voice.note) = voice.keyNext;
+
+    if (voice.keyNext != nullptr)
+        voice.keyNext->keyPrev = voice.keyPrev;
+
+    voice.keyPrev = voice.keyNext = nullptr;
+}
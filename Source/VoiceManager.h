@@ -0,0 +1,255 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "RenderWorkerPool.h"
+#include "VoiceBank.h"
+
+// Per-note bookkeeping for one lane of the VoiceBank. The DSP state itself lives in the bank.
+class PianoVoice final
+{
+public:
+    PianoVoice (VoiceBank& bankToUse, int laneIndex);
+
+    void startNote (int midiChannel, int midiNoteNumber, float velocity);
+    void stopNote (bool allowTailOff);
+
+    // Same key struck again while it still sounds: the lane carries on instead of a new voice starting.
+    void restrikeNote (float velocity);
+
+    // How far the dampers are off the string once the key is up (see VoiceBank::setLaneSustain).
+    void setSustain (float depth);
+    void choke();
+
+    void setParameters (const std::array<float, VoiceBank::numPartials>& gains, float decayCoeff, float releaseCoeff);
+    void setOscillator (VoiceBank::Oscillator newOscillator, LaneSource* newSource) noexcept
+    {
+        oscillator = newOscillator;
+        source = newSource;
+    }
+
+    int getLane() const noexcept { return lane; }
+    int getCurrentlyPlayingNote() const noexcept { return note; }
+    int getChannel() const noexcept { return channel; }
+    bool isKeyDown() const noexcept { return keyDown; }
+
+    // Held by the key or a pedal; stealing prefers voices that aren't.
+    bool isHeld() const noexcept { return keyDown || sustain > 0.0f; }
+    float getLoudness() const noexcept { return bank.getLaneLoudness (lane); }
+
+private:
+    friend class VoiceManager;
+
+    VoiceBank& bank;
+    const int lane;
+
+    VoiceBank::Oscillator oscillator = VoiceBank::Oscillator::additive;
+    LaneSource* source = nullptr;
+    int note = -1;
+    int channel = 0;
+    bool keyDown = false;
+    bool sostenutoHeld = false; // the key was down when the sostenuto pedal went down
+    bool choked = false;
+    float sustain = 0.0f;
+    float pressure = 0.0f; // poly aftertouch or channel pressure, whichever came last
+
+    // Intrusive links owned by VoiceManager: one loudness list, the per-key chain and the dense active array.
+    PianoVoice* listPrev = nullptr;
+    PianoVoice* listNext = nullptr;
+    PianoVoice* keyPrev = nullptr;
+    PianoVoice* keyNext = nullptr;
+    int listIndex = -1;
+    int activeIndex = -1;
+};
+
+// Replaces juce::Synthesiser's voice dispatch. Every voice is preallocated; note-on, note-off and
+// voice stealing are constant time regardless of polyphony, and nothing here takes a lock.
+class VoiceManager
+{
+public:
+    static constexpr int maxVoices = 256;
+
+    VoiceManager();
+
+    void setCurrentPlaybackSampleRate (double newRate);
+
+    // Not concurrently with rendering: stops every voice, lifts the pedals and hands lanes out from the lowest again,
+    // so what follows renders exactly as it would on a new manager with the same settings.
+    void reset();
+
+    // Message thread: sizes the per-thread scratch buffers used by the parallel render mode. Larger blocks are
+    // rendered in pieces of this size.
+    void prepareScratch (int maximumBlockSize, int numParticipants);
+
+    // Voice groups are spread over up to numThreads threads of the pool when a block is big enough to be worth it.
+    void setWorkerPool (RenderWorkerPool* poolToUse) noexcept { workerPool = poolToUse; }
+    void setRenderThreads (int numThreads) noexcept { renderThreads = numThreads; }
+    void setMaxPolyphony (int numVoices) noexcept;
+    int getMaxPolyphony() const noexcept { return maxPolyphony; }
+
+    // Output level below which voices are simplified or culled (see VoiceBank::setDetailFloor).
+    void setDetailFloor (float floorLevel) noexcept { bank.setDetailFloor (floorLevel); }
+
+    // False renders with the bank's scalar reference kernels (see VoiceBank::setReferenceRendering).
+    void setVectorisedRendering (bool shouldVectorise) noexcept { bank.setReferenceRendering (! shouldVectorise); }
+    bool isVectorisedRendering() const noexcept { return ! bank.isReferenceRendering(); }
+
+    // Oscillator used by notes started from now on; sounding notes keep the one they started with.
+    void setOscillator (VoiceBank::Oscillator newOscillator) noexcept { oscillator = newOscillator; }
+    void setWavetables (const WavetableSet* tables) noexcept { bank.setWavetables (tables); }
+
+    // Renderer for one of the LaneSource engines (sampled, modal); notes started without one stay silent.
+    void setLaneSource (VoiceBank::Oscillator engine, LaneSource* source) noexcept { laneSources[static_cast<size_t> (engine)] = source; }
+
+    void updateVoiceParameters (float brightnessAmount, float releaseAmount);
+
+    // Per-voice modulation routes and control rate (see VoiceBank::setModulation). Expression events are snapped to
+    // the control grid as well, since the voices only pick them up at a tick anyway.
+    void setModulation (const ModulationMatrix& matrix) noexcept;
+
+    // Semitones a full pitch wheel bends: every channel outside MPE, the zones' master channels inside it.
+    void setPitchBendRange (int semitones) noexcept;
+
+    // MPE: starts with a lower zone of 15 member channels that bend 48 semitones per note, as MPESynthesiser does,
+    // which MPE configuration messages may then change. Notes on member channels take that channel's bend, pressure
+    // and timbre, the master channel's bend moves the whole zone, and its pedals hold every channel of the zone.
+    void setMpeEnabled (bool shouldBeEnabled) noexcept;
+    bool isMpeEnabled() const noexcept { return mpeEnabled; }
+
+    // Time a released voice takes to fall by 60 dB with the current Release setting.
+    float getReleaseTailSeconds() const noexcept { return releaseTailSeconds; }
+
+    // 0 renders sample-accurately. 8, 16 or 32 snaps MIDI events down to that grid from the block start, so
+    // dense MIDI still renders in runs the voice kernels can vectorise, at the cost of up to grid-1 samples of timing.
+    void setEventQuantisation (int gridSamples) noexcept { eventGrid = juce::jlimit (0, maxEventGrid, gridSamples); }
+    int getEventQuantisation() const noexcept { return eventGrid; }
+
+    void renderNextBlock (juce::AudioBuffer<float>& outputAudio, const juce::MidiBuffer& midiData, int startSample, int numSamples);
+
+    void noteOn (int midiChannel, int midiNoteNumber, float velocity);
+    void noteOff (int midiChannel, int midiNoteNumber, bool allowTailOff);
+    void allNotesOff (bool allowTailOff);
+
+    // CC64 and CC66. The sustain value is continuous, so half-pedalling gives a partly damped release.
+    void setSustainPedal (int midiChannel, int value);
+    void setSostenutoPedal (int midiChannel, bool isDown);
+
+    // Voices a key may have sounding at once when it can't be re-struck in place (sample and modal engines, or an
+    // engine change); the oldest beyond this are choked. Oscillator engines always re-strike their one voice.
+    void setMaxVoicesPerKey (int numVoices) noexcept { maxVoicesPerKey = juce::jlimit (1, 8, numVoices); }
+
+    int getNumActiveVoices() const noexcept { return static_cast<int> (activeVoices.size()); }
+    int getNumSteals() const noexcept { return numSteals; }
+
+    // Voice state and render scratch, all owned by this instance.
+    size_t getMemoryBytes() const noexcept;
+
+private:
+    // Voices are bucketed by loudness in 6 dB steps, with released and held voices kept apart,
+    // so the quietest candidate for stealing is found by scanning a fixed number of lists.
+    static constexpr int numLoudnessBuckets = 16;
+    static constexpr int numLists = numLoudnessBuckets * 2;
+    static constexpr int numChannels = 16;
+
+    struct VoiceList
+    {
+        PianoVoice* head = nullptr;
+        PianoVoice* tail = nullptr;
+    };
+
+    static constexpr int maxEventGrid = 32;
+
+    enum class EventKind
+    {
+        ignored,
+        voice,     // starts, stops or holds notes, so it splits the block at its position
+        expression // bend, pressure or timbre, which the voices take at their next control tick
+    };
+
+    // Last value of each expression dimension per channel, centred at rest.
+    struct ChannelExpression
+    {
+        float bend = 0.0f;     // -1 to 1 of the bend range
+        float pressure = 0.0f; // 0 to 1
+        float timbre = 0.0f;   // -1 to 1
+    };
+
+    static int listIndexFor (float loudness, bool held) noexcept;
+    static float sustainDepthFor (int controllerValue) noexcept;
+    static EventKind classifyEvent (const juce::uint8* data, int numBytes) noexcept;
+
+    void handleMidiEvent (const juce::MidiMessage&);
+    void handleControllerEvent (const juce::MidiMessage&);
+    void setChannelBend (int midiChannel, int value);
+    void setChannelPressure (int midiChannel, float pressure);
+    void setPolyPressure (int midiChannel, int midiNoteNumber, float pressure);
+    void setChannelTimbre (int midiChannel, int value);
+    void resetChannelExpression (int midiChannel);
+
+    // Channels a pedal or bend on this channel applies to: an MPE master channel's whole zone, otherwise itself.
+    juce::Range<int> getChannelsControlledBy (int midiChannel) const noexcept;
+    float getBendSemitones (int midiChannel) const noexcept;
+    ChannelExpression& expressionFor (int midiChannel) noexcept;
+    const ChannelExpression& expressionFor (int midiChannel) const noexcept;
+    void updateExpression (const PianoVoice& voice) noexcept;
+    void updateAllExpression() noexcept;
+
+    void renderVoices (juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples);
+    bool renderVoicesInParallel (juce::AudioBuffer<float>& outputAudio, int startSample, int numSamples);
+    static void renderGroupChunk (void* context, int chunkIndex, int participant);
+    void updateLoudness();
+
+    PianoVoice* allocateVoice();
+    PianoVoice* findStealVictim() const noexcept;
+    void retireVoice (PianoVoice& voice);
+
+    void linkToList (PianoVoice& voice, int index) noexcept;
+    void unlinkFromList (PianoVoice& voice) noexcept;
+    void linkToKey (PianoVoice& voice) noexcept;
+    void unlinkFromKey (PianoVoice& voice) noexcept;
+
+    PianoVoice*& keyHead (int midiChannel, int midiNoteNumber) noexcept;
+    float getSustainFor (const PianoVoice& voice) const noexcept;
+    void limitVoicesOnKey (int midiChannel, int midiNoteNumber, int numToKeep);
+
+    VoiceBank bank;
+    std::vector<std::unique_ptr<PianoVoice>> voices;
+    std::vector<PianoVoice*> freeVoices;
+    std::vector<PianoVoice*> activeVoices;
+    std::array<VoiceList, numLists> lists;
+    std::array<std::array<PianoVoice*, 128>, numChannels> voicesOnKey {};
+    std::array<float, numChannels> sustainPedal {};
+    std::array<bool, numChannels> sostenutoPedal {};
+    std::array<ChannelExpression, numChannels> channelExpression {};
+    juce::MPEZoneLayout zoneLayout;
+
+    // Parallel rendering is skipped below these sizes, where handoff costs more than it saves.
+    static constexpr int minParallelSamples = 32;
+    static constexpr int minParallelGroups = 4;
+
+    RenderWorkerPool* workerPool = nullptr;
+    std::vector<juce::AudioBuffer<float>> scratchBuffers;
+    int maxBlockSize = 4096;
+    std::array<bool, RenderWorkerPool::maxParticipants> scratchUsed {};
+    std::vector<int> parallelGroups;
+    int parallelNumSamples = 0;
+    bool parallelStereo = true;
+    int renderThreads = 1;
+
+    std::array<float, VoiceBank::numPartials> partialGains { 1.0f, 0.52f, 0.30f, 0.15f };
+    float decayCoeff = 0.9995f;
+    float releaseCoeff = 0.9990f;
+    float releaseTailSeconds = 1.0f;
+
+    VoiceBank::Oscillator oscillator = VoiceBank::Oscillator::additive;
+    std::array<LaneSource*, VoiceBank::numOscillators> laneSources {};
+    double sampleRate = 44100.0;
+    int maxPolyphony = 64;
+    int eventGrid = 0;
+    int controlInterval = 32;
+    int pitchBendRange = 2;
+    bool mpeEnabled = false;
+    int maxVoicesPerKey = 2;
+    int numSteals = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (VoiceManager)
+};
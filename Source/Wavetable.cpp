@@ -0,0 +1,188 @@
+#include "Wavetable.h"
+
+WavetableSet::WavetableSet (const Spectrum& spectrum, double sampleRate)
+{
+    const auto nyquist = sampleRate * 0.5;
+
+    for (int octave = 0; octave < numOctaves; ++octave)
+    {
+        auto& table = tables[static_cast<size_t> (octave)];
+        table.assign (static_cast<size_t> (tableSize + 1), 0.0f);
+
+        const auto topFundamental = lowestFundamental * std::pow (2.0, static_cast<double> (octave));
+
+        for (int k = 1; k <= maxPartials; ++k)
+        {
+            const auto gain = spectrum[static_cast<size_t> (k - 1)];
+
+            if (topFundamental * k >= nyquist)
+                break;
+
+            if (gain == 0.0f)
+                continue;
+
+            const auto delta = juce::MathConstants<double>::twoPi * k / tableSize;
+
+            for (int i = 0; i < tableSize; ++i)
+                table[static_cast<size_t> (i)] += gain * static_cast<float> (std::sin (delta * i));
+        }
+
+        table[static_cast<size_t> (tableSize)] = table[0];
+    }
+}
+
+void WavetableSet::harmonicSpectrum (float brightnessAmount, float* gains, int numGains) noexcept
+{
+    const auto b = juce::jlimit (0.0f, 1.0f, brightnessAmount);
+    const std::array<float, 4> lowPartials { 1.0f, 0.30f + 0.45f * b, 0.15f + 0.30f * b, 0.05f + 0.20f * b };
+
+    // Above the fourth partial the spectrum rolls off geometrically, more slowly when brighter.
+    const auto rolloff = 0.35f + 0.40f * b;
+    auto gain = lowPartials.back();
+
+    for (int k = 0; k < numGains; ++k)
+    {
+        if (k < static_cast<int> (lowPartials.size()))
+        {
+            gains[k] = lowPartials[static_cast<size_t> (k)];
+            continue;
+        }
+
+        gain *= rolloff;
+        gains[k] = gain;
+    }
+}
+
+int WavetableSet::octaveForFrequency (double frequency) noexcept
+{
+    const auto octave = static_cast<int> (std::ceil (std::log2 (juce::jmax (frequency, lowestFundamental) / lowestFundamental)));
+    return juce::jlimit (0, numOctaves - 1, octave);
+}
+
+//==============================================================================
+WavetableCache::WavetableCache()
+    : juce::Thread ("Codex Piano wavetables")
+{
+}
+
+WavetableCache::~WavetableCache()
+{
+    release();
+}
+
+int WavetableCache::keyForBrightness (float brightnessAmount) noexcept
+{
+    return juce::roundToInt (juce::jlimit (0.0f, 1.0f, brightnessAmount) * static_cast<float> (brightnessSteps));
+}
+
+void WavetableCache::prepare (double newSampleRate, float brightnessAmount)
+{
+    release();
+
+    if (! juce::approximatelyEqual (sampleRate, newSampleRate))
+        entries.clear();
+
+    sampleRate = newSampleRate;
+
+    const auto key = keyForBrightness (brightnessAmount);
+    current.store (findOrBuild (key));
+    currentKey.store (key);
+    requestedKey.store (key);
+
+    startThread (juce::Thread::Priority::background);
+}
+
+void WavetableCache::release()
+{
+    stopThread (2000);
+}
+
+void WavetableCache::requestBrightness (float brightnessAmount) noexcept
+{
+    requestedKey.store (keyForBrightness (brightnessAmount), std::memory_order_relaxed);
+}
+
+const WavetableSet* WavetableCache::acquire() noexcept
+{
+    const WavetableSet* set = nullptr;
+
+    do
+    {
+        set = current.load();
+        inUse.store (set);
+    }
+    while (set != current.load());
+
+    return set;
+}
+
+void WavetableCache::releaseAcquired() noexcept
+{
+    inUse.store (nullptr);
+}
+
+void WavetableCache::run()
+{
+    while (! threadShouldExit())
+    {
+        const auto key = requestedKey.load (std::memory_order_relaxed);
+
+        if (key != currentKey.load())
+        {
+            current.store (findOrBuild (key));
+            currentKey.store (key);
+            evictUnused();
+        }
+
+        wait (20);
+    }
+}
+
+const WavetableSet* WavetableCache::findOrBuild (int key)
+{
+    const auto now = juce::Time::getMillisecondCounter();
+
+    for (auto& entry : entries)
+    {
+        if (entry.key == key)
+        {
+            entry.lastUsedMs = now;
+            return entry.set.get();
+        }
+    }
+
+    auto set = sharedResources->get<WavetableSet> ("wavetable/" + juce::String (key) + "@" + juce::String (sampleRate), [this, key]
+    {
+        WavetableSet::Spectrum spectrum {};
+        WavetableSet::harmonicSpectrum (static_cast<float> (key) / static_cast<float> (brightnessSteps),
+                                        spectrum.data(), WavetableSet::maxPartials);
+        return std::make_unique<WavetableSet> (spectrum, sampleRate);
+    });
+
+    entries.push_back ({ key, std::move (set), now });
+    return entries.back().set.get();
+}
+
+void WavetableCache::evictUnused()
+{
+    while (entries.size() > maxEntries)
+    {
+        auto oldest = entries.end();
+
+        for (auto it = entries.begin(); it != entries.end(); ++it)
+        {
+            const auto* set = it->set.get();
+
+            if (set == current.load() || set == inUse.load())
+                continue;
+
+            if (oldest == entries.end() || it->lastUsedMs < oldest->lastUsedMs)
+                oldest = it;
+        }
+
+        if (oldest == entries.end())
+            return;
+
+        entries.erase (oldest);
+    }
+}
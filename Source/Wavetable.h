@@ -0,0 +1,86 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "SharedResourceCache.h"
+
+// Band-limited single-cycle tables, one per octave, built from a harmonic spectrum.
+// Partials that would land above Nyquist for the highest note of an octave are left out of its table.
+class WavetableSet
+{
+public:
+    static constexpr int tableSize = 2048;
+    static constexpr int numOctaves = 10;
+    static constexpr int maxPartials = 64;
+    static constexpr double lowestFundamental = 27.5;
+
+    using Spectrum = std::array<float, maxPartials>;
+
+    WavetableSet (const Spectrum& spectrum, double sampleRate);
+
+    // Fills numGains harmonic gains for a brightness amount; shared by the additive and wavetable oscillators.
+    static void harmonicSpectrum (float brightnessAmount, float* gains, int numGains) noexcept;
+
+    static int octaveForFrequency (double frequency) noexcept;
+
+    size_t getMemoryBytes() const noexcept { return sizeof (*this) + numOctaves * (tableSize + 1) * sizeof (float); }
+
+    const float* getTable (int octave) const noexcept { return tables[static_cast<size_t> (octave)].data(); }
+
+    static float lookup (const float* table, float phase) noexcept
+    {
+        const auto position = phase * static_cast<float> (tableSize);
+        const auto index = static_cast<int> (position);
+        const auto frac = position - static_cast<float> (index);
+        return table[index] + frac * (table[index + 1] - table[index]);
+    }
+
+private:
+    std::array<std::vector<float>, numOctaves> tables;
+};
+
+// Holds the wavetable sets for recently used brightness values and builds missing ones on a background thread.
+// Sets come from the SharedResourceCache, so instances at the same sample rate and brightness share them.
+// The audio thread only reads an atomic pointer; a hazard pointer stops a set from being freed while it is rendered.
+class WavetableCache final : private juce::Thread
+{
+public:
+    WavetableCache();
+    ~WavetableCache() override;
+
+    // Message thread: builds the initial set synchronously and starts the builder thread.
+    void prepare (double sampleRate, float brightnessAmount);
+    void release();
+
+    // Audio thread.
+    void requestBrightness (float brightnessAmount) noexcept;
+    const WavetableSet* acquire() noexcept;
+    void releaseAcquired() noexcept;
+
+private:
+    struct Entry
+    {
+        int key = -1;
+        std::shared_ptr<const WavetableSet> set;
+        juce::uint32 lastUsedMs = 0;
+    };
+
+    static constexpr int brightnessSteps = 100;
+    static constexpr size_t maxEntries = 12;
+
+    static int keyForBrightness (float brightnessAmount) noexcept;
+
+    void run() override;
+    const WavetableSet* findOrBuild (int key);
+    void evictUnused();
+
+    juce::SharedResourcePointer<SharedResourceCache> sharedResources;
+    double sampleRate = 44100.0;
+    std::vector<Entry> entries;
+
+    std::atomic<int> requestedKey { -1 };
+    std::atomic<int> currentKey { -1 };
+    std::atomic<const WavetableSet*> current { nullptr };
+    std::atomic<const WavetableSet*> inUse { nullptr };
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (WavetableCache)
+};
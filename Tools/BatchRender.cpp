@@ -0,0 +1,596 @@
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+#include <deque>
+
+namespace
+{
+enum class OutputFormat
+{
+    wav,
+    rawFloat
+};
+
+struct BatchOptions
+{
+    juce::File manifestFile;
+    juce::File spoolFolder;
+    juce::File outputFolder;
+    juce::File stateFile;
+    juce::File sampleFolder;
+    juce::StringArray parameterSettings;
+    OutputFormat format = OutputFormat::wav;
+    double sampleRate = 48000.0;
+    int blockSize = 512;
+    double tailSeconds = -1.0;
+    int numWorkers = 1;
+    double idleExitSeconds = -1.0;
+};
+
+struct Job
+{
+    juce::File midiFile;
+    juce::File outputFile;
+    juce::MemoryBlock state;          // empty for the batch's default state
+    juce::StringArray parameterSettings; // applied after the state, as id=value
+};
+
+struct WorkerStats
+{
+    int numJobs = 0;
+    int numFailed = 0;
+    int numPrepares = 0;
+    double audioSeconds = 0.0;
+    double processSeconds = 0.0;
+    double setupSeconds = 0.0;
+};
+
+double secondsSince (juce::int64 startTicks)
+{
+    return juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - startTicks);
+}
+
+juce::MemoryBlock loadState (const juce::File& file)
+{
+    juce::MemoryBlock state;
+
+    if (file != juce::File() && ! file.loadFileAsData (state))
+        juce::ConsoleApplication::fail ("Could not read state file: " + file.getFullPathName());
+
+    return state;
+}
+
+BatchOptions parseOptions (const juce::ArgumentList& args)
+{
+    BatchOptions options;
+
+    if (args.containsOption ("--manifest"))
+        options.manifestFile = args.getExistingFileForOption ("--manifest");
+
+    if (args.containsOption ("--spool"))
+        options.spoolFolder = args.getExistingFolderForOption ("--spool");
+
+    if (args.containsOption ("--out-dir"))
+        options.outputFolder = args.getFileForOption ("--out-dir");
+
+    if (args.containsOption ("--state"))
+        options.stateFile = args.getExistingFileForOption ("--state");
+
+    if (args.containsOption ("--samples"))
+        options.sampleFolder = args.getExistingFolderForOption ("--samples");
+
+    if (args.containsOption ("--format"))
+        options.format = args.getValueForOption ("--format") == "f32" ? OutputFormat::rawFloat : OutputFormat::wav;
+
+    if (args.containsOption ("--rate"))
+        options.sampleRate = args.getValueForOption ("--rate").getDoubleValue();
+
+    if (args.containsOption ("--block"))
+        options.blockSize = args.getValueForOption ("--block").getIntValue();
+
+    if (args.containsOption ("--tail"))
+        options.tailSeconds = args.getValueForOption ("--tail").getDoubleValue();
+
+    options.numWorkers = args.containsOption ("--workers") ? args.getValueForOption ("--workers").getIntValue()
+                                                           : juce::SystemStats::getNumCpus();
+
+    if (args.containsOption ("--idle-exit"))
+        options.idleExitSeconds = args.getValueForOption ("--idle-exit").getDoubleValue();
+
+    for (int i = 0; i < args.size() - 1; ++i)
+        if (args[i] == "--set")
+            options.parameterSettings.add (args[i + 1].text);
+
+    if ((options.manifestFile == juce::File()) == (options.spoolFolder == juce::File()))
+        juce::ConsoleApplication::fail ("Pass either --manifest jobs.json or --spool folder");
+
+    if (options.sampleRate < 8000.0 || options.sampleRate > 384000.0)
+        juce::ConsoleApplication::fail ("Sample rate out of range: " + juce::String (options.sampleRate));
+
+    if (options.blockSize < 1 || options.blockSize > 65536)
+        juce::ConsoleApplication::fail ("Block size out of range: " + juce::String (options.blockSize));
+
+    options.numWorkers = juce::jlimit (1, 256, options.numWorkers);
+    return options;
+}
+
+juce::String getOutputExtension (OutputFormat format)
+{
+    return format == OutputFormat::rawFloat ? ".f32" : ".wav";
+}
+
+// [ { "midi": "a.mid", "out": "a.wav", "state": "preset.bin", "set": { "gain": -3 } }, ... ]
+// Relative paths are resolved against the manifest's folder; "out" defaults to the MIDI name in --out-dir.
+juce::Array<Job> readManifest (const BatchOptions& options)
+{
+    const auto root = juce::JSON::parse (options.manifestFile);
+    const auto* entries = root.getArray();
+
+    if (entries == nullptr)
+        juce::ConsoleApplication::fail ("The manifest must be a JSON array of jobs: " + options.manifestFile.getFullPathName());
+
+    const auto folder = options.manifestFile.getParentDirectory();
+    std::map<juce::String, juce::MemoryBlock> states;
+    juce::Array<Job> jobs;
+
+    for (const auto& entry : *entries)
+    {
+        Job job;
+        job.midiFile = folder.getChildFile (entry.getProperty ("midi", {}).toString());
+
+        const auto out = entry.getProperty ("out", {}).toString();
+        job.outputFile = out.isNotEmpty() ? folder.getChildFile (out)
+                                          : options.outputFolder.getChildFile (job.midiFile.getFileNameWithoutExtension()
+                                                                               + getOutputExtension (options.format));
+
+        // Each preset file is read once, however many jobs use it.
+        if (const auto statePath = entry.getProperty ("state", {}).toString(); statePath.isNotEmpty())
+        {
+            auto& state = states[statePath];
+
+            if (state.isEmpty())
+                state = loadState (folder.getChildFile (statePath));
+
+            job.state = state;
+        }
+
+        if (const auto* settings = entry.getProperty ("set", {}).getDynamicObject())
+            for (const auto& setting : settings->getProperties())
+                job.parameterSettings.add (setting.name.toString() + "=" + setting.value.toString());
+
+        jobs.add (std::move (job));
+    }
+
+    return jobs;
+}
+
+// Jobs are handed to whichever worker asks first. Closing the queue lets the workers finish once it is drained.
+class JobQueue
+{
+public:
+    void push (Job job)
+    {
+        {
+            const juce::ScopedLock scopedLock (lock);
+            jobs.push_back (std::move (job));
+        }
+
+        jobAdded.signal();
+    }
+
+    void close()
+    {
+        closed = true;
+        jobAdded.signal();
+    }
+
+    // Blocks until a job is available; returns false once the queue is closed and empty.
+    bool pop (Job& job)
+    {
+        for (;;)
+        {
+            {
+                const juce::ScopedLock scopedLock (lock);
+
+                if (! jobs.empty())
+                {
+                    job = std::move (jobs.front());
+                    jobs.pop_front();
+                    return true;
+                }
+
+                if (closed)
+                {
+                    // Wake the next waiting worker so it can see the queue is closed too.
+                    jobAdded.signal();
+                    return false;
+                }
+            }
+
+            jobAdded.wait (100);
+        }
+    }
+
+    int getNumPending() const
+    {
+        const juce::ScopedLock scopedLock (lock);
+        return static_cast<int> (jobs.size());
+    }
+
+private:
+    juce::CriticalSection lock;
+    std::deque<Job> jobs;
+    std::atomic<bool> closed { false };
+    juce::WaitableEvent jobAdded;
+};
+
+// One processor per worker, constructed and prepared once. A job with the same state and settings as the previous
+// one only needs reset(); a different configuration is applied and the processor prepared again. Either way the
+// output depends only on the job, not on which worker ran it or what that worker rendered before.
+class BatchWorker final : public juce::Thread
+{
+public:
+    BatchWorker (int index, const BatchOptions& batchOptions, JobQueue& jobQueue, std::function<void (const Job&, bool)> onJobDone)
+        : juce::Thread ("Codex Piano batch worker " + juce::String (index)),
+          options (batchOptions), queue (jobQueue), jobDone (std::move (onJobDone))
+    {
+        if (options.sampleFolder != juce::File() && ! processor.loadSampleFolder (options.sampleFolder))
+            juce::ConsoleApplication::fail ("No usable samples in: " + options.sampleFolder.getFullPathName());
+
+        processor.getStateInformation (defaultState);
+        processor.setNonRealtime (true);
+        processor.setPlayConfigDetails (0, 2, options.sampleRate, options.blockSize);
+
+        block.setSize (2, options.blockSize);
+        midi.ensureSize (4096);
+    }
+
+    ~BatchWorker() override
+    {
+        stopThread (10000);
+    }
+
+    const WorkerStats& getStats() const noexcept { return stats; }
+
+    void run() override
+    {
+        Job job;
+
+        while (! threadShouldExit() && queue.pop (job))
+        {
+            const auto succeeded = renderJob (job);
+            ++stats.numJobs;
+            stats.numFailed += succeeded ? 0 : 1;
+            jobDone (job, succeeded);
+        }
+
+        if (prepared)
+            processor.releaseResources();
+    }
+
+private:
+    bool renderJob (const Job& job)
+    {
+        const auto setupStart = juce::Time::getHighResolutionTicks();
+
+        juce::MidiMessageSequence sequence;
+
+        if (! readMidi (job.midiFile, sequence))
+        {
+            std::cerr << "Could not read MIDI file: " << job.midiFile.getFullPathName() << std::endl;
+            return false;
+        }
+
+        configure (job);
+
+        const auto tailSeconds = options.tailSeconds >= 0.0 ? options.tailSeconds : processor.getTailLengthSeconds();
+        const auto totalSamples = static_cast<int> (std::ceil ((sequence.getEndTime() + tailSeconds) * options.sampleRate));
+
+        // Grows to the longest job seen and is then reused.
+        output.setSize (2, totalSamples, false, false, true);
+        stats.setupSeconds += secondsSince (setupStart);
+
+        auto& telemetry = processor.getTelemetry();
+        int nextEvent = 0;
+
+        // As in CodexPianoRender, the reported latency is rendered on and then cut from the start.
+        const auto latency = processor.getLatencySamples();
+
+        for (int position = 0; position < totalSamples + latency; position += options.blockSize)
+        {
+            const auto numSamples = juce::jmin (options.blockSize, totalSamples + latency - position);
+            const auto blockEnd = position + numSamples;
+
+            midi.clear();
+
+            while (nextEvent < sequence.getNumEvents())
+            {
+                const auto& message = sequence.getEventPointer (nextEvent)->message;
+                const auto samplePosition = static_cast<int> (std::round (message.getTimeStamp() * options.sampleRate));
+
+                if (samplePosition >= blockEnd)
+                    break;
+
+                if (! message.isMetaEvent())
+                    midi.addEvent (message, juce::jmax (0, samplePosition - position));
+
+                ++nextEvent;
+            }
+
+            juce::AudioBuffer<float> view (block.getArrayOfWritePointers(), 2, numSamples);
+
+            const auto start = juce::Time::getHighResolutionTicks();
+            processor.processBlock (view, midi);
+            stats.processSeconds += secondsSince (start);
+
+            // No message loop runs here, so the telemetry is drained by hand.
+            telemetry.collect();
+
+            const auto skip = juce::jmax (0, latency - position);
+
+            for (int ch = 0; ch < 2 && skip < numSamples; ++ch)
+                output.copyFrom (ch, position + skip - latency, view, ch, skip, numSamples - skip);
+        }
+
+        stats.audioSeconds += totalSamples / options.sampleRate;
+        return write (job.outputFile, totalSamples);
+    }
+
+    void configure (const Job& job)
+    {
+        const auto& state = job.state.isEmpty() ? defaultState : job.state;
+        const auto configuration = state.toBase64Encoding() + job.parameterSettings.joinIntoString (";");
+
+        if (prepared && configuration == currentConfiguration)
+        {
+            processor.reset();
+            return;
+        }
+
+        processor.setStateInformation (state.getData(), static_cast<int> (state.getSize()));
+
+        for (const auto& setting : options.parameterSettings)
+            applySetting (setting);
+
+        for (const auto& setting : job.parameterSettings)
+            applySetting (setting);
+
+        // Jobs run side by side, one per core, so each render stays on its worker's thread.
+        applySetting ("renderThreads=1");
+
+        processor.prepareToPlay (options.sampleRate, options.blockSize);
+        currentConfiguration = configuration;
+        prepared = true;
+        ++stats.numPrepares;
+    }
+
+    void applySetting (const juce::String& setting)
+    {
+        const auto id = setting.upToFirstOccurrenceOf ("=", false, false).trim();
+
+        if (auto* parameter = processor.apvts.getParameter (id))
+            parameter->setValueNotifyingHost (parameter->convertTo0to1 (setting.fromFirstOccurrenceOf ("=", false, false).getFloatValue()));
+        else
+            std::cerr << "Unknown parameter: " << id << std::endl;
+    }
+
+    static bool readMidi (const juce::File& file, juce::MidiMessageSequence& sequence)
+    {
+        juce::FileInputStream stream (file);
+        juce::MidiFile midiFile;
+
+        if (! stream.openedOk() || ! midiFile.readFrom (stream))
+            return false;
+
+        midiFile.convertTimestampTicksToSeconds();
+
+        for (int t = 0; t < midiFile.getNumTracks(); ++t)
+            sequence.addSequence (*midiFile.getTrack (t), 0.0);
+
+        sequence.updateMatchedPairs();
+        return true;
+    }
+
+    bool write (const juce::File& file, int numSamples)
+    {
+        file.getParentDirectory().createDirectory();
+        file.deleteFile();
+        auto stream = file.createOutputStream();
+
+        if (stream == nullptr)
+        {
+            std::cerr << "Could not write: " << file.getFullPathName() << std::endl;
+            return false;
+        }
+
+        if (options.format == OutputFormat::rawFloat)
+        {
+            // Interleaved little-endian 32-bit float, no header.
+            for (int i = 0; i < numSamples; ++i)
+                for (int ch = 0; ch < output.getNumChannels(); ++ch)
+                    stream->writeFloat (output.getSample (ch, i));
+
+            return ! stream->getStatus().failed();
+        }
+
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (stream.get(), options.sampleRate,
+                                                                              static_cast<unsigned int> (output.getNumChannels()),
+                                                                              32, {}, 0));
+
+        if (writer == nullptr)
+            return false;
+
+        stream.release();
+        return writer->writeFromAudioSampleBuffer (output, 0, numSamples);
+    }
+
+    const BatchOptions& options;
+    JobQueue& queue;
+    std::function<void (const Job&, bool)> jobDone;
+
+    CodexPianoVST3AudioProcessor processor;
+    juce::MemoryBlock defaultState;
+    juce::String currentConfiguration;
+    bool prepared = false;
+
+    juce::AudioBuffer<float> block, output;
+    juce::MidiBuffer midi;
+    WorkerStats stats;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (BatchWorker)
+};
+
+// Spool mode: MIDI files dropped into the folder are claimed by moving them to working/, so several batch processes
+// can share one spool, and end up in done/ or failed/.
+class Spool
+{
+public:
+    explicit Spool (const juce::File& spoolFolder)
+        : folder (spoolFolder),
+          working (folder.getChildFile ("working")),
+          done (folder.getChildFile ("done")),
+          failed (folder.getChildFile ("failed"))
+    {
+        for (const auto& child : { working, done, failed })
+            if (! child.createDirectory())
+                juce::ConsoleApplication::fail ("Could not create: " + child.getFullPathName());
+    }
+
+    // Claims every MIDI file currently waiting; returns how many were queued.
+    int claim (JobQueue& queue, const BatchOptions& options)
+    {
+        int numClaimed = 0;
+
+        for (const auto& file : folder.findChildFiles (juce::File::findFiles, false, "*.mid;*.midi"))
+        {
+            const auto claimed = working.getChildFile (file.getFileName());
+
+            if (! file.moveFileTo (claimed))
+                continue;
+
+            Job job;
+            job.midiFile = claimed;
+            job.outputFile = options.outputFolder.getChildFile (file.getFileNameWithoutExtension() + getOutputExtension (options.format));
+            queue.push (std::move (job));
+            ++numClaimed;
+        }
+
+        return numClaimed;
+    }
+
+    void finish (const Job& job, bool succeeded)
+    {
+        job.midiFile.moveFileTo ((succeeded ? done : failed).getChildFile (job.midiFile.getFileName()));
+    }
+
+private:
+    juce::File folder, working, done, failed;
+};
+
+int runBatch (const juce::ArgumentList& args)
+{
+    auto options = parseOptions (args);
+
+    if (options.outputFolder == juce::File())
+        options.outputFolder = options.spoolFolder != juce::File() ? options.spoolFolder.getChildFile ("out")
+                                                                   : juce::File::getCurrentWorkingDirectory();
+
+    JobQueue queue;
+    std::unique_ptr<Spool> spool;
+
+    if (options.spoolFolder != juce::File())
+        spool = std::make_unique<Spool> (options.spoolFolder);
+
+    // Workers are built up front, so per-job cost is only the state check, reset and rendering itself.
+    const auto constructionStart = juce::Time::getHighResolutionTicks();
+    std::atomic<int> numFinished { 0 };
+    std::vector<std::unique_ptr<BatchWorker>> workers;
+
+    for (int i = 0; i < options.numWorkers; ++i)
+        workers.push_back (std::make_unique<BatchWorker> (i, options, queue, [&spool, &numFinished] (const Job& job, bool succeeded)
+        {
+            if (spool != nullptr)
+                spool->finish (job, succeeded);
+
+            ++numFinished;
+        }));
+
+    std::cout << options.numWorkers << " workers ready in " << juce::String (secondsSince (constructionStart) * 1000.0, 1)
+              << " ms" << std::endl;
+
+    const auto batchStart = juce::Time::getHighResolutionTicks();
+
+    for (auto& worker : workers)
+        worker->startThread();
+
+    if (spool == nullptr)
+    {
+        for (auto& job : readManifest (options))
+            queue.push (std::move (job));
+    }
+    else
+    {
+        // Polls until the spool has been empty and the workers idle for --idle-exit seconds; forever without it.
+        auto idleSince = juce::Time::getMillisecondCounterHiRes();
+
+        for (;;)
+        {
+            if (spool->claim (queue, options) > 0 || queue.getNumPending() > 0)
+                idleSince = juce::Time::getMillisecondCounterHiRes();
+
+            if (options.idleExitSeconds >= 0.0 && juce::Time::getMillisecondCounterHiRes() - idleSince > options.idleExitSeconds * 1000.0)
+                break;
+
+            juce::Thread::sleep (250);
+        }
+    }
+
+    queue.close();
+
+    for (auto& worker : workers)
+        worker->stopThread (-1);
+
+    const auto wallSeconds = secondsSince (batchStart);
+    WorkerStats total;
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        const auto& stats = workers[i]->getStats();
+        total.numJobs += stats.numJobs;
+        total.numFailed += stats.numFailed;
+        total.numPrepares += stats.numPrepares;
+        total.audioSeconds += stats.audioSeconds;
+        total.processSeconds += stats.processSeconds;
+        total.setupSeconds += stats.setupSeconds;
+
+        std::cout << "Worker " << i + 1 << ": " << stats.numJobs << " jobs, " << juce::String (stats.audioSeconds, 1)
+                  << " s audio, real-time factor " << juce::String (stats.audioSeconds / juce::jmax (stats.processSeconds, 1.0e-9), 1)
+                  << "x, setup " << juce::String (stats.setupSeconds * 1000.0 / juce::jmax (1, stats.numJobs), 2) << " ms/job ("
+                  << stats.numPrepares << " prepares)" << std::endl;
+    }
+
+    std::cout << "Total: " << total.numJobs << " jobs (" << total.numFailed << " failed) in " << juce::String (wallSeconds, 2)
+              << " s, " << juce::String (total.numJobs / juce::jmax (wallSeconds, 1.0e-9), 1) << " jobs/s, "
+              << juce::String (total.audioSeconds / juce::jmax (wallSeconds, 1.0e-9), 1) << "x real time overall" << std::endl;
+
+    jassert (numFinished == total.numJobs);
+    return total.numFailed > 0 ? 1 : 0;
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    int batchResult = 0;
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "Usage: CodexPianoBatch (--manifest jobs.json | --spool folder [--idle-exit seconds]) "
+                                     "[--out-dir folder] [--format wav|f32] [--workers cores] [--rate 48000] [--block 512] "
+                                     "[--tail seconds] [--state preset.bin] [--set id=value]... [--samples folder]", true);
+    app.addDefaultCommand ({ "--manifest", "--manifest jobs.json", "Renders many MIDI files in parallel, one processor per core", {},
+                             [&batchResult] (const juce::ArgumentList& args) { batchResult = runBatch (args); } });
+
+    const auto commandResult = app.findAndRunCommand (argc, argv);
+    return commandResult != 0 ? commandResult : batchResult;
+}
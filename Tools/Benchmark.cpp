@@ -0,0 +1,707 @@
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+namespace
+{
+struct BenchCase
+{
+    juce::String suite;
+    int voices = 0;
+    int blockSize = 512;
+    double sampleRate = 48000.0;
+    int eventsPerBlock = 0;
+    int eventGrid = 0; // VoiceManager event quantisation, 0 being sample-accurate
+    double irSeconds = 0.0; // convolution suite only
+    double releaseSeconds = -1.0; // release suites only: how long after the notes were released the timing starts
+    int routes = -1; // modulation suite only: routes in the modulation matrix
+
+    juce::String getKey() const
+    {
+        // The grid suffix is left off for sample-accurate cases so older baselines still match.
+        return suite + "/v" + juce::String (voices) + "/b" + juce::String (blockSize)
+             + "/sr" + juce::String (juce::roundToInt (sampleRate)) + "/e" + juce::String (eventsPerBlock)
+             + (eventGrid > 0 ? "/q" + juce::String (eventGrid) : juce::String())
+             + (irSeconds > 0.0 ? "/ir" + juce::String (irSeconds) : juce::String())
+             + (releaseSeconds >= 0.0 ? "/r" + juce::String (releaseSeconds) : juce::String())
+             + (routes >= 0 ? "/m" + juce::String (routes) : juce::String());
+    }
+};
+
+struct BenchResult
+{
+    BenchCase benchCase;
+    double nsPerSample = 0.0; // state suites: ns per setStateInformation call
+    double cyclesPerVoiceSample = 0.0;
+    int peakVoices = 0; // pedal suites only
+    double worstBlockMicros = 0.0; // convolution suite only: the slowest single process call
+};
+
+struct BenchOptions
+{
+    juce::StringArray suites { "voice-simd", "voice-scalar", "process", "process-pipelined", "process-offline", "reverb",
+                               "convolution", "release", "release-full", "pedal", "pedal-modal", "program-switch", "state-xml",
+                               "state-binary", "modulation", "mpe" };
+    double audioSeconds = 2.0;
+    juce::File jsonFile;
+    juce::File baselineFile;
+    double maxRegressionPercent = 10.0;
+};
+
+class Stopwatch
+{
+public:
+    void start() noexcept { startTicks = juce::Time::getHighResolutionTicks(); }
+    void stop() noexcept { elapsedTicks += juce::Time::getHighResolutionTicks() - startTicks; }
+    double getSeconds() const noexcept { return juce::Time::highResolutionTicksToSeconds (elapsedTicks); }
+
+private:
+    juce::int64 startTicks = 0;
+    juce::int64 elapsedTicks = 0;
+};
+
+// Spreads voices over distinct keys (and channels beyond 88) so none of them retrigger each other.
+void addNoteOns (juce::MidiBuffer& midi, int numVoices)
+{
+    for (int i = 0; i < numVoices; ++i)
+        midi.addEvent (juce::MidiMessage::noteOn (1 + i / 88, 21 + i % 88, 0.8f), 0);
+}
+
+// Evenly spaced note-on/note-off pairs on a key the sustained voices don't use. Controller events would not do,
+// as the voice manager skips events that can't change a voice without splitting the block.
+void addNoteEvents (juce::MidiBuffer& midi, int numEvents, int blockSize)
+{
+    for (int i = 0; i < numEvents; ++i)
+    {
+        const auto position = (i * blockSize) / juce::jmax (1, numEvents);
+        midi.addEvent (i % 2 == 0 ? juce::MidiMessage::noteOn (16, 120, 0.5f) : juce::MidiMessage::noteOff (16, 120), position);
+    }
+}
+
+int getNumBlocks (const BenchCase& benchCase, double audioSeconds)
+{
+    return juce::jmax (1, static_cast<int> (audioSeconds * benchCase.sampleRate / benchCase.blockSize));
+}
+
+double measureVoices (const BenchCase& benchCase, double audioSeconds, bool vectorised)
+{
+    VoiceManager voices;
+    voices.setCurrentPlaybackSampleRate (benchCase.sampleRate);
+    voices.prepareScratch (benchCase.blockSize, 1);
+    voices.setMaxPolyphony (benchCase.voices);
+    voices.setVectorisedRendering (vectorised);
+    voices.setEventQuantisation (benchCase.eventGrid);
+    voices.updateVoiceParameters (0.55f, 1.0f);
+
+    juce::MidiBuffer midi;
+    addNoteOns (midi, benchCase.voices);
+
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+    buffer.clear();
+    voices.renderNextBlock (buffer, midi, 0, benchCase.blockSize);
+
+    midi.clear();
+    addNoteEvents (midi, benchCase.eventsPerBlock, benchCase.blockSize);
+
+    const auto numBlocks = getNumBlocks (benchCase, audioSeconds);
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        buffer.clear();
+        stopwatch.start();
+        voices.renderNextBlock (buffer, midi, 0, benchCase.blockSize);
+        stopwatch.stop();
+    }
+
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// Holds the voices for half a second, releases them all and then times a quarter of a second starting the case's
+// release time later, so successive cases show how the cost of a voice falls as its note dies away.
+double measureRelease (const BenchCase& benchCase, bool levelOfDetail)
+{
+    static constexpr double holdSeconds = 0.5;
+    static constexpr double windowSeconds = 0.25;
+
+    VoiceManager voices;
+    voices.setCurrentPlaybackSampleRate (benchCase.sampleRate);
+    voices.prepareScratch (benchCase.blockSize, 1);
+    voices.setMaxPolyphony (benchCase.voices);
+    voices.setDetailFloor (levelOfDetail ? juce::Decibels::decibelsToGain (-80.0f) : 0.0f);
+    voices.updateVoiceParameters (0.55f, 0.3f);
+
+    juce::MidiBuffer midi;
+    addNoteOns (midi, benchCase.voices);
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+
+    auto render = [&] (double seconds, Stopwatch* stopwatch)
+    {
+        const auto numBlocks = juce::jmax (1, static_cast<int> (seconds * benchCase.sampleRate / benchCase.blockSize));
+
+        for (int i = 0; i < numBlocks; ++i)
+        {
+            buffer.clear();
+
+            if (stopwatch != nullptr)
+                stopwatch->start();
+
+            voices.renderNextBlock (buffer, midi, 0, benchCase.blockSize);
+
+            if (stopwatch != nullptr)
+                stopwatch->stop();
+
+            midi.clear();
+        }
+
+        return numBlocks;
+    };
+
+    render (holdSeconds, nullptr);
+    voices.allNotesOff (true);
+
+    if (benchCase.releaseSeconds > 0.0)
+        render (benchCase.releaseSeconds, nullptr);
+
+    Stopwatch stopwatch;
+    const auto numBlocks = render (windowSeconds, &stopwatch);
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// Sustain pedal down for the whole run while the case's number of keys are trilled, eventsPerBlock strikes per
+// block. Every strike would add a voice if keys weren't re-struck in place or limited per key, so the peak voice
+// count shows whether the cost stays bounded. The modal engine can't re-strike in place, so it tests the limit.
+double measurePedal (const BenchCase& benchCase, double audioSeconds, bool modal, int& peakVoices)
+{
+    VoiceManager voices;
+    ModalResonatorBank modalBank;
+    modalBank.prepare (benchCase.sampleRate, VoiceManager::maxVoices);
+
+    voices.setCurrentPlaybackSampleRate (benchCase.sampleRate);
+    voices.prepareScratch (benchCase.blockSize, 1);
+    voices.setMaxPolyphony (VoiceManager::maxVoices);
+    voices.setLaneSource (VoiceBank::Oscillator::modal, &modalBank);
+    voices.setOscillator (modal ? VoiceBank::Oscillator::modal : VoiceBank::Oscillator::additive);
+    voices.updateVoiceParameters (0.55f, 1.0f);
+
+    juce::MidiBuffer midi;
+    midi.addEvent (juce::MidiMessage::controllerEvent (1, 64, 127), 0);
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+
+    const auto numBlocks = getNumBlocks (benchCase, audioSeconds);
+    const auto spacing = juce::jmax (1, benchCase.blockSize / juce::jmax (1, benchCase.eventsPerBlock));
+    int strike = 0;
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        for (int e = 0; e < benchCase.eventsPerBlock; ++e, ++strike)
+        {
+            const auto key = 60 + strike % benchCase.voices;
+            midi.addEvent (juce::MidiMessage::noteOn (1, key, 0.4f + 0.1f * static_cast<float> (strike % 5)), e * spacing);
+            midi.addEvent (juce::MidiMessage::noteOff (1, key), e * spacing + spacing / 2);
+        }
+
+        buffer.clear();
+        stopwatch.start();
+        voices.renderNextBlock (buffer, midi, 0, benchCase.blockSize);
+        stopwatch.stop();
+
+        peakVoices = juce::jmax (peakVoices, voices.getNumActiveVoices());
+        midi.clear();
+    }
+
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// Voice rendering with per-voice modulation. The modulation suite holds the notes under a growing number of routes;
+// the mpe suite spreads them over the member channels of an MPE zone and moves every channel's bend, pressure and
+// timbre once per block, through the default pressure and timbre routes.
+double measureModulation (const BenchCase& benchCase, double audioSeconds)
+{
+    static constexpr ModulationMatrix::Route routes[] = { { ModulationMatrix::lfo, ModulationMatrix::pitch, 0.01f },
+                                                          { ModulationMatrix::velocity, ModulationMatrix::brightness, 0.2f },
+                                                          { ModulationMatrix::envelope, ModulationMatrix::decay, 0.3f },
+                                                          { ModulationMatrix::key, ModulationMatrix::decay, -0.2f },
+                                                          { ModulationMatrix::envelope, ModulationMatrix::brightness, 0.4f },
+                                                          { ModulationMatrix::lfo, ModulationMatrix::brightness, 0.1f } };
+    static constexpr int numMemberChannels = 15;
+    const auto mpe = benchCase.suite == "mpe";
+
+    VoiceManager voices;
+    voices.setCurrentPlaybackSampleRate (benchCase.sampleRate);
+    voices.prepareScratch (benchCase.blockSize, 1);
+    voices.setMaxPolyphony (benchCase.voices);
+    voices.updateVoiceParameters (0.55f, 1.0f);
+    voices.setMpeEnabled (mpe);
+
+    ModulationMatrix matrix;
+
+    if (mpe)
+    {
+        matrix.addRoute (ModulationMatrix::pressure, ModulationMatrix::brightness, 0.5f);
+        matrix.addRoute (ModulationMatrix::timbre, ModulationMatrix::brightness, 0.3f);
+    }
+
+    for (int r = 0; r < juce::jmin (benchCase.routes, static_cast<int> (std::size (routes))); ++r)
+        matrix.addRoute (routes[r].source, routes[r].destination, routes[r].amount);
+
+    voices.setModulation (matrix);
+
+    juce::MidiBuffer midi;
+
+    if (mpe)
+        for (int i = 0; i < benchCase.voices; ++i)
+            midi.addEvent (juce::MidiMessage::noteOn (2 + i % numMemberChannels, 21 + (i / numMemberChannels) % 88, 0.8f), 0);
+    else
+        addNoteOns (midi, benchCase.voices);
+
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+    buffer.clear();
+    voices.renderNextBlock (buffer, midi, 0, benchCase.blockSize);
+    midi.clear();
+
+    const auto numBlocks = getNumBlocks (benchCase, audioSeconds);
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        if (mpe)
+        {
+            midi.clear();
+
+            for (int ch = 0; ch < numMemberChannels; ++ch)
+            {
+                const auto position = (ch * benchCase.blockSize) / numMemberChannels;
+                const auto swing = std::sin (0.05 * (i + ch));
+                midi.addEvent (juce::MidiMessage::pitchWheel (2 + ch, 8192 + juce::roundToInt (2000.0 * swing)), position);
+                midi.addEvent (juce::MidiMessage::channelPressureChange (2 + ch, 64 + juce::roundToInt (40.0 * swing)), position);
+                midi.addEvent (juce::MidiMessage::controllerEvent (2 + ch, 74, 64 - juce::roundToInt (30.0 * swing)), position);
+            }
+        }
+
+        buffer.clear();
+        stopwatch.start();
+        voices.renderNextBlock (buffer, midi, 0, benchCase.blockSize);
+        stopwatch.stop();
+    }
+
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// Full processBlock for the process suites and program-switch. process-offline renders as a bounce would, in the
+// offline quality tier; the others are real-time.
+double measureProcessBlock (const BenchCase& benchCase, double audioSeconds)
+{
+    const auto pipelined = benchCase.suite == "process-pipelined";
+    const auto offline = benchCase.suite == "process-offline";
+    const auto switchPrograms = benchCase.suite == "program-switch";
+
+    CodexPianoVST3AudioProcessor processor;
+    processor.apvts.getParameter ("pipelineEffects")->setValueNotifyingHost (pipelined ? 1.0f : 0.0f);
+
+    auto* quality = processor.apvts.getParameter ("quality");
+    quality->setValueNotifyingHost (quality->convertTo0to1 (offline ? 2.0f : 1.0f));
+    processor.setNonRealtime (offline);
+
+    if (auto* polyphony = processor.apvts.getParameter ("polyphony"))
+        polyphony->setValueNotifyingHost (polyphony->convertTo0to1 (static_cast<float> (juce::jmax (1, benchCase.voices))));
+
+    if (auto* eventGrid = processor.apvts.getParameter ("eventGrid"))
+    {
+        // Choices are sample-accurate, 8, 16 and 32 samples.
+        const auto choice = benchCase.eventGrid >= 32 ? 3 : benchCase.eventGrid >= 16 ? 2 : benchCase.eventGrid >= 8 ? 1 : 0;
+        eventGrid->setValueNotifyingHost (eventGrid->convertTo0to1 (static_cast<float> (choice)));
+    }
+
+    processor.setPlayConfigDetails (0, 2, benchCase.sampleRate, benchCase.blockSize);
+    processor.prepareToPlay (benchCase.sampleRate, benchCase.blockSize);
+
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+    juce::MidiBuffer midi;
+    addNoteOns (midi, benchCase.voices);
+    processor.processBlock (buffer, midi);
+
+    const auto numBlocks = getNumBlocks (benchCase, audioSeconds);
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        midi.clear();
+        addNoteEvents (midi, benchCase.eventsPerBlock, benchCase.blockSize);
+
+        // Programs 0 and 1 differ in engine and every sound parameter, so each switch recomputes everything.
+        if (switchPrograms)
+            processor.setCurrentProgram (i % 2 == 0 ? 1 : 0);
+
+        stopwatch.start();
+        processor.processBlock (buffer, midi);
+        stopwatch.stop();
+    }
+
+    processor.releaseResources();
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// Time to restore a session: the current binary state, or the XML one older versions saved.
+double measureStateLoad (double audioSeconds, bool binary)
+{
+    CodexPianoVST3AudioProcessor processor;
+    juce::MemoryBlock state;
+
+    if (binary)
+    {
+        processor.getStateInformation (state);
+    }
+    else
+    {
+        const auto xml = processor.apvts.copyState().createXml();
+        juce::AudioProcessor::copyXmlToBinary (*xml, state);
+    }
+
+    const auto numLoads = juce::jmax (1, static_cast<int> (audioSeconds * 1000.0));
+    Stopwatch stopwatch;
+    stopwatch.start();
+
+    for (int i = 0; i < numLoads; ++i)
+        processor.setStateInformation (state.getData(), static_cast<int> (state.getSize()));
+
+    stopwatch.stop();
+    return stopwatch.getSeconds() * 1.0e9 / numLoads;
+}
+
+double measureReverb (const BenchCase& benchCase, double audioSeconds)
+{
+    juce::Reverb reverb;
+    reverb.setSampleRate (benchCase.sampleRate);
+
+    juce::Reverb::Parameters params;
+    params.roomSize = 0.55f;
+    params.wetLevel = 0.2f;
+    params.dryLevel = 0.8f;
+    reverb.setParameters (params);
+
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+    juce::Random random (1);
+
+    for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < benchCase.blockSize; ++i)
+            buffer.setSample (ch, i, random.nextFloat() * 0.5f - 0.25f);
+
+    const auto numBlocks = getNumBlocks (benchCase, audioSeconds);
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        stopwatch.start();
+        reverb.processStereo (buffer.getWritePointer (0), buffer.getWritePointer (1), benchCase.blockSize);
+        stopwatch.stop();
+    }
+
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// Loads a generated room of the case's length through the same file path a user-chosen response takes. The slowest
+// block shows how evenly the work is spread, which is what decides whether small host buffers make their deadline.
+double measureConvolution (const BenchCase& benchCase, double audioSeconds, double& worstBlockMicros)
+{
+    const auto irFile = juce::File::getSpecialLocation (juce::File::tempDirectory)
+                            .getChildFile ("CodexPianoBench_ir_" + juce::String (benchCase.irSeconds) + ".wav");
+    {
+        const auto room = ImpulseResponse::makeRoom (benchCase.sampleRate, benchCase.irSeconds);
+        irFile.deleteFile();
+        auto stream = irFile.createOutputStream();
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (stream.get(), benchCase.sampleRate, 2, 32, {}, 0));
+
+        if (writer == nullptr)
+            juce::ConsoleApplication::fail ("Could not write: " + irFile.getFullPathName());
+
+        stream.release();
+        writer->writeFromAudioSampleBuffer (room, 0, room.getNumSamples());
+    }
+
+    ConvolutionReverb convolution;
+    convolution.loadImpulseResponse (irFile);
+    convolution.prepare (benchCase.sampleRate);
+    convolution.setLevels (0.8f, 0.2f);
+
+    juce::AudioBuffer<float> buffer (2, benchCase.blockSize);
+    juce::Random random (1);
+    const auto numBlocks = getNumBlocks (benchCase, audioSeconds);
+    Stopwatch stopwatch;
+
+    for (int i = 0; i < numBlocks; ++i)
+    {
+        for (int ch = 0; ch < 2; ++ch)
+            for (int n = 0; n < benchCase.blockSize; ++n)
+                buffer.setSample (ch, n, random.nextFloat() * 0.5f - 0.25f);
+
+        const auto blockStart = juce::Time::getHighResolutionTicks();
+        stopwatch.start();
+        convolution.process (buffer.getWritePointer (0), buffer.getWritePointer (1), benchCase.blockSize);
+        stopwatch.stop();
+
+        // The first blocks also fault the engine's buffers in, so they don't count.
+        if (i >= 16)
+            worstBlockMicros = juce::jmax (worstBlockMicros, 1.0e6 * juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - blockStart));
+    }
+
+    convolution.release();
+    irFile.deleteFile();
+    return stopwatch.getSeconds() * 1.0e9 / (static_cast<double> (numBlocks) * benchCase.blockSize);
+}
+
+// One axis is swept at a time around a 64-voice, 512-sample, 48 kHz centre point.
+juce::Array<BenchCase> makeCases (const juce::String& suite)
+{
+    juce::Array<BenchCase> cases;
+
+    // The release suites only sweep time since release, with and without the level of detail.
+    if (suite.startsWith ("release"))
+    {
+        for (const auto seconds : { 0.0, 0.5, 1.0, 2.0, 3.0, 4.0, 6.0 })
+            cases.add ({ suite, 64, 512, 48000.0, 0, 0, 0.0, seconds });
+
+        return cases;
+    }
+
+    // One load per state format.
+    if (suite.startsWith ("state"))
+    {
+        cases.add ({ suite, 0, 0, 48000.0 });
+        return cases;
+    }
+
+    // Program switching, once per block, only sweeps the voice count.
+    if (suite == "program-switch")
+    {
+        for (const auto voices : { 1, 16, 64, 256 })
+            cases.add ({ suite, voices, 512, 48000.0 });
+
+        return cases;
+    }
+
+    // Modulation sweeps the route count on 64 held voices, mpe the number of voices sharing the zone's channels.
+    if (suite == "modulation")
+    {
+        for (int routes = 0; routes <= 6; ++routes)
+            cases.add ({ suite, 64, 512, 48000.0, 0, 0, 0.0, -1.0, routes });
+
+        return cases;
+    }
+
+    if (suite == "mpe")
+    {
+        for (const auto voices : { 1, 16, 64, 256 })
+            cases.add ({ suite, voices, 512, 48000.0, 45 });
+
+        return cases;
+    }
+
+    // The pedal suites sweep the number of trilled keys and strikes per block.
+    if (suite.startsWith ("pedal"))
+    {
+        for (const auto keys : { 2, 8, 32 })
+            for (const auto strikes : { 1, 4, 16 })
+                cases.add ({ suite, keys, 512, 48000.0, strikes });
+
+        return cases;
+    }
+
+    const auto usesVoices = suite != "reverb" && suite != "convolution";
+    const auto irSeconds = suite == "convolution" ? 2.0 : 0.0;
+
+    auto add = [&] (int voices, int blockSize, double sampleRate, int events, int grid = 0)
+    {
+        cases.add ({ suite, usesVoices ? voices : 0, blockSize, sampleRate, events, grid, irSeconds });
+    };
+
+    // Cost against impulse response length; the other axes below use a 2 s response.
+    if (suite == "convolution")
+        for (const auto seconds : { 0.25, 0.5, 1.0, 4.0, 8.0 })
+            cases.add ({ suite, 0, 512, 48000.0, 0, 0, seconds });
+
+    if (usesVoices)
+        for (const auto voices : { 1, 4, 16, 64, 128, 256 })
+            add (voices, 512, 48000.0, 0);
+
+    for (const auto blockSize : { 16, 64, 256, 1024, 4096 })
+        add (64, blockSize, 48000.0, 0);
+
+    for (const auto sampleRate : { 44100.0, 96000.0, 192000.0 })
+        add (64, 512, sampleRate, 0);
+
+    // Event density is swept once per event timing mode.
+    if (usesVoices)
+        for (const auto grid : { 0, 8, 16, 32 })
+            for (const auto events : { 1, 10, 100, 1000 })
+                add (64, 512, 48000.0, events, grid);
+
+    return cases;
+}
+
+BenchResult runCase (const BenchCase& benchCase, double audioSeconds)
+{
+    BenchResult result;
+    result.benchCase = benchCase;
+
+    if (benchCase.suite == "voice-simd")
+        result.nsPerSample = measureVoices (benchCase, audioSeconds, true);
+    else if (benchCase.suite == "voice-scalar")
+        result.nsPerSample = measureVoices (benchCase, audioSeconds, false);
+    else if (benchCase.suite.startsWith ("process") || benchCase.suite == "program-switch")
+        result.nsPerSample = measureProcessBlock (benchCase, audioSeconds);
+    else if (benchCase.suite == "state-xml")
+        result.nsPerSample = measureStateLoad (audioSeconds, false);
+    else if (benchCase.suite == "state-binary")
+        result.nsPerSample = measureStateLoad (audioSeconds, true);
+    else if (benchCase.suite == "release")
+        result.nsPerSample = measureRelease (benchCase, true);
+    else if (benchCase.suite == "release-full")
+        result.nsPerSample = measureRelease (benchCase, false);
+    else if (benchCase.suite == "pedal")
+        result.nsPerSample = measurePedal (benchCase, audioSeconds, false, result.peakVoices);
+    else if (benchCase.suite == "pedal-modal")
+        result.nsPerSample = measurePedal (benchCase, audioSeconds, true, result.peakVoices);
+    else if (benchCase.suite == "modulation" || benchCase.suite == "mpe")
+        result.nsPerSample = measureModulation (benchCase, audioSeconds);
+    else if (benchCase.suite == "convolution")
+        result.nsPerSample = measureConvolution (benchCase, audioSeconds, result.worstBlockMicros);
+    else
+        result.nsPerSample = measureReverb (benchCase, audioSeconds);
+
+    const auto cyclesPerNs = juce::SystemStats::getCpuSpeedInMegahertz() / 1000.0;
+    result.cyclesPerVoiceSample = result.nsPerSample * cyclesPerNs / juce::jmax (1, benchCase.voices);
+    return result;
+}
+
+juce::var toJson (const juce::Array<BenchResult>& results)
+{
+    juce::Array<juce::var> entries;
+
+    for (const auto& result : results)
+    {
+        auto* entry = new juce::DynamicObject();
+        entry->setProperty ("key", result.benchCase.getKey());
+        entry->setProperty ("suite", result.benchCase.suite);
+        entry->setProperty ("voices", result.benchCase.voices);
+        entry->setProperty ("blockSize", result.benchCase.blockSize);
+        entry->setProperty ("sampleRate", result.benchCase.sampleRate);
+        entry->setProperty ("eventsPerBlock", result.benchCase.eventsPerBlock);
+        entry->setProperty ("eventGrid", result.benchCase.eventGrid);
+        entry->setProperty ("irSeconds", result.benchCase.irSeconds);
+        entry->setProperty ("releaseSeconds", result.benchCase.releaseSeconds);
+        entry->setProperty ("routes", result.benchCase.routes);
+        entry->setProperty ("nsPerSample", result.nsPerSample);
+        entry->setProperty ("cyclesPerVoiceSample", result.cyclesPerVoiceSample);
+        entry->setProperty ("peakVoices", result.peakVoices);
+        entry->setProperty ("worstBlockMicros", result.worstBlockMicros);
+        entries.add (juce::var (entry));
+    }
+
+    auto* root = new juce::DynamicObject();
+    root->setProperty ("cpu", juce::SystemStats::getCpuModel());
+    root->setProperty ("cpuMHz", juce::SystemStats::getCpuSpeedInMegahertz());
+    root->setProperty ("os", juce::SystemStats::getOperatingSystemName());
+    root->setProperty ("results", entries);
+    return juce::var (root);
+}
+
+// Prints the change against each baseline entry and returns how many cases got slower than allowed.
+int compareWithBaseline (const juce::Array<BenchResult>& results, const juce::File& file, double maxRegressionPercent)
+{
+    const auto baseline = juce::JSON::parse (file);
+    const auto* entries = baseline.getProperty ("results", {}).getArray();
+
+    if (entries == nullptr)
+        juce::ConsoleApplication::fail ("Not a benchmark result file: " + file.getFullPathName());
+
+    int numRegressions = 0;
+
+    for (const auto& result : results)
+    {
+        for (const auto& entry : *entries)
+        {
+            if (entry.getProperty ("key", {}).toString() != result.benchCase.getKey())
+                continue;
+
+            const auto before = static_cast<double> (entry.getProperty ("nsPerSample", 0.0));
+            const auto change = before > 0.0 ? (result.nsPerSample / before - 1.0) * 100.0 : 0.0;
+            const auto regressed = change > maxRegressionPercent;
+            numRegressions += regressed ? 1 : 0;
+
+            std::cout << result.benchCase.getKey().paddedRight (' ', 40) << juce::String (before, 2).paddedLeft (' ', 10)
+                      << " -> " << juce::String (result.nsPerSample, 2).paddedLeft (' ', 10) << " ns/sample  "
+                      << (change >= 0.0 ? "+" : "") << juce::String (change, 1) << "%" << (regressed ? "  REGRESSION" : "")
+                      << std::endl;
+        }
+    }
+
+    return numRegressions;
+}
+
+int runBenchmarks (const juce::ArgumentList& args)
+{
+    BenchOptions options;
+
+    if (args.containsOption ("--suite"))
+        options.suites = juce::StringArray::fromTokens (args.getValueForOption ("--suite"), ",", {});
+
+    if (args.containsOption ("--seconds"))
+        options.audioSeconds = juce::jmax (0.01, args.getValueForOption ("--seconds").getDoubleValue());
+
+    if (args.containsOption ("--json"))
+        options.jsonFile = args.getFileForOption ("--json");
+
+    if (args.containsOption ("--baseline"))
+        options.baselineFile = args.getExistingFileForOption ("--baseline");
+
+    if (args.containsOption ("--max-regression"))
+        options.maxRegressionPercent = args.getValueForOption ("--max-regression").getDoubleValue();
+
+    juce::Array<BenchResult> results;
+
+    for (const auto& suite : options.suites)
+    {
+        for (const auto& benchCase : makeCases (suite))
+        {
+            const auto result = runCase (benchCase, options.audioSeconds);
+            results.add (result);
+
+            std::cout << benchCase.getKey().paddedRight (' ', 40) << juce::String (result.nsPerSample, 2).paddedLeft (' ', 10)
+                      << (benchCase.suite.startsWith ("state") ? " ns/load  " : " ns/sample")
+                      << juce::String (result.cyclesPerVoiceSample, 1).paddedLeft (' ', 10)
+                      << " cycles/voice-sample"
+                      << (result.peakVoices > 0 ? juce::String (result.peakVoices).paddedLeft (' ', 6) + " peak voices" : juce::String())
+                      << (result.worstBlockMicros > 0.0 ? juce::String (result.worstBlockMicros, 1).paddedLeft (' ', 10) + " us worst block"
+                                                         : juce::String())
+                      << std::endl;
+        }
+    }
+
+    if (options.jsonFile != juce::File())
+        options.jsonFile.replaceWithText (juce::JSON::toString (toJson (results)));
+
+    if (options.baselineFile != juce::File())
+        return compareWithBaseline (results, options.baselineFile, options.maxRegressionPercent) > 0 ? 1 : 0;
+
+    return 0;
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    int benchResult = 0;
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "Usage: CodexPianoBench [--suite voice-simd,voice-scalar,process,process-pipelined,process-offline,"
+                                     "reverb,convolution,release,release-full,pedal,pedal-modal,program-switch,state-xml,state-binary,"
+                                     "modulation,mpe] "
+                                     "[--seconds 2] [--json out.json] [--baseline previous.json] [--max-regression 10]", true);
+    app.addDefaultCommand ({ "", "[options]", "Runs the benchmark suites", {},
+                             [&benchResult] (const juce::ArgumentList& args) { benchResult = runBenchmarks (args); } });
+
+    const auto commandResult = app.findAndRunCommand (argc, argv);
+    return commandResult != 0 ? commandResult : benchResult;
+}
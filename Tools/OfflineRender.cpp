@@ -0,0 +1,357 @@
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+
+namespace
+{
+struct RenderOptions
+{
+    juce::File midiFile;
+    juce::File outputFile;
+    juce::File stateFile;
+    juce::File goldenFile;
+    juce::File traceFile;
+    juce::File sampleFolder;
+    double preloadSeconds = -1.0;
+    juce::StringArray parameterSettings;
+    juce::StringArray tiers { "auto" };
+    double sampleRate = 48000.0;
+    int blockSize = 512;
+    double tailSeconds = -1.0;
+    float toleranceDb = -80.0f;
+};
+
+struct RenderResult
+{
+    juce::AudioBuffer<float> audio;
+    double processSeconds = 0.0;
+    int numBlocks = 0;
+    int latencySamples = 0;
+    CodexPianoVST3AudioProcessor::MemoryUsage memory;
+};
+
+RenderOptions parseOptions (const juce::ArgumentList& args)
+{
+    RenderOptions options;
+
+    options.midiFile = args.getExistingFileForOption ("--midi");
+
+    if (args.containsOption ("--out"))
+        options.outputFile = args.getFileForOption ("--out");
+
+    if (args.containsOption ("--state"))
+        options.stateFile = args.getExistingFileForOption ("--state");
+
+    if (args.containsOption ("--golden"))
+        options.goldenFile = args.getExistingFileForOption ("--golden");
+
+    if (args.containsOption ("--trace"))
+        options.traceFile = args.getFileForOption ("--trace");
+
+    if (args.containsOption ("--samples"))
+        options.sampleFolder = args.getExistingFolderForOption ("--samples");
+
+    if (args.containsOption ("--preload"))
+        options.preloadSeconds = args.getValueForOption ("--preload").getDoubleValue();
+
+    if (args.containsOption ("--rate"))
+        options.sampleRate = args.getValueForOption ("--rate").getDoubleValue();
+
+    if (args.containsOption ("--block"))
+        options.blockSize = args.getValueForOption ("--block").getIntValue();
+
+    if (args.containsOption ("--tail"))
+        options.tailSeconds = args.getValueForOption ("--tail").getDoubleValue();
+
+    if (args.containsOption ("--tolerance-db"))
+        options.toleranceDb = args.getValueForOption ("--tolerance-db").getFloatValue();
+
+    // Quality parameter choices, in order; "both" renders the real-time tier and then the offline one.
+    static const juce::StringArray tierNames { "auto", "realtime", "offline" };
+
+    if (args.containsOption ("--tier"))
+    {
+        const auto tier = args.getValueForOption ("--tier").toLowerCase();
+
+        if (tier == "both")
+            options.tiers = { "realtime", "offline" };
+        else if (tierNames.contains (tier))
+            options.tiers = juce::StringArray (tier);
+        else
+            juce::ConsoleApplication::fail ("Unknown tier: " + tier + " (auto, realtime, offline or both)");
+    }
+
+    // --set id=value may be repeated, e.g. --set gain=-3 --set engine=1
+    for (int i = 0; i < args.size() - 1; ++i)
+        if (args[i] == "--set")
+            options.parameterSettings.add (args[i + 1].text);
+
+    if (options.sampleRate < 8000.0 || options.sampleRate > 384000.0)
+        juce::ConsoleApplication::fail ("Sample rate out of range: " + juce::String (options.sampleRate));
+
+    if (options.blockSize < 1 || options.blockSize > 65536)
+        juce::ConsoleApplication::fail ("Block size out of range: " + juce::String (options.blockSize));
+
+    if (options.outputFile == juce::File() && options.goldenFile == juce::File())
+        juce::ConsoleApplication::fail ("Nothing to do: pass --out and/or --golden");
+
+    return options;
+}
+
+juce::MidiMessageSequence loadMidi (const juce::File& file)
+{
+    juce::FileInputStream stream (file);
+    juce::MidiFile midiFile;
+
+    if (! stream.openedOk() || ! midiFile.readFrom (stream))
+        juce::ConsoleApplication::fail ("Could not read MIDI file: " + file.getFullPathName());
+
+    midiFile.convertTimestampTicksToSeconds();
+
+    juce::MidiMessageSequence sequence;
+
+    for (int t = 0; t < midiFile.getNumTracks(); ++t)
+        sequence.addSequence (*midiFile.getTrack (t), 0.0);
+
+    sequence.updateMatchedPairs();
+    return sequence;
+}
+
+void applyState (CodexPianoVST3AudioProcessor& processor, const RenderOptions& options)
+{
+    if (options.stateFile != juce::File())
+    {
+        juce::MemoryBlock state;
+
+        if (! options.stateFile.loadFileAsData (state))
+            juce::ConsoleApplication::fail ("Could not read state file: " + options.stateFile.getFullPathName());
+
+        processor.setStateInformation (state.getData(), static_cast<int> (state.getSize()));
+    }
+
+    if (options.preloadSeconds >= 0.0)
+        processor.setSamplePreloadSeconds (options.preloadSeconds);
+
+    if (options.sampleFolder != juce::File() && ! processor.loadSampleFolder (options.sampleFolder))
+        juce::ConsoleApplication::fail ("No usable samples in: " + options.sampleFolder.getFullPathName());
+
+    for (const auto& setting : options.parameterSettings)
+    {
+        const auto id = setting.upToFirstOccurrenceOf ("=", false, false).trim();
+        auto* parameter = processor.apvts.getParameter (id);
+
+        if (parameter == nullptr)
+            juce::ConsoleApplication::fail ("Unknown parameter: " + id);
+
+        const auto value = setting.fromFirstOccurrenceOf ("=", false, false).getFloatValue();
+        parameter->setValueNotifyingHost (parameter->convertTo0to1 (value));
+    }
+}
+
+RenderResult render (CodexPianoVST3AudioProcessor& processor, const juce::MidiMessageSequence& sequence, const RenderOptions& options)
+{
+    const auto tailSeconds = options.tailSeconds >= 0.0 ? options.tailSeconds : processor.getTailLengthSeconds();
+    const auto totalSamples = static_cast<int> (std::ceil ((sequence.getEndTime() + tailSeconds) * options.sampleRate));
+
+    processor.setNonRealtime (true);
+    processor.setPlayConfigDetails (0, 2, options.sampleRate, options.blockSize);
+    processor.prepareToPlay (options.sampleRate, options.blockSize);
+
+    // Renders run on for the reported latency, which is then cut from the start, so the output lines up with the MIDI
+    // whichever tier rendered it.
+    const auto latency = processor.getLatencySamples();
+
+    // No message loop runs here, so the telemetry is drained by hand after every block.
+    auto& telemetry = processor.getTelemetry();
+
+    if (options.traceFile != juce::File() && ! telemetry.startTrace (options.traceFile))
+        juce::ConsoleApplication::fail ("Could not write trace: " + options.traceFile.getFullPathName());
+
+    RenderResult result;
+    result.audio.setSize (2, totalSamples);
+    result.latencySamples = latency;
+
+    juce::AudioBuffer<float> block (2, options.blockSize);
+    juce::MidiBuffer midi;
+    int nextEvent = 0;
+
+    for (int position = 0; position < totalSamples + latency; position += options.blockSize)
+    {
+        const auto numSamples = juce::jmin (options.blockSize, totalSamples + latency - position);
+        const auto blockEnd = position + numSamples;
+
+        midi.clear();
+
+        while (nextEvent < sequence.getNumEvents())
+        {
+            const auto& message = sequence.getEventPointer (nextEvent)->message;
+            const auto samplePosition = static_cast<int> (std::round (message.getTimeStamp() * options.sampleRate));
+
+            if (samplePosition >= blockEnd)
+                break;
+
+            if (! message.isMetaEvent())
+                midi.addEvent (message, juce::jmax (0, samplePosition - position));
+
+            ++nextEvent;
+        }
+
+        juce::AudioBuffer<float> view (block.getArrayOfWritePointers(), 2, numSamples);
+
+        const auto start = juce::Time::getHighResolutionTicks();
+        processor.processBlock (view, midi);
+        result.processSeconds += juce::Time::highResolutionTicksToSeconds (juce::Time::getHighResolutionTicks() - start);
+        ++result.numBlocks;
+        telemetry.collect();
+
+        const auto skip = juce::jmax (0, latency - position);
+
+        for (int ch = 0; ch < 2 && skip < numSamples; ++ch)
+            result.audio.copyFrom (ch, position + skip - latency, view, ch, skip, numSamples - skip);
+    }
+
+    telemetry.stopTrace();
+    result.memory = processor.getMemoryUsage();
+    processor.releaseResources();
+    return result;
+}
+
+void writeWav (const juce::File& file, const juce::AudioBuffer<float>& audio, double sampleRate)
+{
+    file.deleteFile();
+    auto stream = file.createOutputStream();
+
+    if (stream == nullptr)
+        juce::ConsoleApplication::fail ("Could not write: " + file.getFullPathName());
+
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatWriter> writer (wav.createWriterFor (stream.get(), sampleRate,
+                                                                          static_cast<unsigned int> (audio.getNumChannels()),
+                                                                          32, {}, 0));
+
+    if (writer == nullptr)
+        juce::ConsoleApplication::fail ("Could not create WAV writer for: " + file.getFullPathName());
+
+    stream.release();
+    writer->writeFromAudioSampleBuffer (audio, 0, audio.getNumSamples());
+}
+
+// Returns the largest sample difference against the reference, in dB relative to full scale.
+float compareWithGolden (const juce::File& file, const juce::AudioBuffer<float>& audio, double sampleRate)
+{
+    juce::WavAudioFormat wav;
+    std::unique_ptr<juce::AudioFormatReader> reader (wav.createReaderFor (new juce::FileInputStream (file), true));
+
+    if (reader == nullptr)
+        juce::ConsoleApplication::fail ("Could not read golden file: " + file.getFullPathName());
+
+    if (! juce::approximatelyEqual (reader->sampleRate, sampleRate))
+        juce::ConsoleApplication::fail ("Golden file sample rate differs: " + juce::String (reader->sampleRate));
+
+    const auto numSamples = static_cast<int> (juce::jmax (reader->lengthInSamples, static_cast<juce::int64> (audio.getNumSamples())));
+
+    juce::AudioBuffer<float> reference (audio.getNumChannels(), numSamples);
+    reference.clear();
+    reader->read (&reference, 0, static_cast<int> (reader->lengthInSamples), 0, true, true);
+
+    float maxDifference = 0.0f;
+
+    for (int ch = 0; ch < audio.getNumChannels(); ++ch)
+    {
+        const auto* expected = reference.getReadPointer (ch);
+        const auto* actual = audio.getReadPointer (ch);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const auto value = i < audio.getNumSamples() ? actual[i] : 0.0f;
+            maxDifference = juce::jmax (maxDifference, std::abs (value - expected[i]));
+        }
+    }
+
+    return juce::Decibels::gainToDecibels (maxDifference, -200.0f);
+}
+
+int runRender (const juce::ArgumentList& args)
+{
+    const auto options = parseOptions (args);
+    const auto sequence = loadMidi (options.midiFile);
+
+    CodexPianoVST3AudioProcessor processor;
+    applyState (processor, options);
+
+    RenderResult result;
+    juce::AudioBuffer<float> previousTier;
+
+    // With more than one tier, the output and golden comparison use the last one.
+    for (const auto& tier : options.tiers)
+    {
+        if (tier != "auto")
+        {
+            auto* quality = processor.apvts.getParameter ("quality");
+            quality->setValueNotifyingHost (quality->convertTo0to1 (tier == "offline" ? 2.0f : 1.0f));
+        }
+
+        previousTier = std::move (result.audio);
+        result = render (processor, sequence, options);
+        const auto audioSeconds = result.audio.getNumSamples() / options.sampleRate;
+        const auto factor = processor.getOversamplingFactor();
+
+        std::cout << "Tier " << tier << ": " << (factor > 1 ? "offline, voices oversampled " + juce::String (factor) + "x"
+                                                            : juce::String ("real-time"))
+                  << ", " << result.latencySamples << " samples of latency compensated" << std::endl;
+        std::cout << "Rendered " << juce::String (audioSeconds, 2) << " s in " << result.numBlocks << " blocks of "
+                  << options.blockSize << " @ " << options.sampleRate << " Hz" << std::endl;
+        std::cout << "Process time " << juce::String (result.processSeconds * 1000.0, 1) << " ms, real-time factor "
+                  << juce::String (audioSeconds / juce::jmax (result.processSeconds, 1.0e-9), 1) << "x" << std::endl;
+        std::cout << "Memory: " << juce::File::descriptionOfSizeInBytes (static_cast<juce::int64> (result.memory.privateBytes)) << " private, "
+                  << juce::File::descriptionOfSizeInBytes (static_cast<juce::int64> (result.memory.shared.sharedBytes)) << " in "
+                  << result.memory.shared.numResources << " shared resources" << std::endl;
+    }
+
+    if (previousTier.getNumSamples() > 0)
+    {
+        float maxDifference = 0.0f;
+
+        for (int ch = 0; ch < result.audio.getNumChannels(); ++ch)
+            for (int i = 0; i < juce::jmin (previousTier.getNumSamples(), result.audio.getNumSamples()); ++i)
+                maxDifference = juce::jmax (maxDifference, std::abs (result.audio.getSample (ch, i) - previousTier.getSample (ch, i)));
+
+        std::cout << "Tier difference: " << juce::String (juce::Decibels::gainToDecibels (maxDifference, -200.0f), 1)
+                  << " dBFS largest sample difference" << std::endl;
+    }
+
+    if (options.outputFile != juce::File())
+        writeWav (options.outputFile, result.audio, options.sampleRate);
+
+    if (options.goldenFile != juce::File())
+    {
+        const auto differenceDb = compareWithGolden (options.goldenFile, result.audio, options.sampleRate);
+        const auto passed = differenceDb <= options.toleranceDb;
+
+        std::cout << "Golden " << options.goldenFile.getFileName() << ": max difference " << juce::String (differenceDb, 1)
+                  << " dBFS (tolerance " << juce::String (options.toleranceDb, 1) << " dBFS) "
+                  << (passed ? "PASS" : "FAIL") << std::endl;
+
+        if (! passed)
+            return 1;
+    }
+
+    return 0;
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    int renderResult = 0;
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "Usage: CodexPianoRender --midi in.mid [--out out.wav] [--golden ref.wav] "
+                                     "[--rate 48000] [--block 512] [--tail seconds] [--state preset.bin] "
+                                     "[--set id=value]... [--tolerance-db -80] [--trace blocks.csv] "
+                                     "[--samples folder] [--preload seconds] [--tier auto|realtime|offline|both]", true);
+    app.addDefaultCommand ({ "--midi", "--midi in.mid --out out.wav", "Renders a MIDI file to WAV", {},
+                             [&renderResult] (const juce::ArgumentList& args) { renderResult = runRender (args); } });
+
+    const auto commandResult = app.findAndRunCommand (argc, argv);
+    return commandResult != 0 ? commandResult : renderResult;
+}
@@ -0,0 +1,428 @@
+#include <JuceHeader.h>
+#include "PluginProcessor.h"
+#include "VoiceManager.h"
+
+#if JUCE_LINUX
+ #include <cerrno>
+ #include <dlfcn.h>
+ #include <pthread.h>
+
+extern "C"
+{
+void* __libc_malloc (size_t) noexcept;
+void* __libc_calloc (size_t, size_t) noexcept;
+void* __libc_realloc (void*, size_t) noexcept;
+void* __libc_memalign (size_t, size_t) noexcept;
+void __libc_free (void*) noexcept;
+}
+#endif
+
+namespace
+{
+// Only the thread calling processBlock is audited, and only while it is inside it. Render worker threads run the
+// same voice kernels, so they are covered whenever a session renders on one thread.
+thread_local bool auditing = false;
+std::atomic<juce::int64> allocatorCalls { 0 };
+std::atomic<juce::int64> mutexLocks { 0 };
+
+void noteAllocatorCall() noexcept
+{
+    if (auditing)
+        allocatorCalls.fetch_add (1, std::memory_order_relaxed);
+}
+} // namespace
+
+#if JUCE_LINUX
+namespace
+{
+using MutexLockFunction = int (*) (pthread_mutex_t*);
+
+// Resolved lazily without a function-local static, whose guard could itself take a mutex.
+std::atomic<MutexLockFunction> nextMutexLock { nullptr };
+} // namespace
+
+// glibc: the whole malloc family is replaced, which also catches operator new, juce::HeapBlock and C libraries.
+extern "C"
+{
+void* malloc (size_t size) noexcept                 { noteAllocatorCall(); return __libc_malloc (size); }
+void* calloc (size_t count, size_t size) noexcept   { noteAllocatorCall(); return __libc_calloc (count, size); }
+void* realloc (void* ptr, size_t size) noexcept     { noteAllocatorCall(); return __libc_realloc (ptr, size); }
+void* memalign (size_t alignment, size_t size) noexcept      { noteAllocatorCall(); return __libc_memalign (alignment, size); }
+void* aligned_alloc (size_t alignment, size_t size) noexcept { noteAllocatorCall(); return __libc_memalign (alignment, size); }
+
+int posix_memalign (void** result, size_t alignment, size_t size) noexcept
+{
+    noteAllocatorCall();
+    *result = __libc_memalign (alignment, size);
+    return *result != nullptr ? 0 : ENOMEM;
+}
+
+void free (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        noteAllocatorCall();
+
+    __libc_free (ptr);
+}
+
+// Covers std::mutex, juce::CriticalSection and juce::WaitableEvent, which all end up here.
+int pthread_mutex_lock (pthread_mutex_t* mutex) noexcept
+{
+    auto next = nextMutexLock.load (std::memory_order_acquire);
+
+    if (next == nullptr)
+    {
+        next = reinterpret_cast<MutexLockFunction> (dlsym (RTLD_NEXT, "pthread_mutex_lock"));
+        nextMutexLock.store (next, std::memory_order_release);
+    }
+
+    if (auditing)
+        mutexLocks.fetch_add (1, std::memory_order_relaxed);
+
+    return next (mutex);
+}
+}
+#else
+// Elsewhere only the global operator new/delete can be replaced portably, so locks and direct malloc calls go unseen.
+void* operator new (std::size_t size)
+{
+    noteAllocatorCall();
+
+    if (auto* ptr = std::malloc (size > 0 ? size : 1))
+        return ptr;
+
+    throw std::bad_alloc();
+}
+
+void* operator new[] (std::size_t size)                  { return operator new (size); }
+void operator delete[] (void* ptr) noexcept              { operator delete (ptr); }
+void operator delete (void* ptr, std::size_t) noexcept   { operator delete (ptr); }
+void operator delete[] (void* ptr, std::size_t) noexcept { operator delete (ptr); }
+
+void operator delete (void* ptr) noexcept
+{
+    if (ptr != nullptr)
+        noteAllocatorCall();
+
+    std::free (ptr);
+}
+#endif
+
+namespace
+{
+struct CheckOptions
+{
+    int numSessions = 12;
+    int blocksPerSession = 4000;
+    juce::int64 seed = 1;
+    juce::File sampleFolder;
+};
+
+struct Violation
+{
+    int session = 0;
+    int block = 0;
+    int numSamples = 0;
+    int numEvents = 0;
+    juce::int64 allocations = 0;
+    juce::int64 locks = 0;
+};
+
+CheckOptions parseOptions (const juce::ArgumentList& args)
+{
+    CheckOptions options;
+
+    if (args.containsOption ("--sessions"))
+        options.numSessions = juce::jmax (1, args.getValueForOption ("--sessions").getIntValue());
+
+    if (args.containsOption ("--blocks"))
+        options.blocksPerSession = juce::jmax (1, args.getValueForOption ("--blocks").getIntValue());
+
+    if (args.containsOption ("--seed"))
+        options.seed = args.getValueForOption ("--seed").getLargeIntValue();
+
+    if (args.containsOption ("--samples"))
+        options.sampleFolder = args.getExistingFolderForOption ("--samples");
+
+    return options;
+}
+
+// Notes, sustain pedal, pitch bend and the other expression messages, the odd long SysEx, MPE configuration,
+// program change and panic messages, at random positions in the block. Channels span a whole MPE zone.
+void addRandomMidi (juce::MidiBuffer& midi, juce::Random& random, int numSamples)
+{
+    static constexpr juce::uint8 sysEx[] = { 0xf0, 0x7e, 0x7f, 0x06, 0x01, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+                                             0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0xf7 };
+    const auto numEvents = random.nextInt (10) < 7 ? random.nextInt (4) : random.nextInt (64);
+
+    for (int i = 0; i < numEvents; ++i)
+    {
+        const auto position = random.nextInt (numSamples);
+        const auto channel = 1 + random.nextInt (random.nextBool() ? 2 : 16);
+        const auto note = 21 + random.nextInt (88);
+        const auto kind = random.nextInt (100);
+
+        if (kind < 40)
+            midi.addEvent (juce::MidiMessage::noteOn (channel, note, 0.05f + 0.95f * random.nextFloat()), position);
+        else if (kind < 75)
+            midi.addEvent (juce::MidiMessage::noteOff (channel, note), position);
+        else if (kind < 78)
+            midi.addEvent (juce::MidiMessage::channelPressureChange (channel, random.nextInt (128)), position);
+        else if (kind < 81)
+            midi.addEvent (juce::MidiMessage::aftertouchChange (channel, note, random.nextInt (128)), position);
+        else if (kind < 84)
+            midi.addEvent (juce::MidiMessage::controllerEvent (channel, 74, random.nextInt (128)), position);
+        else if (kind < 85)
+        {
+            // RPN 6 on a master channel: an MPE configuration message resizing (or removing) a zone.
+            const auto master = random.nextBool() ? 1 : 16;
+            midi.addEvent (juce::MidiMessage::controllerEvent (master, 101, 0), position);
+            midi.addEvent (juce::MidiMessage::controllerEvent (master, 100, 6), position);
+            midi.addEvent (juce::MidiMessage::controllerEvent (master, 6, random.nextInt (16)), position);
+        }
+        else if (kind < 90)
+            midi.addEvent (juce::MidiMessage::controllerEvent (channel, 64, random.nextInt (128)), position);
+        else if (kind < 92)
+            midi.addEvent (juce::MidiMessage::controllerEvent (channel, 66, random.nextBool() ? 127 : 0), position);
+        else if (kind < 97)
+            midi.addEvent (juce::MidiMessage::pitchWheel (channel, random.nextInt (16384)), position);
+        else if (kind < 98)
+            midi.addEvent (sysEx, static_cast<int> (sizeof (sysEx)), position);
+        else if (kind < 99)
+            midi.addEvent (juce::MidiMessage::programChange (channel, random.nextInt (8)), position);
+        else
+            midi.addEvent (random.nextBool() ? juce::MidiMessage::allNotesOff (channel) : juce::MidiMessage::allSoundOff (channel), position);
+    }
+}
+
+// What a host's automation would do between two callbacks.
+void automateParameter (CodexPianoVST3AudioProcessor& processor, juce::Random& random)
+{
+    static const juce::StringArray ids { "gain", "brightness", "release", "reverb", "engine", "polyphony",
+                                         "eventGrid", "modes", "reverbType", "voiceFloor", "quality", "bendRange",
+                                         "modRate", "lfoRate", "modEnvelope", "mod1Source", "mod1Target", "mod1Amount",
+                                         "mod2Amount", "mod3Source", "mod3Amount", "mod4Target", "mod4Amount" };
+    auto* parameter = processor.apvts.getParameter (ids[random.nextInt (ids.size())]);
+    parameter->setValueNotifyingHost (random.nextFloat());
+}
+
+int runCheck (const juce::ArgumentList& args)
+{
+    const auto options = parseOptions (args);
+    juce::Random random (options.seed);
+    std::vector<Violation> violations;
+
+    static constexpr double sampleRates[] = { 44100.0, 48000.0, 96000.0 };
+    static constexpr int maxBlockSizes[] = { 32, 128, 512, 1024, 4096 };
+
+    CodexPianoVST3AudioProcessor processor;
+
+    if (options.sampleFolder != juce::File() && ! processor.loadSampleFolder (options.sampleFolder))
+        juce::ConsoleApplication::fail ("No usable samples in: " + options.sampleFolder.getFullPathName());
+
+    // Twice the largest prepared size, as the check also sends blocks larger than the host announced.
+    juce::AudioBuffer<float> buffer (2, 2 * maxBlockSizes[std::size (maxBlockSizes) - 1]);
+    juce::MidiBuffer midi;
+    midi.ensureSize (4096);
+
+    for (int session = 0; session < options.numSessions; ++session)
+    {
+        const auto sampleRate = sampleRates[random.nextInt (static_cast<int> (std::size (sampleRates)))];
+        const auto maxBlockSize = maxBlockSizes[random.nextInt (static_cast<int> (std::size (maxBlockSizes)))];
+        auto* renderThreads = processor.apvts.getParameter ("renderThreads");
+        renderThreads->setValueNotifyingHost (renderThreads->convertTo0to1 (session % 2 == 0 ? 1.0f : 4.0f));
+
+        // Every other pair of sessions hands the effects to the pipeline thread.
+        const auto pipelined = session % 4 >= 2;
+        processor.apvts.getParameter ("pipelineEffects")->setValueNotifyingHost (pipelined ? 1.0f : 0.0f);
+
+        // Every third session is prepared in the offline quality tier, so the oversampled voice path is audited too.
+        auto* quality = processor.apvts.getParameter ("quality");
+        const auto offlineTier = session % 3 == 2;
+        quality->setValueNotifyingHost (quality->convertTo0to1 (offlineTier ? 2.0f : 0.0f));
+
+        // Half the sessions, in a pattern offset from the render thread one, take the MPE zone handling.
+        const auto mpe = (session + session / 2) % 2 == 1;
+        processor.apvts.getParameter ("mpe")->setValueNotifyingHost (mpe ? 1.0f : 0.0f);
+
+        processor.setNonRealtime (false);
+        processor.setPlayConfigDetails (0, 2, sampleRate, maxBlockSize);
+        processor.prepareToPlay (sampleRate, maxBlockSize);
+
+        for (int block = 0; block < options.blocksPerSession; ++block)
+        {
+            // Mostly host-sized or smaller blocks, with the occasional one over the announced maximum.
+            const auto numSamples = random.nextInt (50) == 0 ? maxBlockSize + 1 + random.nextInt (maxBlockSize)
+                                                             : 1 + random.nextInt (maxBlockSize);
+
+            midi.clear();
+            addRandomMidi (midi, random, numSamples);
+
+            if (random.nextInt (20) == 0)
+                automateParameter (processor, random);
+
+            juce::AudioBuffer<float> view (buffer.getArrayOfWritePointers(), 2, numSamples);
+            const auto allocationsBefore = allocatorCalls.load();
+            const auto locksBefore = mutexLocks.load();
+
+            auditing = true;
+            processor.processBlock (view, midi);
+            auditing = false;
+
+            const auto allocations = allocatorCalls.load() - allocationsBefore;
+            const auto locks = mutexLocks.load() - locksBefore;
+
+            if (allocations > 0 || locks > 0)
+                violations.push_back ({ session, block, numSamples, midi.getNumEvents(), allocations, locks });
+
+            processor.getTelemetry().collect();
+        }
+
+        processor.releaseResources();
+
+        std::cout << "Session " << session + 1 << "/" << options.numSessions << ": " << sampleRate << " Hz, blocks up to "
+                  << maxBlockSize << ", " << (session % 2 == 0 ? 1 : 4) << " render thread(s)"
+                  << (pipelined ? ", pipelined effects" : "") << (offlineTier ? ", offline tier" : "") << (mpe ? ", MPE" : "")
+                  << std::endl;
+    }
+
+    for (size_t i = 0; i < juce::jmin<size_t> (violations.size(), 20); ++i)
+    {
+        const auto& violation = violations[i];
+        std::cout << "  session " << violation.session + 1 << " block " << violation.block << " (" << violation.numSamples
+                  << " samples, " << violation.numEvents << " events): " << violation.allocations << " allocator calls, "
+                  << violation.locks << " mutex locks" << std::endl;
+    }
+
+    std::cout << (violations.empty() ? "PASS" : "FAIL") << ": " << violations.size() << " of "
+              << options.numSessions * options.blocksPerSession << " blocks allocated or locked on the audio thread" << std::endl;
+
+    return violations.empty() ? 0 : 1;
+}
+
+// Any sample further than this from the reference, relative to the session's peak (or full scale, if louder),
+// fails the check. The kernels advance every lane identically and only sum the lanes in a different order, so real
+// differences sit near -140 dB; a kernel that skips a ramp, a fade or a cull lands far above the limit.
+constexpr double referenceLimitDecibels = -100.0;
+
+// Renders the same random MIDI through a vectorised VoiceManager and one on the scalar reference kernels, each
+// session with its own engine, level of detail, modulation routes and control rate, and compares the outputs.
+int runReferenceCheck (const juce::ArgumentList& args)
+{
+    const auto options = parseOptions (args);
+    juce::Random random (options.seed);
+
+    static constexpr double sampleRates[] = { 44100.0, 48000.0, 96000.0 };
+    static constexpr int maxBlockSizes[] = { 32, 128, 512, 1024 };
+    static constexpr int controlIntervals[] = { 8, 16, 32, 64 };
+    static constexpr float detailFloors[] = { 0.0f, 0.0001f, 0.001f };
+
+    auto worstDecibels = -300.0;
+    auto failures = 0;
+
+    for (int session = 0; session < options.numSessions; ++session)
+    {
+        const auto sampleRate = sampleRates[random.nextInt (static_cast<int> (std::size (sampleRates)))];
+        const auto maxBlockSize = maxBlockSizes[random.nextInt (static_cast<int> (std::size (maxBlockSizes)))];
+        const auto detailFloor = detailFloors[random.nextInt (static_cast<int> (std::size (detailFloors)))];
+        const auto oscillator = session % 2 == 0 ? VoiceBank::Oscillator::additive : VoiceBank::Oscillator::wavetable;
+        const auto brightness = random.nextFloat();
+        const auto mpe = (session + session / 2) % 2 == 1;
+
+        WavetableSet::Spectrum spectrum {};
+        WavetableSet::harmonicSpectrum (brightness, spectrum.data(), WavetableSet::maxPartials);
+        const WavetableSet tables (spectrum, sampleRate);
+
+        ModulationMatrix matrix;
+        matrix.controlInterval = controlIntervals[random.nextInt (static_cast<int> (std::size (controlIntervals)))];
+        matrix.lfoHz = 0.5f + 9.5f * random.nextFloat();
+        matrix.envelopeSeconds = 0.05f + 2.0f * random.nextFloat();
+
+        for (int i = random.nextInt (5); --i >= 0;)
+            matrix.addRoute (static_cast<ModulationMatrix::Source> (random.nextInt (ModulationMatrix::numSources)),
+                             static_cast<ModulationMatrix::Destination> (random.nextInt (ModulationMatrix::numDestinations)),
+                             random.nextFloat() - 0.5f);
+
+        std::array<VoiceManager, 2> managers;
+
+        for (size_t i = 0; i < managers.size(); ++i)
+        {
+            auto& voices = managers[i];
+            voices.setCurrentPlaybackSampleRate (sampleRate);
+            voices.prepareScratch (maxBlockSize, 1);
+            voices.setVectorisedRendering (i == 0);
+            voices.setDetailFloor (detailFloor);
+            voices.setOscillator (oscillator);
+            voices.setWavetables (&tables);
+            voices.setModulation (matrix);
+            voices.setMpeEnabled (mpe);
+            voices.updateVoiceParameters (brightness, random.nextFloat());
+        }
+
+        juce::AudioBuffer<float> vectorBuffer (2, maxBlockSize), referenceBuffer (2, maxBlockSize);
+        juce::MidiBuffer midi;
+        auto peak = 1.0f;
+        auto maxDifference = 0.0f;
+
+        for (int block = 0; block < options.blocksPerSession; ++block)
+        {
+            const auto numSamples = 1 + random.nextInt (maxBlockSize);
+
+            midi.clear();
+            addRandomMidi (midi, random, numSamples);
+
+            vectorBuffer.clear();
+            referenceBuffer.clear();
+            managers[0].renderNextBlock (vectorBuffer, midi, 0, numSamples);
+            managers[1].renderNextBlock (referenceBuffer, midi, 0, numSamples);
+
+            for (int channel = 0; channel < 2; ++channel)
+            {
+                const auto* vector = vectorBuffer.getReadPointer (channel);
+                const auto* reference = referenceBuffer.getReadPointer (channel);
+
+                for (int i = 0; i < numSamples; ++i)
+                {
+                    peak = juce::jmax (peak, std::abs (reference[i]));
+                    maxDifference = juce::jmax (maxDifference, std::abs (vector[i] - reference[i]));
+                }
+            }
+        }
+
+        const double decibels = juce::Decibels::gainToDecibels (static_cast<double> (maxDifference / peak), -300.0);
+        const auto passed = decibels <= referenceLimitDecibels;
+        worstDecibels = juce::jmax (worstDecibels, decibels);
+        failures += passed ? 0 : 1;
+
+        std::cout << "Session " << session + 1 << "/" << options.numSessions << ": " << sampleRate << " Hz, "
+                  << (oscillator == VoiceBank::Oscillator::additive ? "additive" : "wavetable") << ", floor "
+                  << detailFloor << ", " << matrix.numRoutes << " route(s) every " << matrix.controlInterval << " samples"
+                  << (mpe ? ", MPE" : "") << ": " << juce::String (decibels, 1) << " dB" << (passed ? "" : " FAIL") << std::endl;
+    }
+
+    std::cout << (failures == 0 ? "PASS" : "FAIL") << ": worst difference " << juce::String (worstDecibels, 1)
+              << " dB against a limit of " << referenceLimitDecibels << " dB, " << failures << " of "
+              << options.numSessions << " sessions over" << std::endl;
+
+    return failures == 0 ? 0 : 1;
+}
+} // namespace
+
+int main (int argc, char* argv[])
+{
+    juce::ScopedJuceInitialiser_GUI juceInitialiser;
+
+    int checkResult = 0;
+    juce::ConsoleApplication app;
+    app.addHelpCommand ("--help|-h", "Usage: CodexPianoRealtimeCheck [--reference] [--sessions 12] [--blocks 4000] [--seed 1] "
+                                     "[--samples folder]", true);
+    app.addCommand ({ "--reference", "--reference --sessions 12 --blocks 4000",
+                      "Renders the same MIDI through the vector and scalar reference voice kernels and fails if they differ", {},
+                      [&checkResult] (const juce::ArgumentList& args) { checkResult = runReferenceCheck (args); } });
+    app.addDefaultCommand ({ "--sessions", "--sessions 12 --blocks 4000",
+                             "Stress-runs processBlock and fails on any allocation or lock on the audio thread", {},
+                             [&checkResult] (const juce::ArgumentList& args) { checkResult = runCheck (args); } });
+
+    const auto commandResult = app.findAndRunCommand (argc, argv);
+    return commandResult != 0 ? commandResult : checkResult;
+}